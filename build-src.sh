@@ -27,7 +27,7 @@ cp src/include/*.h $tmpdir/src/include/
 mkdir $tmpdir/src/lib
 cp src/lib/*.c src/lib/*.h src/lib/Makefile* $tmpdir/src/lib/
 mkdir $tmpdir/src/tools
-cp src/tools/*.c src/tools/Makefile* $tmpdir/src/tools/
+cp src/tools/*.c src/tools/*.h src/tools/Makefile* $tmpdir/src/tools/
 mkdir $tmpdir/src/extra
 cp src/extra/README.txt src/extra/lzgmini.c src/extra/lzgmini.pas src/extra/lzgmini.lua src/extra/lzgmini.js src/extra/lzgmini_*.s src/extra/lzgmini_*.h $tmpdir/src/extra/
 
@@ -28,6 +28,8 @@
 #ifndef _LIBLZG_H_
 #define _LIBLZG_H_
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -55,11 +57,28 @@ extern "C" {
 * @li LZG_MaxEncodedSize() - Determine the maximum size of the encoded data for
 *                            a given uncompressed buffer (worst case).
 * @li LZG_InitEncoderConfig() - Set default encoder configuration.
+* @li LZG_EncoderWorkspaceSize() - Determine the size of the working memory
+*                                  of the encoder.
+* @li LZG_EncoderWorkspaceSizeV() - Determine the size of the working memory
+*                                   of LZG_EncodeV().
 * @li LZG_Encode() - Encode uncompressed data as LZG coded data.
+* @li LZG_EncodeV() - Encode uncompressed data that is spread over several
+*                     buffers.
 *
 * @li LZG_DecodedSize() - Determine the size of the decoded data for a given
 *                         LZG coded buffer.
+* @li LZG_EncodedSize() - Determine the size of a LZG coded buffer.
 * @li LZG_Decode() - Decode LZG coded data.
+* @li LZG_DecodeTrusted() - Decode trusted LZG coded data (no safety checks).
+* @li LZG_DecodePrefix() - Decode the first bytes of LZG coded data.
+* @li LZG_DecodeV() - Decode LZG coded data to several buffers.
+* @li LZG_InPlaceMargin() - Determine the extra buffer space that is needed
+*                            for in-place decoding.
+* @li LZG_DecodeInPlace() - Decode LZG coded data in-place.
+* @li LZG_Analyze() - Decode LZG coded data and gather statistics about the
+*                     coded data (for tuning).
+* @li LZG_Validate() - Check that LZG coded data is valid (without decoding
+*                      it).
 *
 * @li LZG_Version() - Get the version of the LZG library.
 * @li LZG_VersionString() - Get the version of the LZG library.
@@ -162,6 +181,91 @@ typedef unsigned int lzg_uint32_t; /**< @brief Unsigned 32-bit integer */
 */
 typedef void (*LZGPROGRESSFUN)(lzg_int32_t progress, void *userdata);
 
+/**
+* Memory allocation callback function.
+* @param[in] size Number of bytes to allocate.
+* @param[in] allocdata User supplied data pointer.
+* @return A pointer to the allocated memory (suitably aligned for any kind of
+*         variable, like malloc()), or NULL if the allocation failed.
+*/
+typedef void *(*LZGALLOCFUN)(lzg_uint32_t size, void *allocdata);
+
+/**
+* Memory release callback function.
+* @param[in] ptr Pointer to memory that was allocated with the corresponding
+*            @ref LZGALLOCFUN function.
+* @param[in] allocdata User supplied data pointer.
+*/
+typedef void (*LZGFREEFUN)(void *ptr, void *allocdata);
+
+/**
+* A memory segment, for data that is spread over several buffers (see
+* LZG_EncodeV() and LZG_DecodeV()). The structure has the same layout as struct iovec on POSIX
+* systems.
+*/
+typedef struct {
+    /** @brief Start of the segment. */
+    void  *base;
+
+    /** @brief Size of the segment (number of bytes). */
+    size_t size;
+} lzg_iovec_t;
+
+/** @brief Number of bins in the copy length histogram of
+    @ref lzg_encoder_stats_t (one bin per copy length, 0-128). */
+#define LZG_STATS_LENGTH_BINS 129
+
+/** @brief Number of bins in the copy offset histogram of
+    @ref lzg_encoder_stats_t (bin n holds offsets 2^n to 2^(n+1)-1). */
+#define LZG_STATS_OFFSET_BINS 20
+
+/** @brief LZG encoder statistics.
+*
+* If the @ref lzg_encoder_config_t::stats member points to this structure,
+* LZG_Encode() clears it and fills it with information about the encoding.
+*/
+typedef struct {
+    /** @brief Number of plain literals (one byte each). */
+    lzg_uint32_t literals;
+
+    /** @brief Number of literals that are equal to a marker symbol (escaped,
+        two bytes each). */
+    lzg_uint32_t escapedLiterals;
+
+    /** @brief Number of copy tokens of each type (index 0-3 = M1-M4, i.e.
+        distant, medium, short and near copies). */
+    lzg_uint32_t copies[4];
+
+    /** @brief Histogram of the copy lengths (index = copy length). */
+    lzg_uint32_t lengths[LZG_STATS_LENGTH_BINS];
+
+    /** @brief Histogram of the copy offsets (index n = offsets in the range
+        2^n to 2^(n+1)-1). */
+    lzg_uint32_t offsets[LZG_STATS_OFFSET_BINS];
+
+    /** @brief Total number of hash chain steps in the match search (a double,
+        since the count may exceed 2^32 at high compression levels). */
+    double chainSteps;
+
+    /** @brief Number of match searches that stopped early since a match of
+        the "good" length for the compression level was found. */
+    lzg_uint32_t goodLengthStops;
+
+    /** @brief Time spent in the histogram / marker symbol selection phase
+        (seconds, including the checksum of the uncompressed data). */
+    double markerTime;
+
+    /** @brief Time spent in the match search phase (seconds, including the
+        setup and updates of the search data structures). The split between
+        the search and emit phases is estimated by timing a sample of the
+        input positions. */
+    double searchTime;
+
+    /** @brief Time spent in the emit phase (seconds, writing tokens and the
+        header). */
+    double emitTime;
+} lzg_encoder_stats_t;
+
 /** @brief LZG compression configuration parameters.
 *
 * This structure is used for passing configuration options to the LZG_Encode()
@@ -204,6 +308,86 @@ typedef struct {
 
         Default value: NULL */
     void *userdata;
+
+    /** @brief Store a checksum of the uncompressed data (LZG_FALSE or
+        LZG_TRUE).
+
+        When enabled, the encoder calculates a checksum of the uncompressed
+        data and stores it in an extended header (four extra bytes), and
+        LZG_Decode() verifies the decoded data against it. This protects
+        against encoder and decoder errors, which the checksum of the
+        compressed data can not detect. Note that older decoders (and the
+        decoders in the extra folder) do not support the extended header.
+
+        Default value: LZG_FALSE */
+    lzg_bool_t contentChecksum;
+
+    /** @brief Encoder statistics (set this to NULL to disable statistics).
+
+        When not NULL, the encoder collects statistics about the encoded data
+        (token counts, match lengths and offsets etc) and the time spent in
+        each phase. If the data can not be compressed (and is stored as a
+        plain copy), the statistics describe the aborted attempt. The
+        statistics are gathered in a separate version of the encoder, so there
+        is no overhead when this is NULL. With statistics, the encoder is
+        about 5-15% slower (the counters are updated, and the clock is read
+        for a sample of the positions), which is usually acceptable for
+        production metrics.
+
+        Default value: NULL */
+    lzg_encoder_stats_t *stats;
+
+    /** @brief Memory allocation function (set this to NULL to use malloc()).
+
+        The encoder allocates its working memory (see
+        LZG_EncoderWorkspaceSize()) once per call, with this function. It is
+        not used if a @ref workspace is given.
+
+        Default value: NULL */
+    LZGALLOCFUN allocfun;
+
+    /** @brief Memory release function (set this to NULL if the memory from
+        @ref allocfun does not need to be released, e.g. for an arena).
+
+        Default value: NULL */
+    LZGFREEFUN freefun;
+
+    /** @brief User data pointer for the memory allocation functions.
+
+        Default value: NULL */
+    void *allocdata;
+
+    /** @brief Caller provided working memory for the encoder (or NULL).
+
+        When given, the encoder does not allocate any memory. The workspace
+        must be at least LZG_EncoderWorkspaceSize() bytes, suitably aligned
+        for pointers (e.g. from malloc()), and zero filled before its first
+        use. The encoder leaves it zero filled, so it can be reused for any
+        number of calls (but only by one thread at a time).
+
+        Default value: NULL */
+    void *workspace;
+
+    /** @brief Size of the @ref workspace (number of bytes).
+
+        Default value: 0 */
+    lzg_uint32_t workspaceSize;
+
+    /** @brief Use huge pages for the working memory, if possible (LZG_FALSE
+        or LZG_TRUE).
+
+        The search tables are accessed randomly, and in fast mode they are
+        large (about 64 MB), so with normal memory pages most accesses miss
+        the TLB. When enabled, the encoder allocates the tables with explicit
+        huge pages (Linux MAP_HUGETLB) or transparent huge pages (Linux
+        MADV_HUGEPAGE), or large pages on Windows (which requires the "Lock
+        pages in memory" privilege). If that fails, or if the tables are
+        small, normal memory is used. It is not used together with
+        @ref allocfun or @ref workspace (a caller that provides the memory
+        can use huge pages for it by itself).
+
+        Default value: LZG_FALSE */
+    lzg_bool_t hugePages;
 } lzg_encoder_config_t;
 
 
@@ -221,6 +405,33 @@ lzg_uint32_t LZG_MaxEncodedSize(lzg_uint32_t insize);
 */
 void LZG_InitEncoderConfig(lzg_encoder_config_t *config);
 
+/**
+* Determine the size of the working memory that the encoder needs.
+* @param[in] level Compression level (1-9).
+* @param[in] fast Use fast method (LZG_FALSE or LZG_TRUE).
+* @param[in] insize Size of the uncompressed buffer (number of bytes). A
+*            workspace for a given size can be used for all smaller sizes too.
+* @return The size of the working memory (number of bytes).
+* @note This is the memory that is allocated by LZG_Encode(), or that can be
+* given as a workspace in the encoder configuration.
+*/
+lzg_uint32_t LZG_EncoderWorkspaceSize(lzg_int32_t level, lzg_bool_t fast,
+                                      lzg_uint32_t insize);
+
+/**
+* Determine the size of the working memory that LZG_EncodeV() needs.
+* @param[in] level Compression level (1-9).
+* @param[in] fast Use fast method (LZG_FALSE or LZG_TRUE).
+* @param[in] insize Total size of the uncompressed segments (number of bytes).
+* @return The size of the working memory (number of bytes).
+* @note This is LZG_EncoderWorkspaceSize() plus the staging buffer of
+* LZG_EncodeV(), which is the window of the compression level plus one block
+* of the larger of the window and 64 KB (at most about 1 MB, and never more
+* than insize).
+*/
+lzg_uint32_t LZG_EncoderWorkspaceSizeV(lzg_int32_t level, lzg_bool_t fast,
+                                       lzg_uint32_t insize);
+
 /**
 * Encode uncompressed data using the LZG coder (i.e. compress the data).
 * @param[in]  in Input (uncompressed) buffer.
@@ -233,16 +444,43 @@ void LZG_InitEncoderConfig(lzg_encoder_config_t *config);
 *         (e.g. if the end of the output buffer was reached before the
 *         entire input buffer was encoded).
 * @note For the slow method (config->fast = 0), the memory requirement during
-* compression is 136 KB (LZG_LEVEL_1) to 2 MB (LZG_LEVEL_9). For the fast
+* compression is 264 KB (LZG_LEVEL_1) to 4.25 MB (LZG_LEVEL_9). For the fast
 * method (config->fast = 1), the memory requirement is 64 MB (LZG_LEVEL_1) to
-* 66 MB (LZG_LEVEL_9). Also note that these figures are doubled on 64-bit
-* systems.
+* 68 MB (LZG_LEVEL_9), on 32-bit and 64-bit systems alike. The figures are
+* smaller for inputs that are smaller than the window of the compression
+* level (see LZG_EncoderWorkspaceSize()).
 */
 lzg_uint32_t LZG_Encode(const unsigned char *in, lzg_uint32_t insize,
                         unsigned char *out, lzg_uint32_t outsize,
                         lzg_encoder_config_t *config);
 
 
+/**
+* Encode uncompressed data that is spread over several buffers.
+*
+* This works like LZG_Encode(), but the input is given as a list of segments,
+* that are encoded as one logical stream (copies may span segment boundaries,
+* and the result can be decoded with LZG_Decode() as usual).
+* @param[in]  iov Input segments.
+* @param[in]  iovcnt Number of input segments.
+* @param[out] out Output (compressed) buffer.
+* @param[in]  outsize Size of the output buffer (number of bytes).
+* @param[in]  config Compression configuration (if set to NULL, default encoder
+*             configuration parameters are used).
+* @return The size of the encoded data, or zero if the function failed
+*         (e.g. if the total size of the segments does not fit in 32 bits).
+* @note Segments that follow each other in memory are encoded in place.
+* Other segments are copied block by block to a staging buffer, that holds the
+* search window of the current position and a small lookahead, but not the
+* entire input. The staging buffer is a part of the working memory (see
+* LZG_EncoderWorkspaceSizeV(), which is also the minimum size of
+* config->workspace for such input).
+*/
+lzg_uint32_t LZG_EncodeV(const lzg_iovec_t *iov, int iovcnt,
+                         unsigned char *out, lzg_uint32_t outsize,
+                         lzg_encoder_config_t *config);
+
+
 /**
 * Determine the size of the decoded data for a given LZG coded buffer.
 * @param[in] in Input (compressed) buffer.
@@ -256,6 +494,20 @@ lzg_uint32_t LZG_Encode(const unsigned char *in, lzg_uint32_t insize,
 lzg_uint32_t LZG_DecodedSize(const unsigned char *in, lzg_uint32_t insize);
 
 
+/**
+* Determine the size of a LZG coded buffer (including the header), given the
+* beginning of the buffer. This is useful for finding the end of a coded
+* buffer in a stream, for instance.
+* @param[in] in Input (compressed) buffer.
+* @param[in] insize Size of the input buffer (number of bytes). This does
+*            not have to be the size of the entire compressed data, but
+*            it has to be at least 16 bytes (the header).
+* @return The size of the coded buffer, or zero if the function failed
+*         (e.g. if the magic header ID could not be found).
+*/
+lzg_uint32_t LZG_EncodedSize(const unsigned char *in, lzg_uint32_t insize);
+
+
 /**
 * Decode LZG coded data.
 * @param[in]  in Input (compressed) buffer.
@@ -270,6 +522,209 @@ lzg_uint32_t LZG_Decode(const unsigned char *in, lzg_uint32_t insize,
                         unsigned char *out, lzg_uint32_t outsize);
 
 
+/**
+* Decode trusted LZG coded data, without any safety checks.
+*
+* This works like LZG_Decode(), but the checksums are not verified and the
+* decoder does no bounds checks on the input or output buffers, which makes it
+* faster. It gives the same speed as building the library with LZG_UNSAFE, but
+* only for the calls that opt in to it.
+* @param[in]  in Input (compressed) buffer.
+* @param[in]  insize Size of the input buffer (number of bytes).
+* @param[out] out Output (uncompressed) buffer.
+* @param[in]  outsize Size of the output buffer (number of bytes).
+* @return The size of the decoded data, or zero if the header is invalid or
+*         the output buffer is too small.
+* @warning Corrupt or malicious data may result in invalid memory accesses.
+* ONLY use this function for data that is known to be intact (e.g. data that
+* was embedded in the executable, or that has already been validated with
+* LZG_Validate() or LZG_Decode()).
+*/
+lzg_uint32_t LZG_DecodeTrusted(const unsigned char *in, lzg_uint32_t insize,
+                               unsigned char *out, lzg_uint32_t outsize);
+
+
+/**
+* Decode the first bytes of LZG coded data.
+*
+* This works like LZG_Decode(), but decoding stops as soon as the output
+* buffer is full, so the decoding time is proportional to the output buffer
+* size rather than to the size of the decoded data (e.g. for reading the
+* header of a large file).
+* @param[in]  in Input (compressed) buffer (the complete coded buffer).
+* @param[in]  insize Size of the input buffer (number of bytes).
+* @param[out] out Output (uncompressed) buffer.
+* @param[in]  outsize Number of bytes to decode (the size of the output
+*             buffer).
+* @param[in]  verify If LZG_TRUE, the checksum of the coded data is verified
+*             before decoding, which reads all the coded data. The checksum of
+*             the decoded data (if any) is verified too, if all the data was
+*             decoded. If LZG_FALSE, no checksums are verified, and the check
+*             can be deferred to a later call to LZG_Validate() or
+*             LZG_Decode().
+* @return The number of decoded bytes (the smaller of outsize and the size of
+*         the decoded data), or zero if the function failed (e.g. if the data
+*         is corrupt).
+* @note The decoder always does bounds checks, so corrupt data can not cause
+* invalid memory accesses, even if verify is LZG_FALSE.
+*/
+lzg_uint32_t LZG_DecodePrefix(const unsigned char *in, lzg_uint32_t insize,
+                              unsigned char *out, lzg_uint32_t outsize,
+                              lzg_bool_t verify);
+
+
+/**
+* Decode LZG coded data to several buffers.
+*
+* This works like LZG_Decode(), but the decoded data is written to a list of
+* segments (e.g. fixed size pages), that are filled in order. Copies that span
+* segment boundaries are resolved by the decoder.
+* @param[in]  in Input (compressed) buffer.
+* @param[in]  insize Size of the input buffer (number of bytes).
+* @param[out] iov Output segments. The last segment that is used may be
+*             partially filled, and the following segments are not touched.
+* @param[in]  iovcnt Number of output segments.
+* @return The size of the decoded data, or zero if the function failed
+*         (e.g. if the data is corrupt, or if it does not fit in the
+*         segments).
+* @note Decoding is slightly slower than with LZG_Decode(), and much slower if
+* the segments are very small (copies that cross a segment boundary are done
+* one byte at a time).
+*/
+lzg_uint32_t LZG_DecodeV(const unsigned char *in, lzg_uint32_t insize,
+                         const lzg_iovec_t *iov, int iovcnt);
+
+
+/**
+* Determine the safety margin that is required for decoding LZG coded data
+* in-place (see LZG_DecodeInPlace()).
+* @param[in]  in Input (compressed) buffer.
+* @param[in]  insize Size of the input buffer (number of bytes).
+* @param[out] margin The number of bytes that the in-place buffer must hold in
+*             addition to the decoded data (zero is a valid margin).
+* @return LZG_TRUE on success, or LZG_FALSE if the function failed (e.g. if
+*         the data is corrupt).
+* @note The margin is determined by scanning the entire coded data, so it is
+* preferably calculated once (e.g. when the data is created) and stored along
+* with the coded data.
+*/
+lzg_bool_t LZG_InPlaceMargin(const unsigned char *in, lzg_uint32_t insize,
+                             lzg_uint32_t *margin);
+
+
+/**
+* Decode LZG coded data in-place.
+*
+* The coded data shall be located at the end of the buffer, and the decoded
+* data is written to the start of the buffer. This way only one buffer of
+* size LZG_DecodedSize() + LZG_InPlaceMargin() is needed.
+* @param[in,out] buf In-place buffer.
+* @param[in]  bufsize Size of the in-place buffer (number of bytes).
+* @param[in]  insize Size of the coded data (number of bytes), which occupies
+*             the last insize bytes of the buffer.
+* @return The size of the decoded data, or zero if the function failed
+*         (e.g. if the buffer is too small, or if the data is corrupt).
+* @note If the function fails, the coded data may have been overwritten.
+*/
+lzg_uint32_t LZG_DecodeInPlace(unsigned char *buf, lzg_uint32_t bufsize,
+                               lzg_uint32_t insize);
+
+
+/** @brief LZG decoder statistics (see LZG_Analyze() and LZG_Validate()). */
+typedef struct {
+    /** @brief Number of plain literals (one byte each). */
+    lzg_uint32_t literals;
+
+    /** @brief Number of literals that are equal to a marker symbol (escaped,
+        two bytes each). */
+    lzg_uint32_t escapedLiterals;
+
+    /** @brief Number of copy tokens of each type (index 0-3 = M1-M4, i.e.
+        distant, medium, short and near copies). */
+    lzg_uint32_t copies[4];
+
+    /** @brief Number of decoded bytes produced by each copy token type. */
+    lzg_uint32_t copyBytes[4];
+
+    /** @brief Largest copy offset that is used (the history that a streaming
+        decoder needs to keep). */
+    lzg_uint32_t maxOffset;
+
+    /** @brief Fraction of the decoded data that is coded as literals (0-1).
+        */
+    double literalRatio;
+
+    /** @brief Histogram of the copy lengths (index = copy length). */
+    lzg_uint32_t lengths[LZG_STATS_LENGTH_BINS];
+
+    /** @brief Histogram of the copy offsets (index n = offsets in the range
+        2^n to 2^(n+1)-1). */
+    lzg_uint32_t offsets[LZG_STATS_OFFSET_BINS];
+
+    /** @brief Number of copies that were cut short by the length quantization
+        (e.g. a match of 40 bytes is coded as a copy of 35 bytes). */
+    lzg_uint32_t quantizedCopies;
+
+    /** @brief Number of matching bytes that were lost by the length
+        quantization (and coded by the following tokens instead). */
+    lzg_uint32_t quantizedBytes;
+
+    /** @brief Estimated number of coded bytes that better (lazy or optimal)
+        parsing could save.
+
+        This is the number of literals that a copy could have absorbed by
+        starting earlier, plus the size of the copies that the following copy
+        could have replaced entirely. */
+    lzg_uint32_t parseGainBytes;
+} lzg_decoder_stats_t;
+
+/**
+* Decode LZG coded data, and gather statistics about the coded data.
+*
+* This works like LZG_Decode(), but while it decodes the data it also
+* collects token counts, copy length and offset distributions, and an
+* analysis of the length quantization and the parsing (which needs the
+* decoded data). It is intended for tuning, e.g. for choosing compression
+* levels.
+* @param[in]  in Input (compressed) buffer.
+* @param[in]  insize Size of the input buffer (number of bytes).
+* @param[out] out Output (uncompressed) buffer.
+* @param[in]  outsize Size of the output buffer (number of bytes).
+* @param[out] stats Statistics (all zero for data that is stored as a plain
+*             copy).
+* @return The size of the decoded data, or zero if the function failed
+*         (e.g. if the end of the output buffer was reached before the
+*         entire input buffer was decoded).
+*/
+lzg_uint32_t LZG_Analyze(const unsigned char *in, lzg_uint32_t insize,
+                         unsigned char *out, lzg_uint32_t outsize,
+                         lzg_decoder_stats_t *stats);
+
+
+/**
+* Check that LZG coded data is valid, without decoding it.
+*
+* The header, the checksum of the coded data and the entire token stream are
+* checked, with the same checks as LZG_Decode(). Since no data is written,
+* this is considerably faster than decoding into a scratch buffer, and no
+* output buffer is needed.
+* @param[in]  in Input (compressed) buffer.
+* @param[in]  insize Size of the input buffer (number of bytes).
+* @param[out] stats Statistics (token counts etc), or NULL. The quantization
+*             and parsing analysis of LZG_Analyze() is not done, since it
+*             needs the decoded data.
+* @return LZG_TRUE if LZG_Decode() would succeed, apart from the check of the
+*         decoded data checksum, otherwise LZG_FALSE.
+* @note The checksum of the decoded data (see
+* @ref lzg_encoder_config_t::contentChecksum) can only be verified by
+* decoding the data, so it is not checked. For data with such a checksum,
+* LZG_Decode() may still fail after a successful validation (if the data was
+* corrupted and the checksum of the coded data was updated to match).
+*/
+lzg_bool_t LZG_Validate(const unsigned char *in, lzg_uint32_t insize,
+                        lzg_decoder_stats_t *stats);
+
+
 /**
 * Get the version of the LZG library.
 * @return The version of the LZG library, on the same format as
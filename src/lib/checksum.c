@@ -27,6 +27,11 @@
 
 #include "internal.h"
 
+#if defined(__SSE2__) && !defined(LZG_NO_SIMD)
+# include <emmintrin.h>
+# define _LZG_CHECKSUM_SSE2
+#endif
+
 /*
 * Description:
 * This is a very fast 32-bit checksum algorithm. It is essentially a modified
@@ -38,6 +43,11 @@
 * takes almost the same time as the decompression routine), while still being
 * as robust as Adler-32 (which is used in zlib, for instance).
 *
+* Since both sums are taken modulo 65536, they can be accumulated in wider
+* (wrapping) integers and truncated at the end. This makes it possible to
+* process 16 bytes at a time with SIMD instructions: for a block of 16 bytes
+* x[0..15], a += sum(x[i]) and b += 16 * a + sum((16 - i) * x[i]).
+*
 * References:
 *     http://en.wikipedia.org/wiki/Adler-32
 *     http://en.wikipedia.org/wiki/Fletcher's_checksum
@@ -48,14 +58,77 @@
     b += a; \
 } while(0)
 
-lzg_uint32_t _LZG_CalcChecksum(const unsigned char *data, lzg_uint32_t size)
+#ifdef _LZG_CHECKSUM_SSE2
+static lzg_uint32_t _LZG_HorizontalSum(__m128i x)
+{
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (lzg_uint32_t) _mm_cvtsi128_si32(x);
+}
+
+static lzg_uint32_t _LZG_UpdateChecksumSSE2(lzg_uint32_t checksum,
+    const unsigned char *data, lzg_uint32_t blocks)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weightsLo = _mm_set_epi16(9, 10, 11, 12, 13, 14, 15, 16);
+    const __m128i weightsHi = _mm_set_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+    __m128i x, sumA, sumAPrev, sumB;
+    lzg_uint32_t a, b, n;
+
+    a = checksum & 0xffff;
+    b = checksum >> 16;
+
+    sumA = zero;
+    sumAPrev = zero;
+    sumB = zero;
+    for (n = blocks; n != 0; --n)
+    {
+        x = _mm_loadu_si128((const __m128i *) data);
+        data += 16;
+
+        /* Sum of a over all previous blocks (scaled by 16 below) */
+        sumAPrev = _mm_add_epi32(sumAPrev, sumA);
+
+        /* a += sum(x[i]) */
+        sumA = _mm_add_epi32(sumA, _mm_sad_epu8(x, zero));
+
+        /* b += sum((16 - i) * x[i]) */
+        sumB = _mm_add_epi32(sumB,
+            _mm_madd_epi16(_mm_unpacklo_epi8(x, zero), weightsLo));
+        sumB = _mm_add_epi32(sumB,
+            _mm_madd_epi16(_mm_unpackhi_epi8(x, zero), weightsHi));
+    }
+
+    b += 16 * blocks * a + 16 * _LZG_HorizontalSum(sumAPrev) +
+         _LZG_HorizontalSum(sumB);
+    a += _LZG_HorizontalSum(sumA);
+
+    return ((b & 0xffff) << 16) | (a & 0xffff);
+}
+#endif
+
+lzg_uint32_t _LZG_UpdateChecksum(lzg_uint32_t checksum,
+    const unsigned char *data, lzg_uint32_t size)
 {
-    unsigned short a = 1, b = 0;
+    unsigned short a, b;
     lzg_uint32_t size8, sizediv8;
     unsigned char *ptr, *end;
 
     ptr = (unsigned char*)data;
 
+#ifdef _LZG_CHECKSUM_SSE2
+    /* Vectorized main loop (modulo 16) */
+    if (size >= 16)
+    {
+        checksum = _LZG_UpdateChecksumSSE2(checksum, ptr, size / 16);
+        ptr += size & ~15;
+        size &= 15;
+    }
+#endif
+
+    a = (unsigned short) checksum;
+    b = (unsigned short) (checksum >> 16);
+
     /* Loop unrolling (modulo 8) */
     sizediv8 = size / 8;
     size8 = sizediv8 * 8;
@@ -77,3 +150,8 @@ lzg_uint32_t _LZG_CalcChecksum(const unsigned char *data, lzg_uint32_t size)
 
     return (((lzg_uint32_t)b) << 16) | a;
 }
+
+lzg_uint32_t _LZG_CalcChecksum(const unsigned char *data, lzg_uint32_t size)
+{
+    return _LZG_UpdateChecksum(LZG_CHECKSUM_INIT, data, size);
+}
@@ -25,6 +25,7 @@
 *    distribution.
 */
 
+#include <string.h>
 #include "internal.h"
 
 
@@ -35,6 +36,8 @@
 * performed. This will speed up the decoder by 10-20%, but may result in invalid
 * memory accesses in case of corrupted data.
 * DO NOT enable this unless you can trust your data 100%!
+* NOTE: LZG_DecodeTrusted() gives the same speed for selected calls, without
+* disabling the checks in the rest of the library.
 */
 /* #define LZG_UNSAFE */
 
@@ -55,36 +58,62 @@ static const unsigned char _LZG_LENGTH_DECODE_LUT[32] = {
      ((lzg_uint32_t)in[offs+3]))
 
 /* This macro is used for out-of-bounds checks, to prevent invalid memory
-   accesses. */
+   accesses (only when checked is TRUE, see _LZG_DecodeLZG1). */
 #ifndef LZG_UNSAFE
-# define CHECK_BOUNDS(expr) if (UNLIKELY(!(expr))) return 0
+# define CHECK_BOUNDS(expr) \
+    if (checked && UNLIKELY(!(expr))) return (unsigned char*) 0
 #else
 # define CHECK_BOUNDS(expr)
 #endif
 
 
-/*-- PUBLIC ------------------------------------------------------------------*/
-
-lzg_uint32_t LZG_DecodedSize(const unsigned char *in, lzg_uint32_t insize)
-{
-    if (insize < 7)
-        return 0;
+/* Copy length bytes from copy to dst, front to back (the areas may overlap),
+   with loop unrolling to improve the speed (i is used as a loop counter) */
+#define _LZG_COPY_UNROLLED(dst, copy, length) \
+    switch (length)                                            \
+    {                                                          \
+        default:                                               \
+            for (i = 29; i < length; ++i)                      \
+                *dst++ = *copy++;                              \
+            LZG_FALLTHROUGH;                                   \
+        case 29: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 28: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 27: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 26: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 25: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 24: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 23: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 22: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 21: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 20: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 19: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 18: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 17: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 16: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 15: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 14: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 13: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 12: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 11: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 10: *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 9:  *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 8:  *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 7:  *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 6:  *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 5:  *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 4:  *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 3:  *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 2:  *dst++ = *copy++; LZG_FALLTHROUGH;            \
+        case 1:  *dst++ = *copy++;                             \
+    }
 
-    /* Check magic number */
-    if ((in[0] != 'L') || (in[1] != 'Z') || (in[2] != 'G'))
-        return 0;
 
-    /* Get output buffer size */
-    return _LZG_GetUINT32(in, 3);
-}
-
-unsigned int LZG_Decode(const unsigned char *in, lzg_uint32_t insize,
-    unsigned char *out, lzg_uint32_t outsize)
+/* Read and check the header. Returns the header size (the start of the
+   encoded data), or zero if the header is invalid. */
+static lzg_uint32_t _LZG_GetHeader(const unsigned char *in,
+    lzg_uint32_t insize, lzg_header *hdr)
 {
-    unsigned char *src, *inEnd, *dst, *outEnd, *copy, symbol, b, b2;
-    unsigned char marker1, marker2, marker3, marker4, method;
-    lzg_uint32_t  i, length, offset, encodedSize, decodedSize, checksum;
-    char isMarkerSymbolLUT[256];
+    lzg_uint32_t hdrSize;
 
     /* Does the input buffer at least contain the header? */
     if (insize < LZG_HEADER_SIZE)
@@ -94,68 +123,153 @@ unsigned int LZG_Decode(const unsigned char *in, lzg_uint32_t insize,
     if ((in[0] != 'L') || (in[1] != 'Z') || (in[2] != 'G'))
         return 0;
 
-    /* Get & check output buffer size */
-    decodedSize = _LZG_GetUINT32(in, 3);
-    if (outsize < decodedSize)
+    /* Check which method is used */
+    hdr->method = in[15] & LZG_METHOD_MASK;
+    hdr->flags = in[15] & ~LZG_METHOD_MASK;
+    if ((hdr->method > LZG_METHOD_LZG1) ||
+        (hdr->flags & ~LZG_FLAG_CONTENT_CHECKSUM))
         return 0;
 
-    /* Get & check input buffer size */
-    encodedSize = _LZG_GetUINT32(in, 7);
-    if (encodedSize != (insize - LZG_HEADER_SIZE))
-        return 0;
+    /* Get the decoded content checksum (extended header) */
+    hdrSize = LZG_HEADER_SIZE;
+    hdr->contentChecksum = 0;
+    if (hdr->flags & LZG_FLAG_CONTENT_CHECKSUM)
+    {
+        hdrSize = LZG_EXT_HEADER_SIZE;
+        if (insize < hdrSize)
+            return 0;
+        hdr->contentChecksum = _LZG_GetUINT32(in, 16);
+    }
 
-    /* Get & check checksum */
-#ifndef LZG_UNSAFE
-    checksum = _LZG_GetUINT32(in, 11);
-    if (_LZG_CalcChecksum(&in[LZG_HEADER_SIZE], encodedSize) != checksum)
-        return 0;
-#endif
+    /* Get sizes & checksum */
+    hdr->decodedSize = _LZG_GetUINT32(in, 3);
+    hdr->encodedSize = _LZG_GetUINT32(in, 7);
+    hdr->checksum = _LZG_GetUINT32(in, 11);
 
-    /* Check which method is used */
-    method = in[15];
-    if (method > LZG_METHOD_LZG1)
+    /* Check input buffer size */
+    if (hdr->encodedSize != (insize - hdrSize))
+        return 0;
+    if ((hdr->method == LZG_METHOD_COPY) &&
+        (hdr->decodedSize != hdr->encodedSize))
         return 0;
 
-    /* Initialize the byte streams */
-    src = (unsigned char *)in;
-    inEnd = ((unsigned char *)in) + insize;
-    dst = out;
-    outEnd = out + outsize;
-
-    /* Skip header information */
-    src += LZG_HEADER_SIZE;
+    return hdrSize;
+}
 
-    /* Plain copy? */
-    if (method == LZG_METHOD_COPY)
+/* Copy types, as returned by _LZG_DecodeCopy (and used as indices of the
+   statistics arrays) */
+#define COPY_DISTANT 0
+#define COPY_MEDIUM  1
+#define COPY_SHORT   2
+#define COPY_NEAR    3
+
+/* Read the four marker symbols at the start of an LZG1 data stream (which
+   must hold at least four bytes), and set up a LUT of the marker symbols */
+static LZG_INLINE void _LZG_GetMarkers(const unsigned char *in,
+    unsigned char *markers, char *isMarkerSymbolLUT)
+{
+    int i;
+    for (i = 0; i < 256; ++i)
+        isMarkerSymbolLUT[i] = 0;
+    for (i = 0; i < 4; ++i)
     {
-        if (decodedSize != encodedSize)
-            return 0;
+        markers[i] = in[i];
+        isMarkerSymbolLUT[in[i]] = 1;
+    }
+}
 
-        /* Copy 1:1, input buffer to output buffer */
-        for (i = decodedSize; i != 0; i--)
-            *dst++ = *src++;
+/* Decode the length and offset parameters of a copy token, given its marker
+   symbol and the (non-zero) byte that follows it, and move src past the
+   token. Returns the copy type, or -1 if the token is cut off by the end of
+   the input (only checked when checked is TRUE). All the LZG1 decoders parse
+   the tokens with this routine. */
+static LZG_INLINE int _LZG_DecodeCopy(const unsigned char **src,
+    const unsigned char *inEnd, const unsigned char *markers,
+    unsigned char symbol, unsigned char b, lzg_bool_t checked,
+    lzg_uint32_t *length, lzg_uint32_t *offset)
+{
+    const unsigned char *s = *src;
 
-        return decodedSize;
+    if (LIKELY(symbol == markers[0]))
+    {
+        /* Distant copy */
+        if (checked && UNLIKELY((s + 2) > inEnd))
+            return -1;
+        *length = _LZG_LENGTH_DECODE_LUT[b & 0x1f];
+        *offset = ((((lzg_uint32_t)(b & 0xe0)) << 11) |
+                   (((lzg_uint32_t)s[0]) << 8) | s[1]) + 2056;
+        *src = s + 2;
+        return COPY_DISTANT;
+    }
+    else if (LIKELY(symbol == markers[1]))
+    {
+        /* Medium copy */
+        if (checked && UNLIKELY(s >= inEnd))
+            return -1;
+        *length = _LZG_LENGTH_DECODE_LUT[b & 0x1f];
+        *offset = ((((lzg_uint32_t)(b & 0xe0)) << 3) | s[0]) + 8;
+        *src = s + 1;
+        return COPY_MEDIUM;
     }
+    else if (LIKELY(symbol == markers[2]))
+    {
+        /* Short copy */
+        *length = (b >> 6) + 3;
+        *offset = (b & 0x3f) + 8;
+        return COPY_SHORT;
+    }
+    else
+    {
+        /* Near copy (including RLE) */
+        *length = _LZG_LENGTH_DECODE_LUT[b & 0x1f];
+        *offset = (b >> 5) + 1;
+        return COPY_NEAR;
+    }
+}
+
+
+/* Decode an LZG1 data stream (the data following the header). Returns the end
+   of the decoded data, or zero if the data is corrupt.
+   When inPlace is TRUE, the output never overtakes the unread input, i.e. the
+   input may be located at the end of the output buffer.
+   When checked is FALSE, there are no bounds checks at all (for trusted data
+   only).
+   When prefix is TRUE, decoding stops as soon as the output buffer is full
+   (the last copy is cut short), instead of failing.
+   The routine is always called with constant flags, so each variant is
+   compiled separately. */
+static LZG_INLINE unsigned char *_LZG_DecodeLZG1(const unsigned char *in,
+    const unsigned char *inEnd, unsigned char *out, unsigned char *outEnd,
+    lzg_bool_t inPlace, lzg_bool_t checked, lzg_bool_t prefix)
+{
+    const unsigned char *src;
+    unsigned char *dst, *copy, symbol, b, markers[4];
+    lzg_uint32_t  i, length, offset;
+    char isMarkerSymbolLUT[256];
+
+#ifdef LZG_UNSAFE
+    checked = FALSE;
+#endif
+
+    /* Output limit (for in-place decoding: the current read position) */
+#define OUT_LIMIT (inPlace ? src : outEnd)
+
+    /* Initialize the byte streams */
+    src = in;
+    dst = out;
 
     /* Get marker symbols from the input stream */
     CHECK_BOUNDS((src + 4) <= inEnd);
-    marker1 = *src++;
-    marker2 = *src++;
-    marker3 = *src++;
-    marker4 = *src++;
-
-    /* Initialize marker symbol LUT */
-    for (i = 0; i < 256; ++i)
-        isMarkerSymbolLUT[i] = 0;
-    isMarkerSymbolLUT[marker1] = 1;
-    isMarkerSymbolLUT[marker2] = 1;
-    isMarkerSymbolLUT[marker3] = 1;
-    isMarkerSymbolLUT[marker4] = 1;
+    _LZG_GetMarkers(src, markers, isMarkerSymbolLUT);
+    src += 4;
 
     /* Main decompression loop */
     while (src < inEnd)
     {
+        /* Done with the requested prefix? */
+        if (prefix && (dst >= outEnd))
+            break;
+
         /* Get the next symbol */
         symbol = *src++;
 
@@ -163,7 +277,7 @@ unsigned int LZG_Decode(const unsigned char *in, lzg_uint32_t insize,
         if (LIKELY(!isMarkerSymbolLUT[symbol]))
         {
             /* Literal copy */
-            CHECK_BOUNDS(dst < outEnd);
+            CHECK_BOUNDS(dst < OUT_LIMIT);
             *dst++ = symbol;
         }
         else
@@ -173,79 +287,722 @@ unsigned int LZG_Decode(const unsigned char *in, lzg_uint32_t insize,
             if (LIKELY(b))
             {
                 /* Decode offset / length parameters */
-                if (LIKELY(symbol == marker1))
-                {
-                    /* Distant copy */
-                    CHECK_BOUNDS((src + 2) <= inEnd);
-                    length = _LZG_LENGTH_DECODE_LUT[b & 0x1f];
-                    b2 = *src++;
-                    offset = (((unsigned int)(b & 0xe0)) << 11) |
-                              (((unsigned int)b2) << 8) |
-                              (*src++);
-                    offset += 2056;
-                }
-                else if (LIKELY(symbol == marker2))
-                {
-                    /* Medium copy */
-                    CHECK_BOUNDS(src < inEnd);
-                    length = _LZG_LENGTH_DECODE_LUT[b & 0x1f];
-                    b2 = *src++;
-                    offset = (((unsigned int)(b & 0xe0)) << 3) | b2;
-                    offset += 8;
-                }
-                else if (LIKELY(symbol == marker3))
-                {
-                    /* Short copy */
-                    length = (b >> 6) + 3;
-                    offset = (b & 0x3f) + 8;
-                }
-                else
-                {
-                    /* Near copy (including RLE) */
-                    length = _LZG_LENGTH_DECODE_LUT[b & 0x1f];
-                    offset = (b >> 5) + 1;
-                }
+                if (UNLIKELY(_LZG_DecodeCopy(&src, inEnd, markers, symbol, b,
+                                             checked, &length, &offset) < 0))
+                    return (unsigned char*) 0;
 
                 /* Copy corresponding data from history window */
+                if (prefix && (length > (lzg_uint32_t)(outEnd - dst)))
+                    length = (lzg_uint32_t)(outEnd - dst);
                 copy = dst - offset;
-                CHECK_BOUNDS((copy >= out) && ((dst + length) <= outEnd));
+                CHECK_BOUNDS((copy >= out) && ((dst + length) <= OUT_LIMIT));
 
                 /* Note: We use loop unrolling to improve the speed */
-                switch (length)
-                {
-                    default:
-                        for (i = 29; i < length; ++i)
-                            *dst++ = *copy++;
-                    case 29: *dst++ = *copy++; case 28: *dst++ = *copy++;
-                    case 27: *dst++ = *copy++; case 26: *dst++ = *copy++;
-                    case 25: *dst++ = *copy++; case 24: *dst++ = *copy++;
-                    case 23: *dst++ = *copy++; case 22: *dst++ = *copy++;
-                    case 21: *dst++ = *copy++; case 20: *dst++ = *copy++;
-                    case 19: *dst++ = *copy++; case 18: *dst++ = *copy++;
-                    case 17: *dst++ = *copy++; case 16: *dst++ = *copy++;
-                    case 15: *dst++ = *copy++; case 14: *dst++ = *copy++;
-                    case 13: *dst++ = *copy++; case 12: *dst++ = *copy++;
-                    case 11: *dst++ = *copy++; case 10: *dst++ = *copy++;
-                    case 9:  *dst++ = *copy++; case 8:  *dst++ = *copy++;
-                    case 7:  *dst++ = *copy++; case 6:  *dst++ = *copy++;
-                    case 5:  *dst++ = *copy++; case 4:  *dst++ = *copy++;
-                    case 3:  *dst++ = *copy++; case 2:  *dst++ = *copy++;
-                    case 1:  *dst++ = *copy++;
-                }
+                _LZG_COPY_UNROLLED(dst, copy, length);
             }
             else
             {
                 /* Single occurance of a marker symbol... */
-                CHECK_BOUNDS(dst < outEnd);
+                CHECK_BOUNDS(dst < OUT_LIMIT);
                 *dst++ = symbol;
             }
         }
     }
 
+#undef OUT_LIMIT
+
+    return dst;
+}
+
+/* Decode a complete LZG buffer (any method). When checked is FALSE, the
+   checksums are not verified, and the LZG1 decoder does no bounds checks. */
+static LZG_INLINE lzg_uint32_t _LZG_DecodeBuffer(const unsigned char *in,
+    lzg_uint32_t insize, unsigned char *out, lzg_uint32_t outsize,
+    lzg_bool_t inPlace, lzg_bool_t checked)
+{
+    unsigned char *src, *dst;
+    lzg_uint32_t i, hdrSize;
+    lzg_header hdr;
+
+    /* Get & check the header */
+    hdrSize = _LZG_GetHeader(in, insize, &hdr);
+    if (!hdrSize)
+        return 0;
+
+    /* Check output buffer size */
+    if (outsize < hdr.decodedSize)
+        return 0;
+
+    /* Check checksum */
+#ifndef LZG_UNSAFE
+    if (checked &&
+        (_LZG_CalcChecksum(&in[hdrSize], hdr.encodedSize) != hdr.checksum))
+        return 0;
+#endif
+
+    /* Skip header information */
+    src = (unsigned char *)in + hdrSize;
+
+    /* Plain copy? */
+    if (hdr.method == LZG_METHOD_COPY)
+    {
+        /* Copy 1:1, input buffer to output buffer (front to back, which is
+           safe for in-place decoding too) */
+        dst = out;
+        for (i = hdr.decodedSize; i != 0; i--)
+            *dst++ = *src++;
+    }
+    else
+    {
+        dst = _LZG_DecodeLZG1(src, in + insize, out, out + outsize, inPlace,
+                              checked, FALSE);
+        if (!dst)
+            return 0;
+    }
+
     /* Did we get the right number of output bytes? */
-    if ((unsigned int)(dst - out) != decodedSize)
+    if ((lzg_uint32_t)(dst - out) != hdr.decodedSize)
+        return 0;
+
+    /* Check the checksum of the decoded data */
+#ifndef LZG_UNSAFE
+    if (checked && (hdr.flags & LZG_FLAG_CONTENT_CHECKSUM) &&
+        (_LZG_CalcChecksum(out, hdr.decodedSize) != hdr.contentChecksum))
         return 0;
+#endif
 
     /* Return size of decompressed buffer */
-    return decodedSize;
+    return hdr.decodedSize;
+}
+
+
+/* Next encodable copy length for each copy length that is the result of a
+   length quantization (zero for the other lengths) */
+static lzg_uint32_t _LZG_NextLength(lzg_uint32_t length)
+{
+    switch (length)
+    {
+        case 29: return 35;
+        case 35: return 48;
+        case 48: return 72;
+        case 72: return 128;
+        default: return 0;
+    }
+}
+
+/* Count the number of bytes that match at pos and pos - offset in the
+   decoded data (going forwards, or backwards from pos - 1 when dir < 0) */
+static lzg_uint32_t _LZG_MatchExtent(const unsigned char *decoded,
+    lzg_uint32_t decodedSize, lzg_uint32_t pos, lzg_uint32_t offset,
+    int dir, lzg_uint32_t maxCount)
+{
+    lzg_uint32_t count = 0;
+    if (dir > 0)
+    {
+        while ((count < maxCount) && (pos + count < decodedSize) &&
+               (decoded[pos + count] == decoded[pos + count - offset]))
+            ++count;
+    }
+    else
+    {
+        while ((count < maxCount) && (pos - count > offset) &&
+               (decoded[pos - count - 1] == decoded[pos - count - 1 - offset]))
+            ++count;
+    }
+    return count;
+}
+
+/* Size of the queue of pending quantization checks in _LZG_WalkLZG1 (a check
+   looks at most 55 bytes ahead of the copy, and there is at most one check
+   per decoded byte) */
+#define QUANT_QUEUE_SIZE 64
+
+/* Walk through an LZG1 data stream (the data following the header), and
+   check that it is well formed, i.e. that LZG_Decode() would succeed (except
+   for the checksums). Returns non-zero on success.
+   - maxAhead (if non-NULL) receives the maximum number of bytes that the
+     decoded data gets ahead of the unread input (for in-place decoding).
+   - stats (if non-NULL) is updated with token statistics.
+   - out (if non-NULL) receives the decoded data (decodedSize bytes), and the
+     statistics get the quantization and parsing analysis too. The analysis
+     looks ahead of each copy, so those checks are queued until the data
+     that they need has been decoded.
+   The routine is called with constant NULL arguments for the unused
+   features, so that they are compiled away. */
+static LZG_INLINE int _LZG_WalkLZG1(const unsigned char *in,
+    const unsigned char *inEnd, lzg_uint32_t decodedSize,
+    lzg_uint32_t *maxAhead, lzg_decoder_stats_t *stats, unsigned char *out)
+{
+    const unsigned char *src;
+    unsigned char symbol, b, markers[4];
+    lzg_uint32_t i, pos, length, offset = 0, ahead, next;
+    lzg_uint32_t run = 0, prevCopy = 0, prevCost = 0;
+    lzg_uint32_t qPos[QUANT_QUEUE_SIZE], qOffset[QUANT_QUEUE_SIZE];
+    lzg_uint32_t qCount[QUANT_QUEUE_SIZE];
+    int type, qHead = 0, qSize = 0;
+    char isMarkerSymbolLUT[256];
+
+    /* Get marker symbols from the input stream */
+    src = in;
+    if ((src + 4) > inEnd)
+        return FALSE;
+    _LZG_GetMarkers(src, markers, isMarkerSymbolLUT);
+    src += 4;
+
+    /* Walk through the token stream */
+    pos = 0;
+    while (src < inEnd)
+    {
+        symbol = *src++;
+        length = 1;
+        type = -1;
+        if (LIKELY(!isMarkerSymbolLUT[symbol]))
+        {
+            if (stats)
+                stats->literals++;
+        }
+        else
+        {
+            if (src >= inEnd)
+                return FALSE;
+            b = *src++;
+            if (b)
+            {
+                type = _LZG_DecodeCopy(&src, inEnd, markers, symbol, b, TRUE,
+                                       &length, &offset);
+                if ((type < 0) || (offset > pos))
+                    return FALSE;
+            }
+            else if (stats)
+                stats->escapedLiterals++;
+        }
+        if (length > decodedSize - pos)
+            return FALSE;
+
+        /* Decode the token */
+        if (out)
+        {
+            if (type >= 0)
+            {
+                for (i = 0; i < length; ++i)
+                    out[pos + i] = out[pos + i - offset];
+            }
+            else
+                out[pos] = symbol;
+        }
+
+        if (stats && (type >= 0))
+        {
+            stats->copies[type]++;
+            stats->copyBytes[type] += length;
+            stats->lengths[length]++;
+            for (i = 0; (i < LZG_STATS_OFFSET_BINS - 1) && (offset >> (i + 1));
+                 ++i);
+            stats->offsets[i]++;
+            if (offset > stats->maxOffset)
+                stats->maxOffset = offset;
+
+            if (out)
+            {
+                /* Did the length quantization cut a longer match short?
+                   (queue the check until the data after the copy has been
+                   decoded) */
+                next = _LZG_NextLength(length);
+                if (next && (type != COPY_SHORT))
+                {
+                    i = (lzg_uint32_t) ((qHead + qSize) % QUANT_QUEUE_SIZE);
+                    qPos[i] = pos + length;
+                    qOffset[i] = offset;
+                    qCount[i] = next - length - 1;
+                    ++qSize;
+                }
+
+                /* Could the match be extended backwards, over the preceding
+                   literals (or over the entire preceding copy)? */
+                if (run)
+                    stats->parseGainBytes += _LZG_MatchExtent(out,
+                        decodedSize, pos, offset, -1,
+                        run < 128 - length ? run : 128 - length);
+                else if (prevCopy && (prevCopy + length <= 128) &&
+                         (_LZG_MatchExtent(out, decodedSize, pos, offset,
+                                           -1, prevCopy) == prevCopy))
+                    stats->parseGainBytes += prevCost;
+            }
+            run = 0;
+            prevCopy = length;
+            prevCost = type == COPY_DISTANT ? 4 : (type == COPY_MEDIUM ? 3 : 2);
+        }
+        else if (stats)
+        {
+            ++run;
+            prevCopy = 0;
+        }
+        pos += length;
+
+        /* Do the quantization checks that have all their data now (or at
+           the end of the data) */
+        while (stats && out && qSize &&
+               ((pos >= qPos[qHead] + qCount[qHead]) || (src >= inEnd)))
+        {
+            i = _LZG_MatchExtent(out, pos, qPos[qHead], qOffset[qHead], 1,
+                                 qCount[qHead]);
+            if (i)
+            {
+                stats->quantizedCopies++;
+                stats->quantizedBytes += i;
+            }
+            qHead = (qHead + 1) % QUANT_QUEUE_SIZE;
+            --qSize;
+        }
+
+        /* How far ahead of the input is the output? */
+        if (maxAhead)
+        {
+            ahead = pos + (lzg_uint32_t)(inEnd - src);
+            if (ahead > *maxAhead)
+                *maxAhead = ahead;
+        }
+    }
+
+    if (stats && decodedSize)
+        stats->literalRatio = (double)(stats->literals +
+                              stats->escapedLiterals) / (double) decodedSize;
+
+    return pos == decodedSize;
+}
+
+
+/* Decode an LZG1 data stream (the data following the header) to a list of
+   output segments, that are filled in order with up to maxSize bytes. If all
+   the segments (except for the last one) have the same, non-zero size, it is
+   given in pageSize (otherwise pageSize is zero). Returns the number of
+   decoded bytes, or zero if the data is corrupt.
+   Copies that lie within the current output segment (the common case) are
+   done directly. Other copies find their source by walking back from the
+   current segment, and are split into pieces at the segment boundaries. */
+static lzg_uint32_t _LZG_DecodeLZG1V(const unsigned char *in,
+    const unsigned char *inEnd, const lzg_iovec_t *iov, int iovcnt,
+    lzg_uint32_t maxSize, lzg_uint32_t pageSize)
+{
+    const unsigned char *src;
+    unsigned char *dst, *dstStart, *dstEnd, *copy, *copyEnd, symbol, b;
+    unsigned char markers[4];
+    lzg_uint32_t i, pos, segPos, length, offset, left;
+    size_t avail;
+    int seg, srcSeg;
+    char isMarkerSymbolLUT[256];
+
+    /* Move the output to the next non-empty segment (the segments are cut
+       off at maxSize bytes) */
+#define NEXT_OUT_SEGMENT \
+    do { \
+        if ((++seg >= iovcnt) || !left) \
+            return 0; \
+        segPos += (lzg_uint32_t)(dst - dstStart); \
+        dstStart = dst = (unsigned char *) iov[seg].base; \
+        avail = iov[seg].size < left ? iov[seg].size : left; \
+        dstEnd = dst + avail; \
+        left -= (lzg_uint32_t) avail; \
+    } while (dst == dstEnd)
+
+    /* Get marker symbols from the input stream */
+    src = in;
+    if ((src + 4) > inEnd)
+        return 0;
+    _LZG_GetMarkers(src, markers, isMarkerSymbolLUT);
+    src += 4;
+
+    /* Start with an empty "segment" in front of the first one */
+    seg = -1;
+    dstStart = dst = dstEnd = (unsigned char *) 0;
+    left = maxSize;
+    segPos = 0;
+
+    /* Main decompression loop */
+    while (src < inEnd)
+    {
+        symbol = *src++;
+        if (LIKELY(!isMarkerSymbolLUT[symbol]))
+        {
+            /* Literal copy */
+            if (UNLIKELY(dst == dstEnd))
+                NEXT_OUT_SEGMENT;
+            *dst++ = symbol;
+            continue;
+        }
+
+        if (src >= inEnd)
+            return 0;
+        b = *src++;
+        if (!b)
+        {
+            /* Single occurance of a marker symbol... */
+            if (UNLIKELY(dst == dstEnd))
+                NEXT_OUT_SEGMENT;
+            *dst++ = symbol;
+            continue;
+        }
+
+        /* Decode offset / length parameters */
+        if (UNLIKELY(_LZG_DecodeCopy(&src, inEnd, markers, symbol, b, TRUE,
+                                     &length, &offset) < 0))
+            return 0;
+
+        /* Source and destination within the current segment? (compare sizes
+           rather than pointers, since dst is NULL before the first segment) */
+        if (LIKELY((offset <= (lzg_uint32_t)(dst - dstStart)) &&
+                   (length <= (lzg_uint32_t)(dstEnd - dst))))
+        {
+            copy = dst - offset;
+            _LZG_COPY_UNROLLED(dst, copy, length);
+            continue;
+        }
+
+        /* Position in the decoded data */
+        pos = segPos + (lzg_uint32_t)(dst - dstStart);
+        if (offset > pos)
+            return 0;
+
+        /* Find the source segment (the current one, or an earlier one). For
+           equally sized segments (e.g. pages), it is found directly. */
+        if (pageSize)
+        {
+            /* (the current segment may be larger than the others) */
+            srcSeg = (int) ((pos - offset) / pageSize);
+            if (srcSeg > seg)
+                srcSeg = seg;
+            copy = (unsigned char *) iov[srcSeg].base +
+                   ((pos - offset) - (lzg_uint32_t) srcSeg * pageSize);
+        }
+        else
+        {
+            srcSeg = seg;
+            avail = (size_t)(dst - dstStart);
+            while (offset > avail)
+            {
+                offset -= (lzg_uint32_t) avail;
+                avail = iov[--srcSeg].size;
+            }
+            copy = (unsigned char *) iov[srcSeg].base + (avail - offset);
+        }
+        copyEnd = (unsigned char *) iov[srcSeg].base + iov[srcSeg].size;
+
+        /* Copy piece by piece, moving to the next segment whenever one is
+           exhausted (only a piece from the current segment can overlap the
+           destination) */
+        while (length)
+        {
+            if (dst == dstEnd)
+                NEXT_OUT_SEGMENT;
+            while (copy == copyEnd)
+            {
+                ++srcSeg;
+                copy = (unsigned char *) iov[srcSeg].base;
+                copyEnd = copy + iov[srcSeg].size;
+            }
+            i = length;
+            if (i > (lzg_uint32_t)(dstEnd - dst))
+                i = (lzg_uint32_t)(dstEnd - dst);
+            if (i > (lzg_uint32_t)(copyEnd - copy))
+                i = (lzg_uint32_t)(copyEnd - copy);
+            length -= i;
+            if (srcSeg != seg)
+            {
+                memcpy(dst, copy, i);
+                dst += i;
+                copy += i;
+            }
+            else
+            {
+                for (; i != 0; --i)
+                    *dst++ = *copy++;
+            }
+        }
+    }
+
+#undef NEXT_OUT_SEGMENT
+
+    return segPos + (lzg_uint32_t)(dst - dstStart);
+}
+
+
+/*-- PUBLIC ------------------------------------------------------------------*/
+
+lzg_uint32_t LZG_DecodedSize(const unsigned char *in, lzg_uint32_t insize)
+{
+    if (insize < 7)
+        return 0;
+
+    /* Check magic number */
+    if ((in[0] != 'L') || (in[1] != 'Z') || (in[2] != 'G'))
+        return 0;
+
+    /* Get output buffer size */
+    return _LZG_GetUINT32(in, 3);
+}
+
+lzg_uint32_t LZG_EncodedSize(const unsigned char *in, lzg_uint32_t insize)
+{
+    lzg_uint32_t hdrSize, encodedSize;
+
+    if (insize < LZG_HEADER_SIZE)
+        return 0;
+
+    /* Check magic number */
+    if ((in[0] != 'L') || (in[1] != 'Z') || (in[2] != 'G'))
+        return 0;
+
+    /* Get header size and encoded data size */
+    hdrSize = (in[15] & LZG_FLAG_CONTENT_CHECKSUM) ? LZG_EXT_HEADER_SIZE :
+              LZG_HEADER_SIZE;
+    encodedSize = _LZG_GetUINT32(in, 7);
+    if (encodedSize > (0xffffffff - hdrSize))
+        return 0;
+
+    return hdrSize + encodedSize;
+}
+
+unsigned int LZG_Decode(const unsigned char *in, lzg_uint32_t insize,
+    unsigned char *out, lzg_uint32_t outsize)
+{
+    return _LZG_DecodeBuffer(in, insize, out, outsize, FALSE, TRUE);
+}
+
+lzg_uint32_t LZG_DecodeTrusted(const unsigned char *in, lzg_uint32_t insize,
+    unsigned char *out, lzg_uint32_t outsize)
+{
+    return _LZG_DecodeBuffer(in, insize, out, outsize, FALSE, FALSE);
+}
+
+lzg_uint32_t LZG_DecodePrefix(const unsigned char *in, lzg_uint32_t insize,
+    unsigned char *out, lzg_uint32_t outsize, lzg_bool_t verify)
+{
+    unsigned char *dst;
+    lzg_uint32_t hdrSize, size;
+    lzg_header hdr;
+
+    /* Get & check the header */
+    hdrSize = _LZG_GetHeader(in, insize, &hdr);
+    if (!hdrSize)
+        return 0;
+
+    /* Number of bytes to decode */
+    size = outsize < hdr.decodedSize ? outsize : hdr.decodedSize;
+
+    /* Check checksum (this reads all the coded data) */
+#ifndef LZG_UNSAFE
+    if (verify &&
+        (_LZG_CalcChecksum(&in[hdrSize], hdr.encodedSize) != hdr.checksum))
+        return 0;
+#endif
+
+    /* Decode the prefix */
+    if (hdr.method == LZG_METHOD_COPY)
+    {
+        memcpy(out, &in[hdrSize], size);
+        dst = out + size;
+    }
+    else
+    {
+        dst = _LZG_DecodeLZG1(&in[hdrSize], in + insize, out, out + size,
+                              FALSE, TRUE, TRUE);
+        if (!dst)
+            return 0;
+    }
+    if ((lzg_uint32_t)(dst - out) != size)
+        return 0;
+
+    /* Check the checksum of the decoded data (only if it was all decoded) */
+#ifndef LZG_UNSAFE
+    if (verify && (size == hdr.decodedSize) &&
+        (hdr.flags & LZG_FLAG_CONTENT_CHECKSUM) &&
+        (_LZG_CalcChecksum(out, size) != hdr.contentChecksum))
+        return 0;
+#endif
+
+    return size;
+}
+
+lzg_uint32_t LZG_DecodeV(const unsigned char *in, lzg_uint32_t insize,
+    const lzg_iovec_t *iov, int iovcnt)
+{
+    const unsigned char *src;
+    lzg_uint32_t hdrSize, left, size;
+    lzg_uint32_t pageSize;
+    size_t total;
+    lzg_header hdr;
+    int i;
+
+    /* Get & check the header */
+    hdrSize = _LZG_GetHeader(in, insize, &hdr);
+    if (!hdrSize || !iov || (iovcnt < 0))
+        return 0;
+
+    /* Check output buffer size, and check if the segments that are used
+       (except for the last one) have the same size */
+    total = 0;
+    pageSize = 0;
+    if ((iovcnt > 0) && ((size_t)(lzg_uint32_t) iov[0].size == iov[0].size))
+        pageSize = (lzg_uint32_t) iov[0].size;  /* (fits in 32 bits) */
+    for (i = 0; (i < iovcnt) && (total < hdr.decodedSize); ++i)
+    {
+        if ((iov[i].size != pageSize) && (total + iov[i].size < hdr.decodedSize))
+            pageSize = 0;
+        total += iov[i].size;
+    }
+    if (total < hdr.decodedSize)
+        return 0;
+
+    /* Check checksum */
+#ifndef LZG_UNSAFE
+    if (_LZG_CalcChecksum(&in[hdrSize], hdr.encodedSize) != hdr.checksum)
+        return 0;
+#endif
+
+    /* Decode */
+    src = in + hdrSize;
+    if (hdr.method == LZG_METHOD_COPY)
+    {
+        /* Plain copy, scattered over the segments */
+        for (i = 0, left = hdr.decodedSize; left; ++i)
+        {
+            size = iov[i].size < left ? (lzg_uint32_t) iov[i].size : left;
+            memcpy(iov[i].base, src, size);
+            src += size;
+            left -= size;
+        }
+    }
+    else if (_LZG_DecodeLZG1V(src, in + insize, iov, iovcnt,
+                              hdr.decodedSize, pageSize) != hdr.decodedSize)
+        return 0;
+
+    /* Check the checksum of the decoded data */
+#ifndef LZG_UNSAFE
+    if (hdr.flags & LZG_FLAG_CONTENT_CHECKSUM)
+    {
+        lzg_uint32_t checksum = LZG_CHECKSUM_INIT;
+        for (i = 0, left = hdr.decodedSize; left; ++i)
+        {
+            size = iov[i].size < left ? (lzg_uint32_t) iov[i].size : left;
+            checksum = _LZG_UpdateChecksum(checksum,
+                (const unsigned char *) iov[i].base, size);
+            left -= size;
+        }
+        if (checksum != hdr.contentChecksum)
+            return 0;
+    }
+#endif
+
+    return hdr.decodedSize;
+}
+
+lzg_bool_t LZG_InPlaceMargin(const unsigned char *in, lzg_uint32_t insize,
+    lzg_uint32_t *margin)
+{
+    lzg_uint32_t hdrSize, maxAhead;
+    lzg_header hdr;
+
+    /* Get & check the header */
+    hdrSize = _LZG_GetHeader(in, insize, &hdr);
+    if (!hdrSize)
+        return FALSE;
+
+    /* Plain copy: the output is always behind the input */
+    if (hdr.method == LZG_METHOD_COPY)
+    {
+        *margin = hdrSize;
+        return TRUE;
+    }
+
+    /* Walk through the token stream, and keep track of how far the output
+       gets ahead of the input (i.e. decoded size - consumed size + insize,
+       which is never negative) */
+    maxAhead = 0;
+    if (!_LZG_WalkLZG1(in + hdrSize, in + insize, hdr.decodedSize, &maxAhead,
+                       NULL, NULL))
+        return FALSE;
+    if (maxAhead < insize)
+        maxAhead = insize;
+
+    *margin = maxAhead - hdr.decodedSize;
+    return TRUE;
+}
+
+lzg_uint32_t LZG_DecodeInPlace(unsigned char *buf, lzg_uint32_t bufsize,
+    lzg_uint32_t insize)
+{
+    if (insize > bufsize)
+        return 0;
+
+    /* Note: The margin is checked during decoding (the output may not
+       overtake the unread input) */
+    return _LZG_DecodeBuffer(buf + (bufsize - insize), insize, buf, bufsize,
+                             TRUE, TRUE);
+}
+
+lzg_uint32_t LZG_Analyze(const unsigned char *in, lzg_uint32_t insize,
+    unsigned char *out, lzg_uint32_t outsize, lzg_decoder_stats_t *stats)
+{
+    lzg_uint32_t hdrSize;
+    lzg_header hdr;
+
+    memset(stats, 0, sizeof(lzg_decoder_stats_t));
+
+    /* Get & check the header */
+    hdrSize = _LZG_GetHeader(in, insize, &hdr);
+    if (!hdrSize || (outsize < hdr.decodedSize))
+        return 0;
+
+    /* Check checksum */
+#ifndef LZG_UNSAFE
+    if (_LZG_CalcChecksum(&in[hdrSize], hdr.encodedSize) != hdr.checksum)
+        return 0;
+#endif
+
+    /* Decode the data and gather statistics in one pass through the token
+       stream */
+    if (hdr.method == LZG_METHOD_COPY)
+        memcpy(out, &in[hdrSize], hdr.decodedSize);
+    else if (!_LZG_WalkLZG1(in + hdrSize, in + insize, hdr.decodedSize, NULL,
+                            stats, out))
+        return 0;
+
+    /* Check the checksum of the decoded data */
+#ifndef LZG_UNSAFE
+    if ((hdr.flags & LZG_FLAG_CONTENT_CHECKSUM) &&
+        (_LZG_CalcChecksum(out, hdr.decodedSize) != hdr.contentChecksum))
+        return 0;
+#endif
+
+    return hdr.decodedSize;
+}
+
+lzg_bool_t LZG_Validate(const unsigned char *in, lzg_uint32_t insize,
+    lzg_decoder_stats_t *stats)
+{
+    lzg_uint32_t hdrSize;
+    lzg_header hdr;
+
+    if (stats)
+        memset(stats, 0, sizeof(lzg_decoder_stats_t));
+
+    /* Get & check the header */
+    hdrSize = _LZG_GetHeader(in, insize, &hdr);
+    if (!hdrSize)
+        return LZG_FALSE;
+
+    /* Check checksum */
+    if (_LZG_CalcChecksum(&in[hdrSize], hdr.encodedSize) != hdr.checksum)
+        return LZG_FALSE;
+
+    /* Plain copy: the sizes have been checked with the header */
+    if (hdr.method == LZG_METHOD_COPY)
+        return LZG_TRUE;
+
+    /* Walk through the token stream (gather statistics only if requested) */
+    if (stats)
+        return _LZG_WalkLZG1(in + hdrSize, in + insize, hdr.decodedSize, NULL,
+                             stats, NULL) ? LZG_TRUE : LZG_FALSE;
+    return _LZG_WalkLZG1(in + hdrSize, in + insize, hdr.decodedSize, NULL,
+                         NULL, NULL) ? LZG_TRUE : LZG_FALSE;
 }
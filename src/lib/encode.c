@@ -29,6 +29,15 @@
 #include <string.h>
 #include "internal.h"
 
+#if defined(_WIN32)
+# include <windows.h>
+#else
+# include <time.h>
+#endif
+#if defined(__linux__)
+# include <sys/mman.h>
+#endif
+
 /*
     Compressed data format
     ----------------------
@@ -47,6 +56,12 @@
         {encoded size}
         {checksum}
         [method]
+        {decoded content checksum}  (only if method & 0x80)
+
+    The lower four bits of [method] hold the method (0 = copy, 1 = LZG1), and
+    bit 7 indicates that the header is extended with a checksum of the decoded
+    data. The checksum in the base header covers the encoded data that follows
+    the (base or extended) header.
 
     LZG1 data stream start:
         [M1] [M2] [M3] [M4]
@@ -115,6 +130,23 @@ static const unsigned char _LZG_LENGTH_QUANT_LUT[129] = {
     128                                              /* 128 */
 };
 
+/* Get the current time in seconds (only used for the encoder statistics) */
+static double _LZG_GetTime(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER t, freq;
+    QueryPerformanceCounter(&t);
+    QueryPerformanceFrequency(&freq);
+    return (double) t.QuadPart / (double) freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+#else
+    return (double) clock() / (double) CLOCKS_PER_SEC;
+#endif
+}
+
 /* Compression tuning parameters (used for specifying different compression
    levels) */
 typedef struct {
@@ -138,8 +170,16 @@ static const tune_params_t _LZG_TUNING_PARAMETERS[9] = {
     {524288, 524288, 128}   /* level = 9 (very slow - best possible) */
 };
 
+static lzg_uint32_t _LZG_HeaderSize(lzg_header *hdr)
+{
+    return (hdr->flags & LZG_FLAG_CONTENT_CHECKSUM) ? LZG_EXT_HEADER_SIZE :
+           LZG_HEADER_SIZE;
+}
+
 static void _LZG_SetHeader(unsigned char *out, lzg_header *hdr)
 {
+    lzg_uint32_t hdrSize = _LZG_HeaderSize(hdr);
+
     /* Magic number */
     out[0] = 'L';
     out[1] = 'Z';
@@ -158,14 +198,23 @@ static void _LZG_SetHeader(unsigned char *out, lzg_header *hdr)
     out[10] = hdr->encodedSize;
 
     /* Checksum */
-    hdr->checksum = _LZG_CalcChecksum(&out[LZG_HEADER_SIZE], hdr->encodedSize);
+    hdr->checksum = _LZG_CalcChecksum(&out[hdrSize], hdr->encodedSize);
     out[11] = hdr->checksum >> 24;
     out[12] = hdr->checksum >> 16;
     out[13] = hdr->checksum >> 8;
     out[14] = hdr->checksum;
 
     /* Method */
-    out[15] = hdr->method;
+    out[15] = hdr->method | hdr->flags;
+
+    /* Decoded content checksum */
+    if (hdr->flags & LZG_FLAG_CONTENT_CHECKSUM)
+    {
+        out[16] = hdr->contentChecksum >> 24;
+        out[17] = hdr->contentChecksum >> 16;
+        out[18] = hdr->contentChecksum >> 8;
+        out[19] = hdr->contentChecksum;
+    }
 }
 
 typedef struct _hist_rec {
@@ -183,18 +232,19 @@ static int hist_rec_compare(const void *p1, const void *p2)
     return h1->symbol - h2->symbol;
 }
 
-static int _LZG_DetermineMarkers(const unsigned char *in, lzg_uint32_t insize,
+/* Block size for the combined histogram/checksum pass (small enough for each
+   block to still be in the L1 cache when it is checksummed) */
+#define _LZG_HIST_BLOCK_SIZE 8192
+
+static void _LZG_DetermineMarkers(const lzg_iovec_t *iov, int iovcnt,
     unsigned char *leastCommon1, unsigned char *leastCommon2,
-    unsigned char *leastCommon3, unsigned char *leastCommon4)
+    unsigned char *leastCommon3, unsigned char *leastCommon4,
+    lzg_uint32_t *checksum)
 {
-    hist_rec *hist;
-    unsigned int i;
-    unsigned char *src;
-
-    /* Allocate memory for histogram */
-    hist = (hist_rec*) malloc(sizeof(hist_rec) * 256);
-    if (!hist)
-        return FALSE;
+    hist_rec hist[256];
+    unsigned int i, blockSize;
+    unsigned char *src, *blockEnd, *end;
+    int seg;
 
     /* Build histogram, O(n) */
     for (i = 0; i < 256; ++i)
@@ -203,9 +253,34 @@ static int _LZG_DetermineMarkers(const unsigned char *in, lzg_uint32_t insize,
         hist[i].symbol = i;
         hist[i].taken = LZG_FALSE;
     }
-    src = (unsigned char *) in;
-    for (i = 0; i < insize; ++i)
-        hist[*src++].count++;
+    if (checksum)
+        *checksum = LZG_CHECKSUM_INIT;
+    for (seg = 0; seg < iovcnt; ++seg)
+    {
+        if (!iov[seg].size)
+            continue;
+        src = (unsigned char *) iov[seg].base;
+        end = src + iov[seg].size;
+        if (checksum)
+        {
+            /* Calculate the content checksum on the fly, block by block */
+            while (src < end)
+            {
+                blockSize = (lzg_uint32_t)(end - src);
+                if (blockSize > _LZG_HIST_BLOCK_SIZE)
+                    blockSize = _LZG_HIST_BLOCK_SIZE;
+                *checksum = _LZG_UpdateChecksum(*checksum, src, blockSize);
+                blockEnd = src + blockSize;
+                while (src < blockEnd)
+                    hist[*src++].count++;
+            }
+        }
+        else
+        {
+            while (src < end)
+                hist[*src++].count++;
+        }
+    }
 
     /* Sort histogram */
     qsort((void *)hist, 256, sizeof(hist_rec), hist_rec_compare);
@@ -215,101 +290,313 @@ static int _LZG_DetermineMarkers(const unsigned char *in, lzg_uint32_t insize,
     *leastCommon2 = (unsigned char) hist[1].symbol;
     *leastCommon3 = (unsigned char) hist[2].symbol;
     *leastCommon4 = (unsigned char) hist[3].symbol;
+}
 
-    /* Free memory for histogram */
-    free(hist);
+/* Hash chain entry, for one window position: the position of the previous
+   occurance of the same pre-matched bytes (zero = none, which is fine since
+   the first position is never a match candidate), followed by the check word
+   of the position (see _LZG_CheckWord) if check words are used. The check
+   word shares the cache line with the link, so it costs no extra cache misses
+   to read it. Without check words, an entry is only the link. */
+#define _LZG_CHAIN_ENTRY_WORDS(useCheck) ((useCheck) ? 2 : 1)
 
-    return TRUE;
-}
+/* Get the hash chain entry of a position */
+#define _LZG_CHAIN_ENTRY(sa, idx, window, useCheck) \
+    (&(sa)->tab[((idx) & ((window) - 1)) * _LZG_CHAIN_ENTRY_WORDS(useCheck)])
 
 typedef struct {
-    unsigned char **tab;
-    unsigned char **last;
+    lzg_uint32_t *tab;
+    lzg_uint32_t *last;
+    lzg_bool_t useCheck;
     tune_params_t params;
-    lzg_uint32_t windowMask;
     lzg_uint32_t size;
-    lzg_uint32_t preMatch;
     lzg_bool_t  fast;
 } search_accel_t;
 
-static search_accel_t* _LZG_SearchAccel_Create(const tune_params_t* params,
-    lzg_uint32_t size, lzg_bool_t fast)
+/* Number of entries in the "last symbol occurance" table */
+#define _LZG_LAST_SIZE(fast) ((fast) ? 16777216 : 65536)
+
+/* Get the "last" table index for a position */
+#define _LZG_LAST_INDEX(fast, pos) \
+    (LIKELY(fast) ? \
+     ((((lzg_uint32_t)(pos)[0]) << 16) | (((lzg_uint32_t)(pos)[1]) << 8) | \
+      ((lzg_uint32_t)(pos)[2])) : \
+     ((((lzg_uint32_t)(pos)[0]) << 8) | ((lzg_uint32_t)(pos)[1])))
+
+/* Minimum chain length (maxMatches) for using check words. The check word
+   of a position holds the four bytes that follow the pre-matched bytes, so
+   that most candidates can be rejected without touching the input data.
+   With short chains, the window data is mostly cached anyway. */
+#define _LZG_CHECK_MIN_MATCHES 100
+
+/* Are check words used with the given tuning parameters? */
+#define _LZG_USE_CHECK(params) \
+    ((params)->maxMatches >= _LZG_CHECK_MIN_MATCHES)
+
+/* Get the check word for a position (bytes beyond the end of the input are
+   zero, which is fine since they never decide a match) */
+static LZG_INLINE lzg_uint32_t _LZG_CheckWord(const unsigned char *pos,
+    const unsigned char *end)
 {
-    search_accel_t *self;
-
-    /* Allocate memory for the sarch tab object */
-    self = malloc(sizeof(search_accel_t));
-    if (!self)
-        return (search_accel_t*) 0;
-
-    /* Allocate memory for the table */
-    self->tab = calloc(params->window, sizeof(unsigned char *));
-    if (!self->tab)
+    if (LIKELY(pos + 4 <= end))
+        return ((lzg_uint32_t)pos[0]) |
+               (((lzg_uint32_t)pos[1]) << 8) |
+               (((lzg_uint32_t)pos[2]) << 16) |
+               (((lzg_uint32_t)pos[3]) << 24);
+    else
     {
-        free(self);
-        return (search_accel_t*) 0;
+        lzg_uint32_t word = 0;
+        int shift = 0;
+        for (; pos < end; ++pos, shift += 8)
+            word |= ((lzg_uint32_t)*pos) << shift;
+        return word;
     }
+}
 
-    /* Allocate memory for the "last symbol occurance" array */
-    self->last = calloc(fast ? 16777216 : 65536, sizeof(unsigned char *));
-    if (!self->last)
-    {
-        free(self->tab);
-        free(self);
-        return (search_accel_t*) 0;
-    }
+/* Get the mask of the check word bytes that a candidate must match, in
+   order to give a match that is longer than length */
+static LZG_INLINE lzg_uint32_t _LZG_CheckMask(lzg_uint32_t length,
+    lzg_uint32_t preMatch)
+{
+    if (length < preMatch)
+        return 0;
+    if (length >= preMatch + 3)
+        return 0xffffffff;
+    return (((lzg_uint32_t) 1) << (8 * (length - preMatch + 1))) - 1;
+}
+
+/* Get the window size for a given input size (a window that is larger than
+   the input gives the same result, so the window is limited to save memory
+   for small inputs) */
+static lzg_uint32_t _LZG_WindowSize(const tune_params_t *params,
+    lzg_uint32_t size)
+{
+    lzg_uint32_t window = 1;
+    while ((window < params->window) && (window < size))
+        window <<= 1;
+    return window;
+}
 
+/* Get the size of the search accelerator tables (number of bytes) */
+static lzg_uint32_t _LZG_SearchAccel_TableSize(const tune_params_t *params,
+    lzg_uint32_t size, lzg_bool_t fast)
+{
+    return _LZG_WindowSize(params, size) *
+           _LZG_CHAIN_ENTRY_WORDS(_LZG_USE_CHECK(params)) *
+           (lzg_uint32_t) sizeof(lzg_uint32_t) +
+           _LZG_LAST_SIZE(fast) * (lzg_uint32_t) sizeof(lzg_uint32_t);
+}
+
+/* Initialize the search accelerator. The tables (see
+   _LZG_SearchAccel_TableSize) must be zero filled. */
+static void _LZG_SearchAccel_Init(search_accel_t *self,
+    const tune_params_t *params, lzg_uint32_t size, lzg_bool_t fast,
+    void *tables)
+{
     /* Init parameters */
     self->params = *params;
-    self->windowMask = params->window - 1; /* NOTE: window must be a power of 2 */
+    self->params.window = _LZG_WindowSize(params, size); /* NOTE: window must be a power of 2 */
     self->size = size;
-    self->preMatch = fast ? 3 : 2;
     self->fast = fast;
 
-    return self;
+    self->useCheck = _LZG_USE_CHECK(params);
+
+    /* The "last symbol occurance" array follows the table */
+    self->tab = (lzg_uint32_t *) tables;
+    self->last = self->tab + self->params.window *
+                 _LZG_CHAIN_ENTRY_WORDS(self->useCheck);
 }
 
-static void _LZG_SearchAccel_Destroy(search_accel_t *self)
+/* Huge pages are assumed to be 2 MB (the size on x86-64 and most ARM64
+   systems), larger huge pages are not used */
+#define _LZG_HUGE_PAGE_SIZE 2097152
+
+/* Allocate zero filled memory for the search accelerator tables, backed by
+   huge pages if possible (the tables are accessed randomly, so with normal
+   pages nearly every access misses the TLB). Returns NULL if huge pages are
+   not supported, and the caller should fall back to normal memory. */
+static void *_LZG_AllocHugePages(lzg_uint32_t size)
 {
-    if (!self)
+#if defined(__linux__) && defined(MAP_ANONYMOUS)
+    size_t mapSize;
+    unsigned char *p, *aligned;
+
+    /* Explicit huge pages (from the pool that is reserved by the system
+       administrator, usually empty) */
+    mapSize = ((size_t) size + _LZG_HUGE_PAGE_SIZE - 1) &
+              ~((size_t) _LZG_HUGE_PAGE_SIZE - 1);
+# if defined(MAP_HUGETLB)
+    p = (unsigned char *) mmap(NULL, mapSize, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                               -1, 0);
+    if (p != (unsigned char *) MAP_FAILED)
+        return p;
+# endif
+
+    /* Transparent huge pages: the kernel can only use huge pages for
+       aligned 2 MB ranges, so map one extra huge page and trim the ends */
+# if defined(MADV_HUGEPAGE)
+    p = (unsigned char *) mmap(NULL, mapSize + _LZG_HUGE_PAGE_SIZE,
+                               PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == (unsigned char *) MAP_FAILED)
+        return NULL;
+    aligned = (unsigned char *) (((size_t) p + _LZG_HUGE_PAGE_SIZE - 1) &
+                                 ~((size_t) _LZG_HUGE_PAGE_SIZE - 1));
+    if (aligned > p)
+        munmap(p, aligned - p);
+    munmap(aligned + mapSize, (p + _LZG_HUGE_PAGE_SIZE) - aligned);
+    madvise(aligned, mapSize, MADV_HUGEPAGE);
+    return aligned;
+# else
+    (void) aligned;
+    return NULL;
+# endif
+#elif defined(_WIN32) && defined(MEM_LARGE_PAGES)
+    /* Large pages require the "Lock pages in memory" privilege */
+    SIZE_T pageSize = GetLargePageMinimum();
+    if (pageSize == 0)
+        return NULL;
+    return VirtualAlloc(NULL, ((SIZE_T) size + pageSize - 1) & ~(pageSize - 1),
+                        MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                        PAGE_READWRITE);
+#else
+    (void) size;
+    return NULL;
+#endif
+}
+
+/* Free memory from _LZG_AllocHugePages */
+static void _LZG_FreeHugePages(void *ptr, lzg_uint32_t size)
+{
+#if defined(__linux__) && defined(MAP_ANONYMOUS)
+    munmap(ptr, ((size_t) size + _LZG_HUGE_PAGE_SIZE - 1) &
+                ~((size_t) _LZG_HUGE_PAGE_SIZE - 1));
+#elif defined(_WIN32) && defined(MEM_LARGE_PAGES)
+    (void) size;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    (void) ptr;
+    (void) size;
+#endif
+}
+
+/* Clear the table entries that were used for the input data (given as a list
+   of segments), so that the tables are zero filled again (and can be
+   reused) */
+static void _LZG_SearchAccel_Clear(search_accel_t *self,
+    const lzg_iovec_t *iov, int iovcnt)
+{
+    const unsigned char *src, *end;
+    lzg_uint32_t lIdx = 0, mask, lag, j, stop;
+    int seg;
+
+    memset(self->tab, 0, sizeof(lzg_uint32_t) *
+           _LZG_CHAIN_ENTRY_WORDS(self->useCheck) *
+           (self->size < self->params.window ? self->size :
+            self->params.window));
+
+    /* Clear the used entries of the "last" array (or all of it, if that is
+       faster) */
+    if (self->size >= _LZG_LAST_SIZE(self->fast))
+    {
+        memset(self->last, 0, sizeof(lzg_uint32_t) *
+               _LZG_LAST_SIZE(self->fast));
         return;
+    }
 
-    free(self->last);
-    free(self->tab);
-    free(self);
+    /* The "last" table index is rolled over the input bytes (see
+       _LZG_LAST_INDEX), and the index of a position is complete when its
+       last pre-matched byte (at j = position + lag) has been read */
+    mask = _LZG_LAST_SIZE(self->fast) - 1;
+    lag = self->fast ? 2 : 1;
+    stop = self->size > 2 ? self->size - 2 + lag : 0;
+    j = 0;
+    for (seg = 0; (seg < iovcnt) && (j < stop); ++seg)
+    {
+        if (!iov[seg].size)
+            continue;
+        src = (const unsigned char *) iov[seg].base;
+        end = src + iov[seg].size;
+        for (; (src < end) && (j < stop); ++src, ++j)
+        {
+            lIdx = ((lIdx << 8) | *src) & mask;
+            if (j >= lag)
+                self->last[lIdx] = 0;
+        }
+    }
 }
 
-static void _LZG_UpdateLastPos(search_accel_t *sa,
-    const unsigned char *first, unsigned char *pos)
+/* Number of positions ahead of the current position, for which the "last"
+   table entry is prefetched (enough to hide most of a cache miss, since
+   the update is called for every position) */
+#define _LZG_PREFETCH_DISTANCE 8
+
+/* Search routine parameters
+   ------------------------
+
+   The search routines get the search parameters (fast, window, maxMatches,
+   goodLength and useCheck) as arguments, instead of reading them from the
+   search accelerator. The encoder calls them with constants (one instance per
+   compression level and mode, see _LZG_EncodeTuned), so that the compiler
+   can fold the parameters into the code. Any window that is at least as
+   large as the window of the search accelerator gives the same result (the
+   window of the search accelerator is only smaller than the window of the
+   compression level if the input is smaller than that, and then no position
+   reaches beyond it), so the window of the compression level is used.
+
+   The input data is given by first, the data of position base (all positions
+   are relative to the start of the input), and end, the end of the data that
+   is available. LZG_Encode() has all the data in place, and calls them with a
+   constant zero base, while LZG_EncodeV() passes a sliding staging buffer
+   that holds the window and the lookahead of the current position (see
+   _LZG_EncodeStaged). */
+
+static LZG_INLINE void _LZG_UpdateLastPos(search_accel_t *sa,
+    const unsigned char *first, lzg_uint32_t base, const unsigned char *end,
+    unsigned char *pos, lzg_bool_t fast, lzg_uint32_t window,
+    lzg_bool_t useCheck)
 {
-    lzg_uint32_t lIdx;
-    if (UNLIKELY(((lzg_uint32_t)(pos - first) + 2) >= sa->size)) return;
-    if (LIKELY(sa->fast))
-        lIdx = (((lzg_uint32_t)pos[0]) << 16) |
-               (((lzg_uint32_t)pos[1]) << 8) |
-               ((lzg_uint32_t)pos[2]);
-    else
-        lIdx = (((lzg_uint32_t)pos[0]) << 8) |
-               ((lzg_uint32_t)pos[1]);
-    sa->tab[(pos - first) & sa->windowMask] = sa->last[lIdx];
-    sa->last[lIdx] = pos;
+    lzg_uint32_t lIdx, idx = (lzg_uint32_t)(pos - first) + base;
+    lzg_uint32_t *entry;
+    if (UNLIKELY((idx + 2) >= sa->size)) return;
+
+    /* The "last" table is accessed randomly (and in fast mode, it is too
+       large for the cache), so start loading the entry for a later position */
+    if (LIKELY((idx + _LZG_PREFETCH_DISTANCE + 2) < sa->size))
+        LZG_PREFETCH(&sa->last[_LZG_LAST_INDEX(fast,
+                                               pos + _LZG_PREFETCH_DISTANCE)]);
+
+    lIdx = _LZG_LAST_INDEX(fast, pos);
+    entry = _LZG_CHAIN_ENTRY(sa, idx, window, useCheck);
+    entry[0] = sa->last[lIdx];
+    sa->last[lIdx] = idx;
+    if (useCheck)
+        entry[1] = _LZG_CheckWord(pos + (fast ? 3 : 2), end);
 }
 
-static lzg_uint32_t _LZG_FindMatch(search_accel_t *sa, const unsigned char *first,
-  const unsigned char *end, const unsigned char *pos, lzg_uint32_t symbolCost,
-  lzg_uint32_t *offset)
+/* Find the best match for the current position. When stats is non-NULL, the
+   chain steps and early stops are counted (see _LZG_EncodeLZG1). */
+static LZG_INLINE lzg_uint32_t _LZG_FindMatch(search_accel_t *sa,
+  const unsigned char *first, lzg_uint32_t base, const unsigned char *end,
+  const unsigned char *pos, lzg_uint32_t symbolCost, lzg_uint32_t *offset,
+  lzg_encoder_stats_t *stats, lzg_bool_t fast, lzg_uint32_t window,
+  lzg_uint32_t maxMatches, lzg_uint32_t goodLength, lzg_bool_t useCheck)
 {
-    lzg_uint32_t length, bestLength = 2, dist, preMatch, maxMatches;
-    int win, bestWin = 0;
-    unsigned char *pos2, *cmp1, *cmp2, *minPos, *endStr;
+    lzg_uint32_t length, bestLength = 2, dist, preMatch, steps = 0;
+    lzg_uint32_t idx, idx2, next, minIdx, checkWord = 0, checkMask = 0;
+    int win, bestWin = 0, candidate;
+    const lzg_uint32_t *entry;
+    unsigned char *pos2, *cmp1, *cmp2, *endStr;
 
     *offset = 0;
 
     /* Minimum search position */
-    if ((lzg_uint32_t)(pos - first) >= sa->params.window)
-        minPos = (unsigned char*)(pos - sa->params.window);
+    idx = (lzg_uint32_t)(pos - first) + base;
+    if (idx >= window)
+        minIdx = idx - window;
     else
-        minPos = (unsigned char*)first;
+        minIdx = 0;
 
     /* Search string end */
     endStr = (unsigned char*)(pos + _LZG_MAX_RUN_LENGTH);
@@ -317,17 +604,50 @@ static lzg_uint32_t _LZG_FindMatch(search_accel_t *sa, const unsigned char *firs
       endStr = (unsigned char*)end;
 
     /* Previous search position */
-    pos2 = sa->tab[(pos - first) & sa->windowMask];
+    idx2 = _LZG_CHAIN_ENTRY(sa, idx, window, useCheck)[0];
 
     /* Pre-matched by the acceleration structure */
-    preMatch = sa->preMatch;
+    preMatch = fast ? 3 : 2;
+
+    /* Check word of the current position, and the mask of the bytes that a
+       candidate must match to give a longer match than bestLength */
+    if (useCheck)
+    {
+        checkWord = _LZG_CheckWord(pos + preMatch, end);
+        checkMask = _LZG_CheckMask(bestLength, preMatch);
+    }
 
     /* Main search loop */
-    maxMatches = sa->params.maxMatches;
-    while (pos2 && (pos2 > minPos) && (maxMatches--))
+    while ((idx2 > minIdx) && (maxMatches--))
     {
-        /* If we don't have a match at bestLength, don't even bother... */
-        if (UNLIKELY(pos[bestLength] == pos2[bestLength]))
+        if (stats)
+            ++steps;
+
+        /* Load the next chain entry before testing the current candidate,
+           and prefetch what the next candidate will be tested with, so that
+           the cache misses of the next step overlap with this step */
+        pos2 = (unsigned char*)first + (idx2 - base);
+        entry = _LZG_CHAIN_ENTRY(sa, idx2, window, useCheck);
+        next = entry[0];
+
+        /* If we don't have a match at bestLength, don't even bother... (with
+           check words, all the bytes up to bestLength are tested without
+           reading the candidate data, unless bestLength is long) */
+        if (useCheck)
+        {
+            LZG_PREFETCH(_LZG_CHAIN_ENTRY(sa, next, window, useCheck));
+            candidate = !((entry[1] ^ checkWord) & checkMask) &&
+                        ((bestLength < preMatch + 4) ||
+                         (pos[bestLength] == pos2[bestLength]));
+        }
+        else
+        {
+            /* (the end of the chain may be older than a staging buffer) */
+            if (!base || (next >= base))
+                LZG_PREFETCH(first + (next - base) + bestLength);
+            candidate = pos[bestLength] == pos2[bestLength];
+        }
+        if (UNLIKELY(candidate))
         {
             /* Calculate maximum match length for this offset */
             cmp1 = (unsigned char*)pos + preMatch;
@@ -362,20 +682,28 @@ static lzg_uint32_t _LZG_FindMatch(search_accel_t *sa, const unsigned char *firs
                     bestWin = win;
                     *offset = dist;
                     bestLength = length;
+                    checkMask = _LZG_CheckMask(bestLength, preMatch);
 
                     /* Did we find a match that was good enough, or did we reach
                        the end of the buffer (no longer match is possible)? */
-                    if (UNLIKELY((length >= sa->params.goodLength) ||
+                    if (UNLIKELY((length >= goodLength) ||
                                  (cmp1 >= endStr)))
+                    {
+                        if (stats && (length >= goodLength))
+                            ++stats->goodLengthStops;
                         break;
+                    }
                 }
             }
         }
 
         /* Previous search position */
-        pos2 = sa->tab[(pos2 - first) & sa->windowMask];
+        idx2 = next;
     }
 
+    if (stats)
+        stats->chainSteps += steps;
+
     /* Did we get a match that would actually compress? */
     if (bestWin > 0)
         return bestLength;
@@ -384,80 +712,57 @@ static lzg_uint32_t _LZG_FindMatch(search_accel_t *sa, const unsigned char *firs
 }
 
 
-/*-- PUBLIC ------------------------------------------------------------------*/
-
-lzg_uint32_t LZG_MaxEncodedSize(lzg_uint32_t insize)
+/* Update the copy token statistics */
+static void _LZG_CountCopy(lzg_encoder_stats_t *stats, int type,
+    lzg_uint32_t length, lzg_uint32_t offset)
 {
-    return LZG_HEADER_SIZE + insize;
+    int bin;
+    stats->copies[type]++;
+    stats->lengths[length]++;
+    for (bin = 0; (bin < LZG_STATS_OFFSET_BINS - 1) && (offset >> (bin + 1));
+         ++bin);
+    stats->offsets[bin]++;
 }
 
-void LZG_InitEncoderConfig(lzg_encoder_config_t *config)
+/* Encode the LZG1 tokens for the positions from *pos up to inEnd (the data
+   following the header and the marker symbols, or a part of it), with the
+   input data given as for the search routines. Returns the end of the encoded
+   data, or zero if the output buffer is too small, and sets *pos to where the
+   encoding stopped (the last copy may reach past inEnd). When stats is
+   non-NULL, the encoder statistics are updated. The routine is
+   always called with a constant NULL when no statistics are requested, so the
+   instrumentation is compiled away in that case. The search parameters are
+   passed on to the search routines (see above). */
+/* With statistics, only every _LZG_STATS_TIME_INTERVAL:th position is timed
+   (reading the clock at every position would slow the encoder down by more
+   than 50%), and the search / emit split is estimated from the samples */
+#define _LZG_STATS_TIME_INTERVAL 256
+
+static LZG_INLINE unsigned char *_LZG_EncodeLZG1(search_accel_t *sa,
+    const unsigned char *first, lzg_uint32_t base, const unsigned char **pos,
+    const unsigned char *inEnd, const unsigned char *end, unsigned char *dst,
+    unsigned char *outEnd, const unsigned char *markers,
+    lzg_encoder_config_t *config, lzg_encoder_stats_t *stats,
+    lzg_bool_t fast, lzg_uint32_t window, lzg_uint32_t maxMatches,
+    lzg_uint32_t goodLength, lzg_bool_t useCheck)
 {
-    /* Set the default values */
-    config->level = LZG_LEVEL_DEFAULT;
-    config->fast = LZG_TRUE;
-    config->progressfun = NULL;
-    config->userdata = NULL;
-}
-
-lzg_uint32_t LZG_Encode(const unsigned char *in, lzg_uint32_t insize,
-    unsigned char *out, lzg_uint32_t outsize, lzg_encoder_config_t *config)
-{
-    unsigned char *src, *inEnd, *dst, *outEnd, symbol;
+    unsigned char *src, symbol;
     unsigned char marker1, marker2, marker3, marker4;
-    const tune_params_t *params;
     lzg_uint32_t lengthEnc, length, offset = 0, symbolCost, i;
-    int level, progress, oldProgress = -1;
-    char isMarkerSymbol, isMarkerSymbolLUT[255];
-
-    search_accel_t *sa = (search_accel_t*) 0;
-    lzg_encoder_config_t defaultConfig;
-    lzg_header hdr;
-
-    /* Check arguments */
-    if ((!in) || (!out) || (outsize < (LZG_HEADER_SIZE + insize)))
-        goto fail;
-
-    /* Use default configuration? */
-    if (!config)
-    {
-        LZG_InitEncoderConfig(&defaultConfig);
-        config = &defaultConfig;
-    }
-
-    /* Clamp the compression level to [1, 9] */
-    if (config->level < 1)
-        level = 1;
-    else if (config->level > 9)
-        level = 9;
-    else
-        level = config->level;
-
-    /* Get the compression tuning parameters (window size etc) */
-    params = &_LZG_TUNING_PARAMETERS[level - 1];
+    lzg_uint32_t samples = 0;
+    int progress, oldProgress = -1;
+    char isMarkerSymbol, isMarkerSymbolLUT[256];
+    lzg_bool_t timed;
+    double t = 0.0, t2;
 
-    /* Calculate histogram and find optimal marker symbols */
-    if (!_LZG_DetermineMarkers(in, insize, &marker1, &marker2, &marker3,
-                               &marker4))
-        goto fail;
+    /* Initialize the byte stream */
+    src = (unsigned char *)*pos;
 
-    /* Initialize search accelerator */
-    sa = _LZG_SearchAccel_Create(params, insize, config->fast);
-    if (!sa)
-        goto fail;
-
-    /* Initialize the byte streams */
-    src = (unsigned char *)in;
-    inEnd = ((unsigned char *)in) + insize;
-    dst = out + LZG_HEADER_SIZE;
-    outEnd = out + outsize;
-
-    /* Set marker symbols */
-    if ((dst + 4) > outEnd) goto overflow;
-    *dst++ = marker1;
-    *dst++ = marker2;
-    *dst++ = marker3;
-    *dst++ = marker4;
+    /* Get marker symbols */
+    marker1 = markers[0];
+    marker2 = markers[1];
+    marker3 = markers[2];
+    marker4 = markers[3];
 
     /* Initialize marker symbol LUT */
     for (i = 0; i < 256; ++i)
@@ -473,7 +778,7 @@ lzg_uint32_t LZG_Encode(const unsigned char *in, lzg_uint32_t insize,
         /* Report progress? */
         if (UNLIKELY(config->progressfun))
         {
-            progress = (100 * (src - in)) / insize;
+            progress = (100 * ((src - first) + base)) / sa->size;
             if (UNLIKELY(progress != oldProgress))
             {
                 config->progressfun(progress, config->userdata);
@@ -490,33 +795,55 @@ lzg_uint32_t LZG_Encode(const unsigned char *in, lzg_uint32_t insize,
         /* What's the cost for this symbol if we do not compress */
         symbolCost = isMarkerSymbol ? 2 : 1;
 
+        /* Time this position? (the sampled times are accumulated in the
+           statistics, and scaled to the loop time by LZG_Encode()) */
+        timed = stats && !((samples++) & (_LZG_STATS_TIME_INTERVAL - 1));
+        if (timed)
+            t = _LZG_GetTime();
+
         /* Update search accelerator */
-        _LZG_UpdateLastPos(sa, in, src);
+        _LZG_UpdateLastPos(sa, first, base, end, src, fast, window,
+                           useCheck);
 
         /* Find best history match for this position in the input buffer */
-        length = _LZG_FindMatch(sa, in, inEnd, src, symbolCost, &offset);
+        length = _LZG_FindMatch(sa, first, base, end, src, symbolCost, &offset,
+                                stats, fast, window, maxMatches, goodLength,
+                                useCheck);
+
+        if (timed)
+        {
+            t2 = _LZG_GetTime();
+            stats->searchTime += t2 - t;
+            t = t2;
+        }
 
         if (UNLIKELY(length > 0))
         {
             if (UNLIKELY((length <= 6) && (offset >= 9) && (offset <= 71)))
             {
                 /* Short copy (emit 2 bytes) */
-                if (UNLIKELY((dst + 2) > outEnd)) goto overflow;
+                if (UNLIKELY((dst + 2) > outEnd)) return (unsigned char*) 0;
                 *dst++ = marker3;
                 *dst++ = ((length - 3) << 6) | (offset - 8);
+                if (stats)
+                    _LZG_CountCopy(stats, 2, length, offset);
             }
             else if (UNLIKELY(offset <= 8))
             {
                 /* Near copy (emit 2 bytes) */
-                if (UNLIKELY((dst + 2) > outEnd)) goto overflow;
+                if (UNLIKELY((dst + 2) > outEnd)) return (unsigned char*) 0;
                 lengthEnc = _LZG_LENGTH_ENCODE_LUT[length];
                 *dst++ = marker4;
                 *dst++ = ((offset - 1) << 5) | (lengthEnc - 2);
+                if (stats)
+                    _LZG_CountCopy(stats, 3, length, offset);
             }
             else if (LIKELY(offset >= 2056))
             {
                 /* Generic copy (emit 4 bytes) */
-                if (UNLIKELY((dst + 4) > outEnd)) goto overflow;
+                if (UNLIKELY((dst + 4) > outEnd)) return (unsigned char*) 0;
+                if (stats)
+                    _LZG_CountCopy(stats, 0, length, offset);
                 lengthEnc = _LZG_LENGTH_ENCODE_LUT[length];
                 offset -= 2056;
                 *dst++ = marker1;
@@ -527,7 +854,9 @@ lzg_uint32_t LZG_Encode(const unsigned char *in, lzg_uint32_t insize,
             else
             {
                 /* Generic copy (emit 3 bytes) */
-                if (UNLIKELY((dst + 3) > outEnd)) goto overflow;
+                if (UNLIKELY((dst + 3) > outEnd)) return (unsigned char*) 0;
+                if (stats)
+                    _LZG_CountCopy(stats, 1, length, offset);
                 lengthEnc = _LZG_LENGTH_ENCODE_LUT[length];
                 offset -= 8;
                 *dst++ = marker2;
@@ -535,26 +864,400 @@ lzg_uint32_t LZG_Encode(const unsigned char *in, lzg_uint32_t insize,
                 *dst++ = offset;
             }
 
+            if (timed)
+            {
+                t2 = _LZG_GetTime();
+                stats->emitTime += t2 - t;
+                t = t2;
+            }
+
             /* Skip ahead (and update search accelerator)... */
             for (i = 1; i < length; ++i)
-                _LZG_UpdateLastPos(sa, in, src + i);
+                _LZG_UpdateLastPos(sa, first, base, end, src + i, fast,
+                                   window, useCheck);
             src += length;
+
+            if (timed)
+                stats->searchTime += _LZG_GetTime() - t;
         }
         else
         {
             /* Plain copy */
-            if (UNLIKELY(dst >= outEnd)) goto overflow;
+            if (UNLIKELY(dst >= outEnd)) return (unsigned char*) 0;
             *dst++ = symbol;
             ++src;
 
             /* Was this symbol equal to any of the markers? */
             if (UNLIKELY(isMarkerSymbol))
             {
-                if (UNLIKELY(dst >= outEnd)) goto overflow;
+                if (UNLIKELY(dst >= outEnd)) return (unsigned char*) 0;
                 *dst++ = 0;
+                if (stats)
+                    stats->escapedLiterals++;
+            }
+            else if (stats)
+                stats->literals++;
+
+            if (timed)
+                stats->emitTime += _LZG_GetTime() - t;
+        }
+    }
+
+    *pos = src;
+    return dst;
+}
+
+/* Instantiate the encoder for a compression level (1-9) and mode, with the
+   tuning parameters as constants */
+#define _LZG_ENCODE_TUNED(level, fast) \
+    _LZG_EncodeLZG1(sa, in, 0, &src, inEnd, inEnd, dst, outEnd, markers, \
+        config, (lzg_encoder_stats_t *) 0, fast, \
+        _LZG_TUNING_PARAMETERS[(level) - 1].window, \
+        _LZG_TUNING_PARAMETERS[(level) - 1].maxMatches, \
+        _LZG_TUNING_PARAMETERS[(level) - 1].goodLength, \
+        _LZG_USE_CHECK(&_LZG_TUNING_PARAMETERS[(level) - 1]))
+
+/* Encode the LZG1 data stream with the encoder instance for the given
+   compression level (1-9) and the mode of the search accelerator (without
+   statistics) */
+static unsigned char *_LZG_EncodeTuned(search_accel_t *sa,
+    const unsigned char *in, lzg_uint32_t insize, unsigned char *dst,
+    unsigned char *outEnd, const unsigned char *markers,
+    lzg_encoder_config_t *config, lzg_int32_t level)
+{
+    const unsigned char *src = in, *inEnd = in + insize;
+
+    if (sa->fast)
+    {
+        switch (level)
+        {
+            case 1: return _LZG_ENCODE_TUNED(1, TRUE);
+            case 2: return _LZG_ENCODE_TUNED(2, TRUE);
+            case 3: return _LZG_ENCODE_TUNED(3, TRUE);
+            case 4: return _LZG_ENCODE_TUNED(4, TRUE);
+            case 5: return _LZG_ENCODE_TUNED(5, TRUE);
+            case 6: return _LZG_ENCODE_TUNED(6, TRUE);
+            case 7: return _LZG_ENCODE_TUNED(7, TRUE);
+            case 8: return _LZG_ENCODE_TUNED(8, TRUE);
+            default: return _LZG_ENCODE_TUNED(9, TRUE);
+        }
+    }
+    else
+    {
+        switch (level)
+        {
+            case 1: return _LZG_ENCODE_TUNED(1, FALSE);
+            case 2: return _LZG_ENCODE_TUNED(2, FALSE);
+            case 3: return _LZG_ENCODE_TUNED(3, FALSE);
+            case 4: return _LZG_ENCODE_TUNED(4, FALSE);
+            case 5: return _LZG_ENCODE_TUNED(5, FALSE);
+            case 6: return _LZG_ENCODE_TUNED(6, FALSE);
+            case 7: return _LZG_ENCODE_TUNED(7, FALSE);
+            case 8: return _LZG_ENCODE_TUNED(8, FALSE);
+            default: return _LZG_ENCODE_TUNED(9, FALSE);
+        }
+    }
+}
+
+
+/* Lookahead of the staging buffer: the number of bytes beyond a position
+   that the encoder may read (the longest copy, plus the check words and the
+   prefetched entries of the search accelerator updates that follow it) */
+#define _LZG_STAGING_LOOKAHEAD (2 * _LZG_MAX_RUN_LENGTH)
+
+/* Minimum number of positions that are encoded per refill of the staging
+   buffer (the window of the low compression levels is small) */
+#define _LZG_STAGING_MIN_BLOCK 65536
+
+/* Get the size of the staging buffer of LZG_EncodeV (number of bytes): the
+   window, one block of positions and its lookahead, or the entire input if
+   that is smaller */
+static lzg_uint32_t _LZG_StagingSize(const tune_params_t *params,
+    lzg_uint32_t size)
+{
+    lzg_uint32_t window, block;
+    window = _LZG_WindowSize(params, size);
+    block = window < _LZG_STAGING_MIN_BLOCK ? _LZG_STAGING_MIN_BLOCK : window;
+    if (size < window + block + _LZG_STAGING_LOOKAHEAD)
+        return size;
+    return window + block + _LZG_STAGING_LOOKAHEAD;
+}
+
+/* Encode the LZG1 tokens for input that is spread over several segments,
+   through a staging buffer (see _LZG_StagingSize). The buffer is refilled
+   from the segments, and the positions that have their full lookahead in the
+   buffer are encoded. Before the next refill, the data that has fallen out
+   of the window is dropped, so the search routines always find the window
+   of a position in the buffer. The generic version of the encoder is used
+   (with a separate instance for gathering statistics). */
+static unsigned char *_LZG_EncodeStaged(search_accel_t *sa,
+    const lzg_iovec_t *iov, int iovcnt, unsigned char *staging,
+    lzg_uint32_t stagingSize, unsigned char *dst, unsigned char *outEnd,
+    const unsigned char *markers, lzg_encoder_config_t *config,
+    lzg_encoder_stats_t *stats)
+{
+    const unsigned char *src, *blockEnd, *end;
+    lzg_uint32_t window, base = 0, have = 0, pos = 0, segPos = 0, shift, n;
+    int seg = 0;
+
+    window = sa->params.window;
+    while (pos < sa->size)
+    {
+        /* Drop the data that has fallen out of the window */
+        if (pos - base > window)
+        {
+            shift = pos - window - base;
+            memmove(staging, staging + shift, have - shift);
+            base += shift;
+            have -= shift;
+        }
+
+        /* Refill the staging buffer */
+        while ((have < stagingSize) && (seg < iovcnt))
+        {
+            n = (lzg_uint32_t) iov[seg].size - segPos;
+            if (n > stagingSize - have)
+                n = stagingSize - have;
+            if (n)
+                memcpy(staging + have,
+                       (const unsigned char *) iov[seg].base + segPos, n);
+            have += n;
+            segPos += n;
+            if (segPos == iov[seg].size)
+            {
+                ++seg;
+                segPos = 0;
             }
         }
+
+        /* Encode up to the lookahead (or to the end of the input) */
+        end = staging + have;
+        blockEnd = (base + have < sa->size) ? end - _LZG_STAGING_LOOKAHEAD :
+                   end;
+        src = staging + (pos - base);
+        if (stats)
+            dst = _LZG_EncodeLZG1(sa, staging, base, &src, blockEnd, end,
+                                  dst, outEnd, markers, config, stats,
+                                  sa->fast, window, sa->params.maxMatches,
+                                  sa->params.goodLength, sa->useCheck);
+        else
+            dst = _LZG_EncodeLZG1(sa, staging, base, &src, blockEnd, end,
+                                  dst, outEnd, markers, config,
+                                  (lzg_encoder_stats_t *) 0,
+                                  sa->fast, window, sa->params.maxMatches,
+                                  sa->params.goodLength, sa->useCheck);
+        if (!dst)
+            return (unsigned char*) 0;
+        pos = base + (lzg_uint32_t)(src - staging);
+    }
+
+    return dst;
+}
+
+
+/*-- PUBLIC ------------------------------------------------------------------*/
+
+lzg_uint32_t LZG_MaxEncodedSize(lzg_uint32_t insize)
+{
+    return LZG_MAX_HEADER_SIZE + insize;
+}
+
+void LZG_InitEncoderConfig(lzg_encoder_config_t *config)
+{
+    /* Set the default values */
+    config->level = LZG_LEVEL_DEFAULT;
+    config->fast = LZG_TRUE;
+    config->progressfun = NULL;
+    config->userdata = NULL;
+    config->contentChecksum = LZG_FALSE;
+    config->stats = NULL;
+    config->allocfun = NULL;
+    config->freefun = NULL;
+    config->allocdata = NULL;
+    config->workspace = NULL;
+    config->workspaceSize = 0;
+    config->hugePages = LZG_FALSE;
+}
+
+/* Clamp the compression level to [1, 9] and get the tuning parameters */
+static const tune_params_t *_LZG_GetParams(lzg_int32_t level)
+{
+    if (level < 1)
+        level = 1;
+    else if (level > 9)
+        level = 9;
+    return &_LZG_TUNING_PARAMETERS[level - 1];
+}
+
+lzg_uint32_t LZG_EncoderWorkspaceSize(lzg_int32_t level, lzg_bool_t fast,
+    lzg_uint32_t insize)
+{
+    return _LZG_SearchAccel_TableSize(_LZG_GetParams(level), insize, fast);
+}
+
+lzg_uint32_t LZG_EncoderWorkspaceSizeV(lzg_int32_t level, lzg_bool_t fast,
+    lzg_uint32_t insize)
+{
+    const tune_params_t *params = _LZG_GetParams(level);
+    return _LZG_SearchAccel_TableSize(params, insize, fast) +
+           _LZG_StagingSize(params, insize);
+}
+
+/* Encode input that is given as a list of segments, with insize bytes in
+   total. If in is non-NULL, the input is one block of memory that starts at
+   in (and iov is the single segment for it), and it is encoded in place.
+   Otherwise the segments are encoded through a staging buffer, which follows
+   the search accelerator tables in the working memory. */
+static lzg_uint32_t _LZG_Encode(const lzg_iovec_t *iov, int iovcnt,
+    const unsigned char *in, lzg_uint32_t insize, unsigned char *out,
+    lzg_uint32_t outsize, lzg_encoder_config_t *config)
+{
+    unsigned char *dst, *outEnd, *staging, markers[4];
+    const unsigned char *src;
+    const tune_params_t *params;
+    lzg_uint32_t hdrSize, tablesSize, stagingSize, memSize;
+    double t = 0.0, tLoop = 0.0, tEnd = 0.0, sampled, share;
+    int i;
+
+    void *tables = (void*) 0;
+    lzg_bool_t hugePages = LZG_FALSE;
+    search_accel_t sa;
+    lzg_encoder_config_t defaultConfig;
+    lzg_encoder_stats_t *stats;
+    lzg_header hdr;
+
+    /* Use default configuration? */
+    if (!config)
+    {
+        LZG_InitEncoderConfig(&defaultConfig);
+        config = &defaultConfig;
+    }
+
+    /* Clear the statistics */
+    stats = config->stats;
+    if (stats)
+    {
+        memset(stats, 0, sizeof(lzg_encoder_stats_t));
+        t = _LZG_GetTime();
+    }
+
+    /* Header format */
+    hdr.flags = config->contentChecksum ? LZG_FLAG_CONTENT_CHECKSUM : 0;
+    hdrSize = _LZG_HeaderSize(&hdr);
+
+    /* Check arguments */
+    if ((!out) || (outsize < (hdrSize + insize)))
+        return 0;
+
+    /* Never produce more than a plain copy would (the header size depends on
+       the flags, so a larger output buffer must not delay the fallback) */
+    outEnd = out + hdrSize + insize;
+
+    /* Get the compression tuning parameters (window size etc) */
+    params = _LZG_GetParams(config->level);
+
+    /* Calculate histogram and find optimal marker symbols */
+    _LZG_DetermineMarkers(iov, iovcnt, &markers[0], &markers[1], &markers[2],
+        &markers[3], config->contentChecksum ? &hdr.contentChecksum : NULL);
+
+    if (stats)
+    {
+        stats->markerTime = _LZG_GetTime() - t;
+        t = _LZG_GetTime();
+    }
+
+    /* Get memory for the search accelerator tables (and the staging buffer):
+       the caller provided workspace (which is always zero filled), or newly
+       allocated memory */
+    tablesSize = _LZG_SearchAccel_TableSize(params, insize, config->fast);
+    stagingSize = in ? 0 : _LZG_StagingSize(params, insize);
+    memSize = tablesSize + stagingSize;
+    if (config->workspace)
+    {
+        if (config->workspaceSize < memSize)
+            return 0;
+        tables = config->workspace;
+    }
+    else if (config->allocfun)
+    {
+        tables = config->allocfun(memSize, config->allocdata);
+        if (!tables)
+            return 0;
+        memset(tables, 0, memSize);
+    }
+    else
+    {
+        /* Huge pages are only worth it for tables that span several pages */
+        hugePages = config->hugePages &&
+                    (memSize >= 2 * _LZG_HUGE_PAGE_SIZE) &&
+                    (tables = _LZG_AllocHugePages(memSize)) != NULL;
+        if (!hugePages)
+            tables = calloc(memSize, 1);
+        if (!tables)
+            return 0;
+    }
+    staging = (unsigned char *) tables + tablesSize;
+
+    /* Initialize search accelerator */
+    _LZG_SearchAccel_Init(&sa, params, insize, config->fast, tables);
+
+    /* Encode the data stream: the marker symbols, followed by the tokens (use
+       a separate, generic version of the encoder for gathering statistics) */
+    tLoop = stats ? _LZG_GetTime() : 0.0;
+    dst = out + hdrSize;
+    if ((dst + 4) > (outEnd))
+        dst = (unsigned char*) 0;
+    else
+    {
+        for (i = 0; i < 4; ++i)
+            *dst++ = markers[i];
+        if (!in)
+            dst = _LZG_EncodeStaged(&sa, iov, iovcnt, staging, stagingSize,
+                                    dst, outEnd, markers, config,
+                                    stats);
+        else if (stats)
+        {
+            src = in;
+            dst = _LZG_EncodeLZG1(&sa, in, 0, &src, in + insize, in + insize,
+                                  dst, outEnd, markers, config, stats,
+                                  sa.fast, params->window, params->maxMatches,
+                                  params->goodLength, sa.useCheck);
+        }
+        else
+            dst = _LZG_EncodeTuned(&sa, in, insize, dst, outEnd,
+                                   markers, config,
+                                   (lzg_int32_t) (params - _LZG_TUNING_PARAMETERS) + 1);
+    }
+
+    if (stats)
+    {
+        /* Split the loop time between the search and emit phases, in the
+           proportions of the sampled times (the setup counts as search) */
+        sampled = stats->searchTime + stats->emitTime;
+        share = sampled > 0.0 ? stats->searchTime / sampled : 1.0;
+        tEnd = _LZG_GetTime();
+        stats->searchTime = (tLoop - t) + share * (tEnd - tLoop);
+        stats->emitTime = (1.0 - share) * (tEnd - tLoop);
+    }
+
+    /* Free resources (leave the caller provided workspace zero filled) */
+    if (config->workspace)
+    {
+        _LZG_SearchAccel_Clear(&sa, iov, iovcnt);
+        memset(staging, 0, stagingSize);
+    }
+    else if (config->allocfun)
+    {
+        if (config->freefun)
+            config->freefun(tables, config->allocdata);
     }
+    else if (hugePages)
+        _LZG_FreeHugePages(tables, memSize);
+    else
+        free(tables);
+
+    if (!dst)
+        goto overflow;
 
     /* Report progress? (we're done now) */
     if (config->progressfun)
@@ -562,20 +1265,27 @@ lzg_uint32_t LZG_Encode(const unsigned char *in, lzg_uint32_t insize,
 
     /* Set header data */
     hdr.method = LZG_METHOD_LZG1;
-    hdr.encodedSize = (dst - out) - LZG_HEADER_SIZE;
+    hdr.encodedSize = (dst - out) - hdrSize;
     hdr.decodedSize = insize;
     _LZG_SetHeader(out, &hdr);
 
-    /* Free resources */
-    _LZG_SearchAccel_Destroy(sa);
+    if (stats)
+        stats->emitTime += _LZG_GetTime() - tEnd;
 
     /* Return size of compressed buffer */
-    return LZG_HEADER_SIZE + hdr.encodedSize;
+    return hdrSize + hdr.encodedSize;
 
 
 overflow:
     /* Exit routine for output buffer overflow: revert to 1:1 copy */
-    memcpy(out + LZG_HEADER_SIZE, in, insize);
+    dst = out + hdrSize;
+    for (i = 0; i < iovcnt; ++i)
+    {
+        if (!iov[i].size)
+            continue;
+        memcpy(dst, iov[i].base, iov[i].size);
+        dst += iov[i].size;
+    }
 
     /* Report progress? (we're done now) */
     if (config->progressfun)
@@ -587,17 +1297,55 @@ overflow:
     hdr.decodedSize = insize;
     _LZG_SetHeader(out, &hdr);
 
-    /* Free resources */
-    _LZG_SearchAccel_Destroy(sa);
-
     /* Return size of compressed buffer */
-    return LZG_HEADER_SIZE + hdr.encodedSize;
+    return hdrSize + hdr.encodedSize;
+}
 
+lzg_uint32_t LZG_Encode(const unsigned char *in, lzg_uint32_t insize,
+    unsigned char *out, lzg_uint32_t outsize, lzg_encoder_config_t *config)
+{
+    lzg_iovec_t seg;
 
-fail:
-    /* Exit routine for failure situations */
-    if (sa)
-        _LZG_SearchAccel_Destroy(sa);
-    return 0;
+    if (!in)
+        return 0;
+    seg.base = (void *) in;
+    seg.size = insize;
+    return _LZG_Encode(&seg, 1, in, insize, out, outsize, config);
 }
 
+lzg_uint32_t LZG_EncodeV(const lzg_iovec_t *iov, int iovcnt,
+    unsigned char *out, lzg_uint32_t outsize, lzg_encoder_config_t *config)
+{
+    const unsigned char *first;
+    lzg_uint32_t total;
+    lzg_bool_t contiguous;
+    int i;
+
+    if ((!iov) || (iovcnt < 0))
+        return 0;
+
+    /* Total size, and are the segments contiguous in memory? */
+    total = 0;
+    first = (const unsigned char *) 0;
+    contiguous = TRUE;
+    for (i = 0; i < iovcnt; ++i)
+    {
+        if (iov[i].size > (size_t) (0xffffffff - total))
+            return 0;
+        if (!iov[i].size)
+            continue;
+        if (!first)
+            first = (const unsigned char *) iov[i].base;
+        else if ((const unsigned char *) iov[i].base != first + total)
+            contiguous = FALSE;
+        total += (lzg_uint32_t) iov[i].size;
+    }
+
+    /* A single block of memory can be encoded in place (for empty input, any
+       non-NULL input pointer will do), other input is encoded through a
+       staging buffer */
+    if (contiguous)
+        return LZG_Encode(first ? first : out, total, out, outsize, config);
+    return _LZG_Encode(iov, iovcnt, (const unsigned char *) 0, total, out,
+                       outsize, config);
+}
@@ -42,14 +42,22 @@
 #define LZG_METHOD_COPY 0
 #define LZG_METHOD_LZG1 1
 
+/* Method byte flags (the lower bits of the method byte hold the method) */
+#define LZG_METHOD_MASK           0x0f
+#define LZG_FLAG_CONTENT_CHECKSUM 0x80
+
 /* Buffer header format definitions */
-#define LZG_HEADER_SIZE 16
+#define LZG_HEADER_SIZE     16
+#define LZG_EXT_HEADER_SIZE 20  /* Header + decoded content checksum */
+#define LZG_MAX_HEADER_SIZE LZG_EXT_HEADER_SIZE
 
 typedef struct _lzg_header {
     lzg_uint32_t  encodedSize;
     lzg_uint32_t  decodedSize;
     lzg_uint32_t  checksum;
+    lzg_uint32_t  contentChecksum;
     unsigned char method;
+    unsigned char flags;
 } lzg_header;
 
 
@@ -62,8 +70,40 @@ typedef struct _lzg_header {
 # define UNLIKELY(expr) (expr)
 #endif
 
-/* Checksum calculation function (checksum.c) */
+/* Forced inlining (used for generating specialized versions of a routine by
+   calling it with constant arguments) */
+#if defined(__GNUC__)
+# define LZG_INLINE __inline__ __attribute__((always_inline))
+#elif defined(_MSC_VER)
+# define LZG_INLINE __forceinline
+#else
+# define LZG_INLINE
+#endif
+
+/* Prefetch the cache line at addr for reading (only a hint, which never
+   faults, so it can be used for addresses that may not be accessed) */
+#if defined(__GNUC__)
+# define LZG_PREFETCH(addr) __builtin_prefetch((const void *)(addr), 0, 3)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+# include <xmmintrin.h>
+# define LZG_PREFETCH(addr) _mm_prefetch((const char *)(addr), _MM_HINT_T0)
+#else
+# define LZG_PREFETCH(addr)
+#endif
+
+/* Mark an intended fall through to the next case label (a fall through
+   comment is not seen by the compiler inside a macro) */
+#if defined(__GNUC__) && (__GNUC__ >= 7)
+# define LZG_FALLTHROUGH __attribute__((fallthrough))
+#else
+# define LZG_FALLTHROUGH
+#endif
+
+/* Checksum calculation functions (checksum.c) */
+#define LZG_CHECKSUM_INIT 1
 lzg_uint32_t _LZG_CalcChecksum(const unsigned char *in, lzg_uint32_t insize);
+lzg_uint32_t _LZG_UpdateChecksum(lzg_uint32_t checksum,
+                                 const unsigned char *in, lzg_uint32_t insize);
 
 
 #endif // _LZG_INTERNAL_H_
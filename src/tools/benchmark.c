@@ -25,10 +25,17 @@
 *    distribution.
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE /* For CPU affinity */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <lzg.h>
+#include "fileio.h"
+#include "synth.h"
 
 #ifdef USE_ZLIB
 # include <zlib.h>
@@ -52,44 +59,409 @@
 #ifdef _WIN32
 # include <windows.h>
 #else
-# include <sys/time.h>
+# include <time.h>
+#endif
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+# include <x86intrin.h>
+# define HAVE_TSC
 #endif
 
+/* Get the current time (seconds, monotonic) */
+double GetTime(void)
+{
 #ifdef _WIN32
-static __int64 g_timeStart;
-static __int64 g_timeFreq;
+    static __int64 timeFreq = 0;
+    __int64 t;
+    if (!timeFreq)
+        QueryPerformanceFrequency((LARGE_INTEGER *)&timeFreq);
+    QueryPerformanceCounter((LARGE_INTEGER *)&t);
+    return (double) t / (double) timeFreq;
 #else
-static long long g_timeStart;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
 #endif
+}
 
-void StartTimer(void)
+/* Get the current CPU time stamp counter (zero if not available) */
+unsigned long long GetCycles(void)
 {
-#ifdef _WIN32
-  if(QueryPerformanceFrequency((LARGE_INTEGER *)&g_timeFreq))
-    QueryPerformanceCounter((LARGE_INTEGER *)&g_timeStart);
-  else
-    g_timeFreq = 0;
+#ifdef HAVE_TSC
+    return __rdtsc();
 #else
-  struct timeval tv;
-  gettimeofday(&tv, 0);
-  g_timeStart = (long long) tv.tv_sec * (long long) 1000000 + (long long) tv.tv_usec;
+    return 0;
 #endif
 }
 
-unsigned int StopTimer(void)
+/*-- (end of high resolution timer implementation) --------------------------*/
+
+
+/*-- CPU affinity -----------------------------------------------------------*/
+
+#if defined(__linux__)
+# include <sched.h>
+#endif
+
+/* Pin the current thread to a CPU (cpu < 0: the current CPU). Returns the CPU
+   number, or -1 if not supported. */
+int PinToCPU(int cpu)
 {
-#ifdef _WIN32
-  __int64 t;
-  QueryPerformanceCounter((LARGE_INTEGER *)&t);
-  return ((t - g_timeStart) * 1000000) / g_timeFreq;
+#if defined(__linux__)
+    cpu_set_t set;
+    if (cpu < 0)
+        cpu = sched_getcpu();
+    if (cpu < 0)
+        return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        return -1;
+    return cpu;
+#elif defined(_WIN32)
+    if (cpu < 0)
+        cpu = (int) GetCurrentProcessorNumber();
+    if (!SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR) 1) << cpu))
+        return -1;
+    return cpu;
 #else
-  struct timeval tv;
-  gettimeofday(&tv, 0);
-  return (long long) tv.tv_sec * (long long) 1000000 + (long long) tv.tv_usec - g_timeStart;
+    (void) cpu;
+    return -1;
 #endif
 }
 
-/*-- (end of high resolution timer implementation) --------------------------*/
+/*-- (end of CPU affinity) --------------------------------------------------*/
+
+
+/*-- Statistics -------------------------------------------------------------*/
+
+/* Timing statistics for a number of runs */
+typedef struct {
+    int    count;       /* Number of timed runs */
+    double median;      /* Median time (seconds) */
+    double min;         /* Minimum time (seconds) */
+    double max;         /* Maximum time (seconds) */
+    double mean;        /* Mean time (seconds) */
+    double stddev;      /* Standard deviation (seconds) */
+    double cycles;      /* Median number of cycles (zero if not available) */
+} time_stats_t;
+
+static int CompareDouble(const void *p1, const void *p2)
+{
+    double d1 = *(const double *)p1, d2 = *(const double *)p2;
+    return d1 < d2 ? -1 : (d1 > d2 ? 1 : 0);
+}
+
+static double Median(double *x, int n)
+{
+    qsort((void *)x, n, sizeof(double), CompareDouble);
+    if (n & 1)
+        return x[n / 2];
+    return 0.5 * (x[n / 2 - 1] + x[n / 2]);
+}
+
+/* Calculate statistics (note: the arrays are sorted) */
+void CalcTimeStats(double *times, double *cycles, int n, time_stats_t *s)
+{
+    double sum = 0.0, sum2 = 0.0, d;
+    int i;
+
+    s->count = n;
+    if (n < 1)
+    {
+        s->median = s->min = s->max = s->mean = s->stddev = s->cycles = 0.0;
+        return;
+    }
+
+    for (i = 0; i < n; ++i)
+        sum += times[i];
+    s->mean = sum / n;
+    for (i = 0; i < n; ++i)
+    {
+        d = times[i] - s->mean;
+        sum2 += d * d;
+    }
+    s->stddev = n > 1 ? sqrt(sum2 / (n - 1)) : 0.0;
+    s->median = Median(times, n);
+    s->min = times[0];
+    s->max = times[n - 1];
+    s->cycles = Median(cycles, n);
+}
+
+/* Throughput in MB/s (1 MB = 1000000 bytes) */
+double Throughput(double bytes, double seconds)
+{
+    return seconds > 0.0 ? bytes / (1e6 * seconds) : 0.0;
+}
+
+/*-- (end of statistics) ----------------------------------------------------*/
+
+
+/*-- Memory usage -----------------------------------------------------------*/
+
+#if !defined(_WIN32)
+# include <sys/resource.h>
+#endif
+
+#if defined(__linux__)
+/* Read a value (in KB) from /proc/self/status (-1 if not available) */
+static long ReadProcStatus(const char *key)
+{
+    FILE *f;
+    char line[128];
+    size_t keyLen = strlen(key);
+    long value = -1;
+
+    f = fopen("/proc/self/status", "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (strncmp(line, key, keyLen) == 0)
+        {
+            value = atol(line + keyLen);
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+#endif
+
+/* Reset the peak memory usage of the process to the current memory usage.
+   Returns non-zero if supported. */
+int ResetPeakMemory(void)
+{
+#if defined(__linux__)
+    FILE *f;
+    int success;
+    f = fopen("/proc/self/clear_refs", "w");
+    if (!f)
+        return 0;
+    success = fputs("5", f) >= 0;
+    if (fclose(f) != 0)
+        success = 0;
+    return success && (ReadProcStatus("VmHWM:") >= 0);
+#else
+    return 0;
+#endif
+}
+
+/* Get the current memory usage (resident set size) of the process in KB (-1
+   if not available) */
+long GetCurrentMemory(void)
+{
+#if defined(__linux__)
+    return ReadProcStatus("VmRSS:");
+#else
+    return -1;
+#endif
+}
+
+/* Get the peak memory usage (resident set size) of the process in KB (-1 if
+   not available) */
+long GetPeakMemory(void)
+{
+#if defined(__linux__)
+    long peak = ReadProcStatus("VmHWM:");
+    if (peak >= 0)
+        return peak;
+#endif
+#if !defined(_WIN32)
+    {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return -1;
+# if defined(__APPLE__)
+        return (long) (usage.ru_maxrss / 1024);
+# else
+        return (long) usage.ru_maxrss;
+# endif
+    }
+#else
+    return -1;
+#endif
+}
+
+/*-- (end of memory usage) --------------------------------------------------*/
+
+
+/*-- Hardware performance counters ------------------------------------------*/
+
+#if defined(__linux__)
+# include <linux/perf_event.h>
+# include <sys/syscall.h>
+# include <sys/ioctl.h>
+# include <unistd.h>
+# define HAVE_PERF_EVENTS
+#endif
+
+/* Counters */
+#define PERF_CYCLES        0
+#define PERF_INSTRUCTIONS  1
+#define PERF_L1D_MISSES    2
+#define PERF_LLC_MISSES    3
+#define PERF_BRANCH_MISSES 4
+#define PERF_DTLB_MISSES   5
+#define NUM_PERF_COUNTERS  6
+
+/* Counter values (negative = not available) */
+typedef struct {
+    double count[NUM_PERF_COUNTERS];
+} perf_counts_t;
+
+/* Open counters (the file descriptors are -1 for unavailable counters) */
+typedef struct {
+    int fd[NUM_PERF_COUNTERS];
+} perf_counters_t;
+
+static void ClearPerfCounts(perf_counts_t *c)
+{
+    int i;
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+        c->count[i] = -1.0;
+}
+
+static void ScalePerfCounts(perf_counts_t *c, double scale)
+{
+    int i;
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        if (c->count[i] >= 0.0)
+            c->count[i] *= scale;
+    }
+}
+
+/* Add counter values to a total (unavailable in any = unavailable) */
+static void AddPerfCounts(perf_counts_t *total, const perf_counts_t *c)
+{
+    int i;
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        if (total->count[i] < 0.0 || c->count[i] < 0.0)
+            total->count[i] = -1.0;
+        else
+            total->count[i] += c->count[i];
+    }
+}
+
+/* Counter value per byte (negative if not available) */
+static double PerfPerByte(const perf_counts_t *c, int counter, double bytes)
+{
+    return c->count[counter] >= 0.0 ? c->count[counter] / bytes : -1.0;
+}
+
+/* Instructions per cycle (negative if not available) */
+static double PerfIPC(const perf_counts_t *c)
+{
+    if (c->count[PERF_INSTRUCTIONS] < 0.0 || c->count[PERF_CYCLES] <= 0.0)
+        return -1.0;
+    return c->count[PERF_INSTRUCTIONS] / c->count[PERF_CYCLES];
+}
+
+/* Open the counters for the calling thread (user space only). Returns the
+   number of available counters. */
+int OpenPerfCounters(perf_counters_t *p)
+{
+    int i, count = 0;
+#ifdef HAVE_PERF_EVENTS
+    static const struct {
+        unsigned int       type;
+        unsigned long long config;
+    } events[NUM_PERF_COUNTERS] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) }
+    };
+    struct perf_event_attr attr;
+
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        p->fd[i] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (p->fd[i] >= 0)
+            ++count;
+    }
+#else
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+        p->fd[i] = -1;
+#endif
+    return count;
+}
+
+void ClosePerfCounters(perf_counters_t *p)
+{
+    int i;
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+#ifdef HAVE_PERF_EVENTS
+        if (p->fd[i] >= 0)
+            close(p->fd[i]);
+#endif
+        p->fd[i] = -1;
+    }
+}
+
+/* Reset and start the counters */
+void StartPerfCounters(perf_counters_t *p)
+{
+#ifdef HAVE_PERF_EVENTS
+    int i;
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        if (p->fd[i] >= 0)
+        {
+            ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    (void) p;
+#endif
+}
+
+/* Stop the counters and read their values (scaled if the counters had to be
+   multiplexed) */
+void StopPerfCounters(perf_counters_t *p, perf_counts_t *c)
+{
+    int i;
+    ClearPerfCounts(c);
+#ifdef HAVE_PERF_EVENTS
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        if (p->fd[i] >= 0)
+            ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        unsigned long long values[3]; /* Value, time enabled, time running */
+        if ((p->fd[i] >= 0) &&
+            (read(p->fd[i], values, sizeof(values)) == sizeof(values)) &&
+            (values[2] > 0))
+            c->count[i] = (double) values[0] * ((double) values[1] /
+                                                (double) values[2]);
+    }
+#else
+    (void) p;
+    (void) i;
+#endif
+}
+
+/*-- (end of hardware performance counters) ---------------------------------*/
 
 
 /*-- Dynamic codec class ----------------------------------------------------*/
@@ -103,11 +475,22 @@ typedef unsigned int (*DECODEFUN)(const unsigned char *encBuf, unsigned int encS
                                   unsigned char *decBuf, unsigned int decSize);
 
 typedef struct _codec_t {
+    const char       *name;
+    const int        *levels;   /* Supported levels (zero terminated) */
     MAXENCODEDSIZEFUN MaxEncodedSize;
     ENCODEFUN         Encode;
     DECODEFUN         Decode;
 } codec_t;
 
+static const int ALL_LEVELS[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 0 };
+static const int NO_LEVELS[] = { 1, 0 };
+
+
+/* Use huge pages for the LZG search tables (set by -hugepages) */
+static int lzgHugePages = 0;
+
+/* Use the unchecked LZG decoder (set by -trusted) */
+static int lzgTrusted = 0;
 
 static unsigned int LZG_Encode_wrapper(const unsigned char *decBuf,
     unsigned int decSize, unsigned char *encBuf, unsigned int maxEncSize,
@@ -119,14 +502,25 @@ static unsigned int LZG_Encode_wrapper(const unsigned char *decBuf,
     config.fast = fast;
     config.progressfun = progressfun;
     config.userdata = userdata;
+    config.hugePages = lzgHugePages ? LZG_TRUE : LZG_FALSE;
     return LZG_Encode(decBuf, decSize, encBuf, maxEncSize, &config);
 }
 
+static unsigned int LZG_Decode_wrapper(const unsigned char *encBuf,
+    unsigned int encSize, unsigned char *decBuf, unsigned int decSize)
+{
+    if (lzgTrusted)
+        return LZG_DecodeTrusted(encBuf, encSize, decBuf, decSize);
+    return LZG_Decode(encBuf, encSize, decBuf, decSize);
+}
+
 static void InitCodecLZG(codec_t *c)
 {
+    c->name = "lzg";
+    c->levels = ALL_LEVELS;
     c->MaxEncodedSize = LZG_MaxEncodedSize;
     c->Encode = LZG_Encode_wrapper;
-    c->Decode = LZG_Decode;
+    c->Decode = LZG_Decode_wrapper;
 }
 
 static unsigned int MEMCPY_MaxEncodedSize_wrapper(unsigned int insize)
@@ -168,6 +562,8 @@ static unsigned int MEMCPY_Decode_wrapper(const unsigned char *encBuf,
 
 static void InitCodecMEMCPY(codec_t *c)
 {
+    c->name = "memcpy";
+    c->levels = NO_LEVELS;
     c->MaxEncodedSize = MEMCPY_MaxEncodedSize_wrapper;
     c->Encode = MEMCPY_Encode_wrapper;
     c->Decode = MEMCPY_Decode_wrapper;
@@ -238,6 +634,8 @@ static unsigned int ZLIB_Decode_wrapper(const unsigned char *encBuf,
 
 static void InitCodecZLIB(codec_t *c)
 {
+    c->name = "zlib";
+    c->levels = ALL_LEVELS;
     c->MaxEncodedSize = ZLIB_MaxEncodedSize_wrapper;
     c->Encode = ZLIB_Encode_wrapper;
     c->Decode = ZLIB_Decode_wrapper;
@@ -309,6 +707,8 @@ static unsigned int BZ2_Decode_wrapper(const unsigned char *encBuf,
 
 static void InitCodecBZ2(codec_t *c)
 {
+    c->name = "bz2";
+    c->levels = ALL_LEVELS;
     c->MaxEncodedSize = BZ2_MaxEncodedSize_wrapper;
     c->Encode = BZ2_Encode_wrapper;
     c->Decode = BZ2_Decode_wrapper;
@@ -369,9 +769,13 @@ static unsigned int LZO_Decode_wrapper(const unsigned char *encBuf,
     return decompressedSize;
 }
 
+static const int LZO_LEVELS[] = { 1, 9, 0 };
+
 static void InitCodecLZO(codec_t *c)
 {
     lzo_init();
+    c->name = "lzo";
+    c->levels = LZO_LEVELS;
     c->MaxEncodedSize = LZO_MaxEncodedSize_wrapper;
     c->Encode = LZO_Encode_wrapper;
     c->Decode = LZO_Decode_wrapper;
@@ -382,15 +786,72 @@ static void InitCodecLZO(codec_t *c)
 /*-- (end of dynamic codec class) -------------------------------------------*/
 
 
+/* Default number of runs */
+#define DEFAULT_WARMUP_RUNS 1
+#define DEFAULT_TIMED_RUNS  5
+
+/* Default regression threshold (percent) */
+#define DEFAULT_THRESHOLD 5.0
+
+/* Maximum number of codec / level combinations */
+#define MAX_CONFIGS 64
+
+/* Output formats */
+#define FORMAT_TEXT 0
+#define FORMAT_CSV  1
+#define FORMAT_JSON 2
+
+/* Benchmark modes */
+#define MODE_BULK     0
+#define MODE_MESSAGES 1
+#define MODE_THREADS  2
+
+/* Benchmark results for one codec / file combination */
+typedef struct {
+    double       decSize;    /* Uncompressed size (bytes) */
+    double       encSize;    /* Compressed size (bytes) */
+    time_stats_t encode;     /* Compression timing */
+    time_stats_t decode;     /* Decompression timing */
+    long         encMem;     /* Peak memory during compression (KB, -1 = N/A) */
+    long         decMem;     /* Peak memory during decompression (KB, -1 = N/A) */
+    perf_counts_t encPerf;   /* Counters for one compression run */
+    perf_counts_t decPerf;   /* Counters for one decompression run */
+} bench_result_t;
+
+/* A codec / level combination, and the aggregate results for all files */
+typedef struct {
+    codec_t        codec;
+    int            level;
+    int            files;
+    bench_result_t total;
+} bench_config_t;
+
+/* Result output state */
+typedef struct {
+    FILE *f;
+    int   format;
+    int   titles;   /* Print a title for each result (text format) */
+    int   mode;     /* Benchmark mode (MODE_*) */
+    int   records;  /* Number of records in the current section */
+} output_t;
+
 void ShowUsage(char *prgName)
 {
-    fprintf(stderr, "Usage: %s [options] file\n", prgName);
+    int i;
+    fprintf(stderr, "Usage: %s [options] file(s)\n", prgName);
     fprintf(stderr, "\nOptions:\n");
     fprintf(stderr, " -1      Use fastest compression\n");
     fprintf(stderr, " -9      Use best compression\n");
     fprintf(stderr, " -s      Do not use the fast method (saves memory, LZG only)\n");
     fprintf(stderr, " -v      Be verbose\n");
-    fprintf(stderr, " -m      Perform multiple passes (10)\n");
+    fprintf(stderr, " -n N    Number of timed runs (default: %d)\n", DEFAULT_TIMED_RUNS);
+    fprintf(stderr, " -w N    Number of warm-up runs (default: %d)\n", DEFAULT_WARMUP_RUNS);
+    fprintf(stderr, " -m      Perform multiple passes (same as -n 10)\n");
+    fprintf(stderr, " -cpu N  Run on CPU N (default: the current CPU)\n");
+    fprintf(stderr, " -nopin  Do not pin the benchmark to a CPU\n");
+    fprintf(stderr, " -perf   Read hardware performance counters (Linux)\n");
+    fprintf(stderr, " -hugepages     Use huge pages for the search tables (LZG only)\n");
+    fprintf(stderr, " -trusted       Decode without safety checks (LZG only)\n");
     fprintf(stderr, " -lzg    Use LZG compression (default).\n");
 #ifdef USE_ZLIB
     fprintf(stderr, " -zlib   Use zlib compression.\n");
@@ -402,10 +863,50 @@ void ShowUsage(char *prgName)
     fprintf(stderr, " -lzo    Use lzo compression.\n");
 #endif
     fprintf(stderr, " -memcpy Use memcpy \"compression\" (raw 1:1 copy).\n");
+    fprintf(stderr, " -levels Run the selected codecs at all compression levels\n");
+    fprintf(stderr, " -all    Run all codecs at all compression levels\n");
+    fprintf(stderr, " -csv    Print the results in CSV format\n");
+    fprintf(stderr, " -json   Print the results in JSON format\n");
+    fprintf(stderr, " -o name Write the results to a file instead of stdout\n");
+    fprintf(stderr, " -msg S[-S2]    Small message mode: message size S, or S to S2\n");
+    fprintf(stderr, " -threads N     Thread scaling mode: run on 1 and N threads at once\n");
+    fprintf(stderr, " -split         Split the data between the threads (one large job)\n");
+    fprintf(stderr, " -synth T[:S]   Use synthetic input of type T and size S (default: 1M)\n");
+    fprintf(stderr, " -seed N        Seed for the synthetic inputs (default: 1)\n");
+    fprintf(stderr, " -save name     Save the results to a file (CSV)\n");
+    fprintf(stderr, " -compare name  Compare the results with a saved results file\n");
+    fprintf(stderr, " -threshold P   Regression threshold in percent (default: %.1f)\n",
+            DEFAULT_THRESHOLD);
     fprintf(stderr, "\nDescription:\n");
-    fprintf(stderr, "This program will load the given file, compress it, and then decompress it\n");
-    fprintf(stderr, "again. The time it takes to do the operations are measured (excluding file\n");
-    fprintf(stderr, "I/O etc), and printed to stdout.\n");
+    fprintf(stderr, "This program will load the given file(s), compress them, and then decompress\n");
+    fprintf(stderr, "them again. The operations are first run a few times to warm up caches etc,\n");
+    fprintf(stderr, "and then timed over a number of runs (excluding file I/O and memory\n");
+    fprintf(stderr, "allocation). The median, best and standard deviation of the throughput are\n");
+    fprintf(stderr, "printed to stdout.\n");
+    fprintf(stderr, "\nA directory argument adds all files in the directory (and its sub\n");
+    fprintf(stderr, "directories), and @name adds all files listed in the file name (one per line).\n");
+    fprintf(stderr, "When more than one file is given, aggregate results are printed too.\n");
+    fprintf(stderr, "\nIn small message mode, the input is split into messages that are compressed\n");
+    fprintf(stderr, "and decompressed one by one (sizes are log-uniformly distributed between S\n");
+    fprintf(stderr, "and S2, depending on the seed). Every call is timed, and latency percentiles\n");
+    fprintf(stderr, "and calls per second are printed.\n");
+    fprintf(stderr, "\nIn thread scaling mode, independent compression and decompression loops\n");
+    fprintf(stderr, "run on all threads at once (each thread processes all the data, or with\n");
+    fprintf(stderr, "-split, a part of it). The aggregate and per-thread throughput, the scaling\n");
+    fprintf(stderr, "efficiency relative to a single thread, and the peak memory of the process\n");
+    fprintf(stderr, "are printed. Combined with -msg, every thread processes small messages.\n");
+    fprintf(stderr, "\nSynthetic inputs are generated in memory, and are the same on every machine\n");
+    fprintf(stderr, "for a given seed. Available types (\"all\" = all types):");
+    for (i = 0; SyntheticTypeName(i); ++i)
+        fprintf(stderr, " %s", SyntheticTypeName(i));
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Peak memory is the memory used by the codec and its buffers (in KB).\n");
+    fprintf(stderr, "\nWhen comparing with a baseline, the throughput changes are printed with 95%%\n");
+    fprintf(stderr, "confidence intervals. If the compression or decompression throughput is\n");
+    fprintf(stderr, "significantly lower than the baseline (by more than the threshold), the\n");
+    fprintf(stderr, "program exits with code 2.\n");
+    fprintf(stderr, "The change of the dTLB misses is printed too, if both runs used -perf (e.g.\n");
+    fprintf(stderr, "save a run with -levels -perf, and compare it with -levels -perf -hugepages).\n");
 }
 
 void ShowProgress(int progress, void *data)
@@ -415,172 +916,2049 @@ void ShowProgress(int progress, void *data)
     fflush(f);
 }
 
-int main(int argc, char **argv)
+/* Load an entire file into memory */
+unsigned char *LoadFile(const char *name, unsigned int *size)
 {
-    char *inName;
     FILE *inFile;
     size_t fileSize;
-    unsigned char *decBuf;
-    unsigned int decSize = 0;
-    unsigned char *encBuf;
-    unsigned int maxEncSize, encSize, t;
-    int arg, level, fast, verbose, pass, numPasses, success;
-    LZGPROGRESSFUN progressfun = 0;
-    codec_t c;
-
-    // Default arguments
-    inName = NULL;
-    level = 5;
-    verbose = 0;
-    fast = 1;
-    numPasses = 1;
-    InitCodecLZG(&c);
+    unsigned char *buf = (unsigned char*) 0;
 
-    // Get arguments
-    for (arg = 1; arg < argc; ++arg)
+    inFile = fopen(name, "rb");
+    if (inFile)
     {
-        if (strcmp("-1", argv[arg]) == 0)
-            level = 1;
-        else if (strcmp("-2", argv[arg]) == 0)
-            level = 2;
-        else if (strcmp("-3", argv[arg]) == 0)
-            level = 3;
-        else if (strcmp("-4", argv[arg]) == 0)
-            level = 4;
-        else if (strcmp("-5", argv[arg]) == 0)
-            level = 5;
-        else if (strcmp("-6", argv[arg]) == 0)
-            level = 6;
-        else if (strcmp("-7", argv[arg]) == 0)
-            level = 7;
-        else if (strcmp("-8", argv[arg]) == 0)
-            level = 8;
-        else if (strcmp("-9", argv[arg]) == 0)
-            level = 9;
-        else if (strcmp("-v", argv[arg]) == 0)
-            verbose = 1;
-        else if (strcmp("-m", argv[arg]) == 0)
-            numPasses = 10;
-        else if (strcmp("-s", argv[arg]) == 0)
-            fast = 0;
-        else if (strcmp("-lzg", argv[arg]) == 0)
-            InitCodecLZG(&c);
-#ifdef USE_ZLIB
-        else if (strcmp("-zlib", argv[arg]) == 0)
-            InitCodecZLIB(&c);
-#endif
-#ifdef USE_BZ2
-        else if (strcmp("-bz2", argv[arg]) == 0)
-            InitCodecBZ2(&c);
-#endif
-#ifdef USE_LZO
-        else if (strcmp("-lzo", argv[arg]) == 0)
-            InitCodecLZO(&c);
-#endif
-        else if (strcmp("-memcpy", argv[arg]) == 0)
-            InitCodecMEMCPY(&c);
-        else if (!inName)
-            inName = argv[arg];
-        else
+        fseek(inFile, 0, SEEK_END);
+        fileSize = (size_t) ftell(inFile);
+        fseek(inFile, 0, SEEK_SET);
+        if (fileSize > 0)
         {
-            ShowUsage(argv[0]);
-            return 0;
+            *size = (unsigned int) fileSize;
+            buf = (unsigned char*) malloc(fileSize);
+            if (buf)
+            {
+                if (fread(buf, 1, fileSize, inFile) != fileSize)
+                {
+                    fprintf(stderr, "Error reading \"%s\".\n", name);
+                    free(buf);
+                    buf = (unsigned char*) 0;
+                }
+            }
+            else
+                fprintf(stderr, "Out of memory.\n");
         }
+        else
+            fprintf(stderr, "Input file \"%s\" is empty.\n", name);
+
+        fclose(inFile);
     }
-    if (!inName)
+    else
+        fprintf(stderr, "Unable to open file \"%s\".\n", name);
+
+    return buf;
+}
+
+/* Prefix of synthetic input names ("synth:type:size:seed") */
+#define SYNTH_PREFIX "synth:"
+
+/* Default size of synthetic inputs */
+#define DEFAULT_SYNTH_SIZE (1024 * 1024)
+
+/* Parse a size, with an optional K/M/G suffix (0 if invalid) */
+static size_t ParseSize(const char *str)
+{
+    char *end;
+    unsigned long size = strtoul(str, &end, 10);
+    if (*end == 'k' || *end == 'K')
+        size <<= 10, ++end;
+    else if (*end == 'm' || *end == 'M')
+        size <<= 20, ++end;
+    else if (*end == 'g' || *end == 'G')
+        size <<= 30, ++end;
+    return *end ? 0 : (size_t) size;
+}
+
+/* Add synthetic inputs ("type[:size]", type "all" = all types) to a file list */
+int AddSynthetic(file_list_t *list, const char *spec, unsigned int seed)
+{
+    char name[128], type[32];
+    const char *sizeStr;
+    size_t typeLen, size = DEFAULT_SYNTH_SIZE;
+    int i, success = 1;
+
+    sizeStr = strchr(spec, ':');
+    typeLen = sizeStr ? (size_t) (sizeStr - spec) : strlen(spec);
+    if (sizeStr)
+        size = ParseSize(sizeStr + 1);
+    if ((typeLen >= sizeof(type)) || (size == 0))
     {
-        ShowUsage(argv[0]);
+        fprintf(stderr, "Invalid synthetic input \"%s\".\n", spec);
         return 0;
     }
+    memcpy(type, spec, typeLen);
+    type[typeLen] = 0;
 
-    for (pass = 1; pass <= numPasses; ++pass)
+    for (i = 0; success && SyntheticTypeName(i); ++i)
     {
-        success = 0;
-
-        // Read input file
-        decBuf = (unsigned char*) 0;
-        inFile = fopen(inName, "rb");
-        if (inFile)
+        if ((strcmp(type, "all") == 0) ||
+            (strcmp(type, SyntheticTypeName(i)) == 0))
         {
-            fseek(inFile, 0, SEEK_END);
-            fileSize = (unsigned int) ftell(inFile);
-            fseek(inFile, 0, SEEK_SET);
-            if (fileSize > 0)
-            {
-                decSize = (unsigned int) fileSize;
-                decBuf = (unsigned char*) malloc(decSize);
-                if (decBuf)
-                {
-                    if (fread(decBuf, 1, decSize, inFile) != decSize)
-                    {
-                        fprintf(stderr, "Error reading \"%s\".\n", inName);
-                        free(decBuf);
-                        decBuf = (unsigned char*) 0;
-                    }
-                }
-                else
-                    fprintf(stderr, "Out of memory.\n");
-            }
-            else
-                fprintf(stderr, "Input file is empty.\n");
-
-            fclose(inFile);
+            sprintf(name, SYNTH_PREFIX "%s:%lu:%u", SyntheticTypeName(i),
+                    (unsigned long) size, seed);
+            success = AddFile(list, name);
+            if (strcmp(type, "all") != 0)
+                return success;
         }
-        else
-            fprintf(stderr, "Unable to open file \"%s\".\n", inName);
+    }
+    if (strcmp(type, "all") != 0)
+    {
+        fprintf(stderr, "Unknown synthetic input type \"%s\".\n", type);
+        return 0;
+    }
+    return success;
+}
 
-        if (decBuf)
-        {
-            // Determine maximum size of compressed data
-            maxEncSize = c.MaxEncodedSize(decSize);
+/* Load an input file, or generate synthetic input data */
+unsigned char *LoadInput(const char *name, unsigned int *size)
+{
+    char type[32];
+    unsigned long synthSize;
+    unsigned int seed;
+    unsigned char *buf;
 
-            // Allocate memory for the compressed data
-            encBuf = (unsigned char*) malloc(maxEncSize);
-            if (encBuf)
-            {
-                // Compress
-                if (verbose)
-                    progressfun = ShowProgress;
-                StartTimer();
-                encSize = c.Encode(decBuf, decSize, encBuf, maxEncSize,
-                                    level, fast, progressfun, stderr);
-                t = StopTimer();
-                if (encSize)
-                {
-                    fprintf(stdout, "Compression: %d us (%lld KB/s)\n", t,
-                                    (decSize * (long long) 977) / t);
-
-                    // Compressed data is now in encBuf, now decompress it...
-                    StartTimer();
-                    decSize = c.Decode(encBuf, encSize, decBuf, decSize);
-                    t = StopTimer();
-                    if (decSize)
-                    {
-                        fprintf(stdout, "Decompression: %d us (%lld KB/s)\n", t,
-                                        (decSize * (long long) 977) / t);
-                        fprintf(stdout, "Sizes: %d => %d bytes, %d%%\n", decSize, encSize,
-                                        (100 * encSize) / decSize);
-                        success = 1;
-                    }
-                    else
-                        fprintf(stderr, "Decompression failed!\n");
-                }
-                else
-                    fprintf(stderr, "Compression failed!\n");
+    if (strncmp(name, SYNTH_PREFIX, strlen(SYNTH_PREFIX)) != 0)
+        return LoadFile(name, size);
 
-                // Free memory when we're done with the compressed data
-                free(encBuf);
-            }
-            else
-                fprintf(stderr, "Out of memory!\n");
+    if ((sscanf(name + strlen(SYNTH_PREFIX), "%31[^:]:%lu:%u", type,
+                &synthSize, &seed) != 3) || (synthSize == 0))
+    {
+        fprintf(stderr, "Invalid synthetic input \"%s\".\n", name);
+        return NULL;
+    }
+    buf = (unsigned char*) malloc(synthSize);
+    if (!buf)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        return NULL;
+    }
+    if (!GenerateSynthetic(type, buf, synthSize, seed))
+    {
+        fprintf(stderr, "Unknown synthetic input type \"%s\".\n", type);
+        free(buf);
+        return NULL;
+    }
+    *size = (unsigned int) synthSize;
+    return buf;
+}
 
-            // Free memory when we're done with the decompressed data
-            free(decBuf);
-        }
+/* Add all files listed in a text file (one name per line) to a file list */
+int AddFileList(file_list_t *list, const char *listName)
+{
+    FILE *f;
+    char line[4096];
+    size_t len;
+    int success = 1;
 
-        if (!success) break;
+    f = fopen(listName, "r");
+    if (!f)
+    {
+        fprintf(stderr, "Unable to open file \"%s\".\n", listName);
+        return 0;
+    }
+    while (success && fgets(line, sizeof(line), f))
+    {
+        len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = 0;
+        if (len > 0)
+            success = AddFile(list, line);
     }
+    fclose(f);
+    return success;
+}
 
-    return 0;
+/* Memory used since base (or the peak memory if base < 0), in KB */
+static long PeakMemorySince(long base)
+{
+    long peak = GetPeakMemory();
+    if (peak < 0 || base < 0)
+        return peak;
+    return peak > base ? peak - base : 0;
 }
 
+/* Benchmark a codec on a data buffer. Returns non-zero on success. */
+int RunBenchmark(codec_t *c, const unsigned char *data, unsigned int size,
+                 int level, int fast, int warmupRuns, int timedRuns,
+                 LZGPROGRESSFUN progressfun, perf_counters_t *perf,
+                 bench_result_t *r)
+{
+    unsigned char *encBuf, *decBuf;
+    unsigned int maxEncSize, encSize = 0, decSize = 0;
+    double *times, *cycles, t;
+    unsigned long long cy;
+    long memBase;
+    int run, success = 0;
+
+    r->decSize = size;
+    r->encSize = 0;
+    r->encMem = r->decMem = -1;
+    ClearPerfCounts(&r->encPerf);
+    ClearPerfCounts(&r->decPerf);
+
+    // Track the memory used from here on (if possible)
+    memBase = ResetPeakMemory() ? GetCurrentMemory() : -1;
+
+    // Allocate memory (outside of the timed sections)
+    maxEncSize = c->MaxEncodedSize(size);
+    encBuf = (unsigned char*) malloc(maxEncSize);
+    decBuf = (unsigned char*) malloc(size);
+    times = (double*) malloc(sizeof(double) * 2 * (timedRuns + 1));
+    if (!encBuf || !decBuf || !times)
+    {
+        fprintf(stderr, "Out of memory!\n");
+        goto done;
+    }
+    cycles = times + timedRuns + 1;
+
+    // Touch the buffers (page faults should not be part of the first run)
+    memset(encBuf, 0, maxEncSize);
+    memset(decBuf, 0, size);
+
+    // Compress
+    for (run = 0; run < warmupRuns + timedRuns; ++run)
+    {
+        if (perf && run == warmupRuns)
+            StartPerfCounters(perf);
+        t = GetTime();
+        cy = GetCycles();
+        encSize = c->Encode(data, size, encBuf, maxEncSize, level, fast,
+                            run == 0 ? progressfun : 0, stderr);
+        cy = GetCycles() - cy;
+        t = GetTime() - t;
+        if (!encSize)
+        {
+            fprintf(stderr, "Compression failed!\n");
+            goto done;
+        }
+        if (run >= warmupRuns)
+        {
+            times[run - warmupRuns] = t;
+            cycles[run - warmupRuns] = (double) cy;
+        }
+    }
+    if (perf)
+    {
+        StopPerfCounters(perf, &r->encPerf);
+        ScalePerfCounts(&r->encPerf, 1.0 / timedRuns);
+    }
+    CalcTimeStats(times, cycles, timedRuns, &r->encode);
+    r->encSize = encSize;
+    r->encMem = PeakMemorySince(memBase);
+    if (memBase >= 0)
+        ResetPeakMemory();
+
+    // Decompress
+    for (run = 0; run < warmupRuns + timedRuns; ++run)
+    {
+        if (perf && run == warmupRuns)
+            StartPerfCounters(perf);
+        t = GetTime();
+        cy = GetCycles();
+        decSize = c->Decode(encBuf, encSize, decBuf, size);
+        cy = GetCycles() - cy;
+        t = GetTime() - t;
+        if (decSize != size)
+        {
+            fprintf(stderr, "Decompression failed!\n");
+            goto done;
+        }
+        if (run >= warmupRuns)
+        {
+            times[run - warmupRuns] = t;
+            cycles[run - warmupRuns] = (double) cy;
+        }
+    }
+    if (perf)
+    {
+        StopPerfCounters(perf, &r->decPerf);
+        ScalePerfCounts(&r->decPerf, 1.0 / timedRuns);
+    }
+    CalcTimeStats(times, cycles, timedRuns, &r->decode);
+    r->decMem = PeakMemorySince(memBase);
+
+    // Verify the result
+    if (memcmp(data, decBuf, size) != 0)
+    {
+        fprintf(stderr, "Decompressed data differs from the original!\n");
+        goto done;
+    }
+
+    success = 1;
+
+done:
+    free(times);
+    free(decBuf);
+    free(encBuf);
+    return success;
+}
+
+/*-- Small message benchmark ------------------------------------------------*/
+
+/* Latency statistics for a number of calls */
+typedef struct {
+    double p50;          /* Median latency (seconds) */
+    double p90;          /* 90th percentile (seconds) */
+    double p99;          /* 99th percentile (seconds) */
+    double p999;         /* 99.9th percentile (seconds) */
+    double max;          /* Maximum latency (seconds) */
+    double callsPerSec;  /* Calls per second */
+    double throughput;   /* MB/s (uncompressed data) */
+} latency_stats_t;
+
+/* Small message benchmark results for one codec / file combination */
+typedef struct {
+    double          decSize;    /* Uncompressed size of all messages (bytes) */
+    double          encSize;    /* Compressed size of all messages (bytes) */
+    int             messages;   /* Number of messages (per run) */
+    int             runs;       /* Number of timed runs */
+    latency_stats_t encode;     /* Compression latency */
+    latency_stats_t decode;     /* Decompression latency */
+} msg_result_t;
+
+/* Message size distribution (sizes are log-uniformly distributed) */
+typedef struct {
+    unsigned int minSize;
+    unsigned int maxSize;
+    unsigned int seed;
+} msg_sizes_t;
+
+/* Parse a message size distribution ("size" or "min-max") */
+static int ParseMessageSizes(const char *str, msg_sizes_t *m)
+{
+    char tmp[64];
+    const char *dash = strchr(str, '-');
+    size_t len = dash ? (size_t) (dash - str) : strlen(str);
+    if (len >= sizeof(tmp))
+        return 0;
+    memcpy(tmp, str, len);
+    tmp[len] = 0;
+    m->minSize = (unsigned int) ParseSize(tmp);
+    m->maxSize = dash ? (unsigned int) ParseSize(dash + 1) : m->minSize;
+    return (m->minSize > 0) && (m->maxSize >= m->minSize);
+}
+
+/* Split data into messages. Returns the number of messages, and the message
+   offsets (number of messages + 1 entries, to be freed by the caller). */
+static int SplitMessages(unsigned int size, const msg_sizes_t *m,
+                         unsigned int **offsets)
+{
+    unsigned int state, pos, len, *offs = NULL;
+    int count, pass;
+    double u;
+
+    // First pass: count the messages, second pass: store the offsets
+    for (pass = 0; pass < 2; ++pass)
+    {
+        state = m->seed * 2654435761u + 1;
+        count = 0;
+        for (pos = 0; pos < size; pos += len)
+        {
+            state = state * 1664525u + 1013904223u;
+            u = (double) (state >> 8) * (1.0 / 16777216.0);
+            len = (unsigned int) (m->minSize * pow((double) m->maxSize /
+                                                   m->minSize, u) + 0.5);
+            if (len > size - pos)
+                len = size - pos;
+            if (offs)
+                offs[count] = pos;
+            ++count;
+        }
+        if (offs)
+            offs[count] = size;
+        else if (!(offs = (unsigned int*) malloc((count + 1) *
+                                                 sizeof(unsigned int))))
+            return 0;
+    }
+    *offsets = offs;
+    return count;
+}
+
+/* Calculate latency statistics (note: the array is sorted) */
+static void CalcLatencyStats(double *times, int n, double bytes,
+                             latency_stats_t *s)
+{
+    double sum = 0.0;
+    int i;
+
+    for (i = 0; i < n; ++i)
+        sum += times[i];
+    qsort((void *)times, n, sizeof(double), CompareDouble);
+    s->p50 = times[(n * 50 + 99) / 100 - 1];
+    s->p90 = times[(n * 90 + 99) / 100 - 1];
+    s->p99 = times[(n * 99 + 99) / 100 - 1];
+    s->p999 = times[(n * 999 + 999) / 1000 - 1];
+    s->max = times[n - 1];
+    s->callsPerSec = sum > 0.0 ? n / sum : 0.0;
+    s->throughput = Throughput(bytes, sum);
+}
+
+/* Benchmark a codec on many small messages, timing each call separately.
+   Returns non-zero on success. */
+int RunMessageBenchmark(codec_t *c, const unsigned char *data,
+                        unsigned int size, int level, int fast, int warmupRuns,
+                        int timedRuns, const msg_sizes_t *sizes,
+                        msg_result_t *r)
+{
+    unsigned char *encBuf = NULL, *decBuf = NULL;
+    unsigned int *offsets = NULL, *encOffsets = NULL, *encSizes = NULL;
+    unsigned int decLen, maxEncLen, len;
+    double *times = NULL, t, encSize = 0.0;
+    int count, run, i, n, success = 0;
+
+    memset(r, 0, sizeof(msg_result_t));
+
+    // Split the data into messages, and allocate memory
+    count = SplitMessages(size, sizes, &offsets);
+    encOffsets = (unsigned int*) malloc((count + 1) * sizeof(unsigned int));
+    encSizes = (unsigned int*) malloc((count + 1) * sizeof(unsigned int));
+    times = (double*) malloc(sizeof(double) * count * timedRuns);
+    if (!count || !encOffsets || !encSizes || !times)
+    {
+        fprintf(stderr, "Out of memory!\n");
+        goto done;
+    }
+    encOffsets[0] = 0;
+    for (i = 0; i < count; ++i)
+        encOffsets[i + 1] = encOffsets[i] +
+                            c->MaxEncodedSize(offsets[i + 1] - offsets[i]);
+    encBuf = (unsigned char*) malloc(encOffsets[count]);
+    decBuf = (unsigned char*) malloc(size);
+    if (!encBuf || !decBuf)
+    {
+        fprintf(stderr, "Out of memory!\n");
+        goto done;
+    }
+    memset(encBuf, 0, encOffsets[count]);
+    memset(decBuf, 0, size);
+
+    // Compress
+    for (run = 0, n = 0; run < warmupRuns + timedRuns; ++run)
+    {
+        encSize = 0.0;
+        for (i = 0; i < count; ++i)
+        {
+            decLen = offsets[i + 1] - offsets[i];
+            maxEncLen = encOffsets[i + 1] - encOffsets[i];
+            t = GetTime();
+            len = c->Encode(&data[offsets[i]], decLen, &encBuf[encOffsets[i]],
+                            maxEncLen, level, fast, 0, 0);
+            t = GetTime() - t;
+            if (!len)
+            {
+                fprintf(stderr, "Compression failed!\n");
+                goto done;
+            }
+            encSizes[i] = len;
+            encSize += len;
+            if (run >= warmupRuns)
+                times[n++] = t;
+        }
+    }
+    CalcLatencyStats(times, n, (double) size * timedRuns, &r->encode);
+
+    // Decompress
+    for (run = 0, n = 0; run < warmupRuns + timedRuns; ++run)
+    {
+        for (i = 0; i < count; ++i)
+        {
+            decLen = offsets[i + 1] - offsets[i];
+            t = GetTime();
+            len = c->Decode(&encBuf[encOffsets[i]], encSizes[i],
+                            &decBuf[offsets[i]], decLen);
+            t = GetTime() - t;
+            if (len != decLen)
+            {
+                fprintf(stderr, "Decompression failed!\n");
+                goto done;
+            }
+            if (run >= warmupRuns)
+                times[n++] = t;
+        }
+    }
+    CalcLatencyStats(times, n, (double) size * timedRuns, &r->decode);
+
+    // Verify the result
+    if (memcmp(data, decBuf, size) != 0)
+    {
+        fprintf(stderr, "Decompressed data differs from the original!\n");
+        goto done;
+    }
+
+    r->decSize = size;
+    r->encSize = encSize;
+    r->messages = count;
+    r->runs = timedRuns;
+    success = 1;
+
+done:
+    free(decBuf);
+    free(encBuf);
+    free(times);
+    free(encSizes);
+    free(encOffsets);
+    free(offsets);
+    return success;
+}
+
+/*-- (end of small message benchmark) ---------------------------------------*/
+
+
+/*-- Thread scaling benchmark -----------------------------------------------*/
+
+#if !defined(_WIN32)
+# define USE_THREADS
+# include <pthread.h>
+#endif
+
+/* Maximum number of threads */
+#define MAX_THREADS 256
+
+/* Workloads */
+#define WORKLOAD_FULL     0  /* Every thread processes all the data */
+#define WORKLOAD_SPLIT    1  /* The data is split between the threads */
+
+/* Results of a thread scaling benchmark */
+typedef struct {
+    int    threads;         /* Number of threads */
+    int    runs;            /* Number of timed runs */
+    double decSize;         /* Uncompressed size, all threads (bytes) */
+    double encSize;         /* Compressed size, all threads (bytes) */
+    double encThroughput;   /* Aggregate compression throughput (MB/s) */
+    double decThroughput;   /* Aggregate decompression throughput (MB/s) */
+    double encThread[3];    /* Min, mean, max per-thread throughput (MB/s) */
+    double decThread[3];    /* Min, mean, max per-thread throughput (MB/s) */
+    double encCalls;        /* Aggregate compression calls per second */
+    double decCalls;        /* Aggregate decompression calls per second */
+    double encEfficiency;   /* Scaling efficiency (relative to one thread) */
+    double decEfficiency;
+    long   peakMem;         /* Peak memory of the process (KB, -1 = N/A) */
+} thread_result_t;
+
+#ifdef USE_THREADS
+
+/* Reusable thread barrier */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    int             count;
+    int             total;
+    int             generation;
+} barrier_t;
+
+static void WaitBarrier(barrier_t *b)
+{
+    int generation;
+    pthread_mutex_lock(&b->mutex);
+    generation = b->generation;
+    if (++b->count >= b->total)
+    {
+        b->count = 0;
+        ++b->generation;
+        pthread_cond_broadcast(&b->cond);
+    }
+    else
+    {
+        while (generation == b->generation)
+            pthread_cond_wait(&b->cond, &b->mutex);
+    }
+    pthread_mutex_unlock(&b->mutex);
+}
+
+/* Benchmark parameters (shared by all threads) */
+typedef struct {
+    codec_t           *codec;
+    int                level;
+    int                fast;
+    int                warmupRuns;
+    int                timedRuns;
+    const msg_sizes_t *sizes;      /* Message sizes (NULL = one call) */
+    barrier_t          barrier;
+} thread_bench_t;
+
+/* Per-thread job */
+typedef struct {
+    thread_bench_t      *bench;
+    pthread_t            thread;
+    const unsigned char *data;
+    unsigned int         size;
+    int                  calls;     /* Calls per run */
+    double               encSize;
+    double               encStart, encEnd;
+    double               decStart, decEnd;
+    int                  success;
+} thread_job_t;
+
+static void *ThreadBenchmarkWorker(void *arg)
+{
+    thread_job_t *job = (thread_job_t *) arg;
+    thread_bench_t *b = job->bench;
+    codec_t *c = b->codec;
+    unsigned char *encBuf = NULL, *decBuf = NULL;
+    unsigned int *offsets = NULL, *encOffsets = NULL, *encSizes = NULL;
+    unsigned int decLen;
+    int count = 0, run, i, ok;
+
+    // Split the data into messages, and allocate memory
+    if (b->sizes)
+        count = SplitMessages(job->size, b->sizes, &offsets);
+    else if ((offsets = (unsigned int*) malloc(2 * sizeof(unsigned int))))
+    {
+        offsets[0] = 0;
+        offsets[1] = job->size;
+        count = 1;
+    }
+    encOffsets = (unsigned int*) malloc((count + 1) * sizeof(unsigned int));
+    encSizes = (unsigned int*) malloc((count + 1) * sizeof(unsigned int));
+    ok = count && encOffsets && encSizes;
+    if (ok)
+    {
+        encOffsets[0] = 0;
+        for (i = 0; i < count; ++i)
+            encOffsets[i + 1] = encOffsets[i] +
+                                c->MaxEncodedSize(offsets[i + 1] - offsets[i]);
+        encBuf = (unsigned char*) malloc(encOffsets[count]);
+        decBuf = (unsigned char*) malloc(job->size);
+        ok = encBuf && decBuf;
+    }
+    if (!ok)
+        fprintf(stderr, "Out of memory!\n");
+    job->calls = count;
+
+    // Compress (all threads start at the same time)
+    for (run = 0; run < b->warmupRuns + b->timedRuns; ++run)
+    {
+        if (run == b->warmupRuns)
+        {
+            WaitBarrier(&b->barrier);
+            job->encStart = GetTime();
+        }
+        job->encSize = 0.0;
+        for (i = 0; ok && i < count; ++i)
+        {
+            encSizes[i] = c->Encode(&job->data[offsets[i]],
+                                    offsets[i + 1] - offsets[i],
+                                    &encBuf[encOffsets[i]],
+                                    encOffsets[i + 1] - encOffsets[i],
+                                    b->level, b->fast, 0, 0);
+            ok = encSizes[i] > 0;
+            job->encSize += encSizes[i];
+        }
+    }
+    job->encEnd = GetTime();
+
+    // Decompress
+    for (run = 0; run < b->warmupRuns + b->timedRuns; ++run)
+    {
+        if (run == b->warmupRuns)
+        {
+            WaitBarrier(&b->barrier);
+            job->decStart = GetTime();
+        }
+        for (i = 0; ok && i < count; ++i)
+        {
+            decLen = offsets[i + 1] - offsets[i];
+            ok = c->Decode(&encBuf[encOffsets[i]], encSizes[i],
+                           &decBuf[offsets[i]], decLen) == decLen;
+        }
+    }
+    job->decEnd = GetTime();
+
+    // Verify the result
+    job->success = ok && (memcmp(job->data, decBuf, job->size) == 0);
+
+    free(decBuf);
+    free(encBuf);
+    free(encSizes);
+    free(encOffsets);
+    free(offsets);
+    return NULL;
+}
+
+#endif // USE_THREADS
+
+/* Per-thread throughput statistics (min, mean, max) */
+static void ThreadStats(const double *x, int n, double *stats)
+{
+    int i;
+    stats[0] = stats[2] = x[0];
+    stats[1] = 0.0;
+    for (i = 0; i < n; ++i)
+    {
+        if (x[i] < stats[0])
+            stats[0] = x[i];
+        if (x[i] > stats[2])
+            stats[2] = x[i];
+        stats[1] += x[i] / n;
+    }
+}
+
+/* Run independent compression / decompression loops on a number of threads
+   at the same time. Returns non-zero on success. */
+int RunThreadBenchmark(codec_t *c, const unsigned char *data,
+                       unsigned int size, int level, int fast, int warmupRuns,
+                       int timedRuns, const msg_sizes_t *sizes, int workload,
+                       int threads, thread_result_t *r)
+{
+#ifdef USE_THREADS
+    thread_bench_t b;
+    thread_job_t *jobs;
+    double encRate[MAX_THREADS], decRate[MAX_THREADS];
+    double encStart, encEnd, decStart, decEnd, calls = 0.0;
+    unsigned int chunk;
+    int i, started, success = 1;
+
+    memset(r, 0, sizeof(thread_result_t));
+    r->threads = threads;
+    r->runs = timedRuns;
+    if (threads < 1 || threads > MAX_THREADS)
+        return 0;
+    jobs = (thread_job_t*) calloc(threads, sizeof(thread_job_t));
+    if (!jobs)
+    {
+        fprintf(stderr, "Out of memory!\n");
+        return 0;
+    }
+
+    b.codec = c;
+    b.level = level;
+    b.fast = fast;
+    b.warmupRuns = warmupRuns;
+    b.timedRuns = timedRuns;
+    b.sizes = sizes;
+    pthread_mutex_init(&b.barrier.mutex, NULL);
+    pthread_cond_init(&b.barrier.cond, NULL);
+    b.barrier.count = 0;
+    b.barrier.generation = 0;
+
+    // Assign the data to the threads
+    chunk = (size + threads - 1) / threads;
+    for (i = 0; i < threads; ++i)
+    {
+        jobs[i].bench = &b;
+        if (workload == WORKLOAD_SPLIT)
+        {
+            jobs[i].data = data + (size_t) i * chunk;
+            jobs[i].size = i < threads - 1 ? chunk : size - (threads - 1) * chunk;
+        }
+        else
+        {
+            jobs[i].data = data;
+            jobs[i].size = size;
+        }
+        if (jobs[i].size == 0)
+            break;
+    }
+    threads = i;
+    b.barrier.total = threads;
+    r->threads = threads;
+
+    // Run the threads
+    ResetPeakMemory();
+    for (started = 0; started < threads; ++started)
+    {
+        if (pthread_create(&jobs[started].thread, NULL, ThreadBenchmarkWorker,
+                           &jobs[started]) != 0)
+            break;
+    }
+    if (started < threads)
+    {
+        // Let the started threads pass the barriers
+        fprintf(stderr, "Unable to create thread.\n");
+        pthread_mutex_lock(&b.barrier.mutex);
+        b.barrier.total = started;
+        if (b.barrier.count >= started)
+        {
+            b.barrier.count = 0;
+            ++b.barrier.generation;
+            pthread_cond_broadcast(&b.barrier.cond);
+        }
+        pthread_mutex_unlock(&b.barrier.mutex);
+        success = 0;
+    }
+    for (i = 0; i < started; ++i)
+        pthread_join(jobs[i].thread, NULL);
+    r->peakMem = GetPeakMemory();
+
+    // Collect the results
+    encRate[0] = decRate[0] = 0.0;
+    encStart = decStart = jobs[0].encStart;
+    encEnd = decEnd = 0.0;
+    for (i = 0; success && i < threads; ++i)
+    {
+        if (!jobs[i].success)
+        {
+            fprintf(stderr, "Thread %d failed!\n", i + 1);
+            success = 0;
+            break;
+        }
+        if (jobs[i].encStart < encStart)
+            encStart = jobs[i].encStart;
+        if (jobs[i].encEnd > encEnd)
+            encEnd = jobs[i].encEnd;
+        if (i == 0 || jobs[i].decStart < decStart)
+            decStart = jobs[i].decStart;
+        if (jobs[i].decEnd > decEnd)
+            decEnd = jobs[i].decEnd;
+        encRate[i] = Throughput((double) jobs[i].size * timedRuns,
+                                jobs[i].encEnd - jobs[i].encStart);
+        decRate[i] = Throughput((double) jobs[i].size * timedRuns,
+                                jobs[i].decEnd - jobs[i].decStart);
+        r->decSize += jobs[i].size;
+        r->encSize += jobs[i].encSize;
+        calls += (double) jobs[i].calls * timedRuns;
+    }
+    if (success)
+    {
+        r->encThroughput = Throughput(r->decSize * timedRuns, encEnd - encStart);
+        r->decThroughput = Throughput(r->decSize * timedRuns, decEnd - decStart);
+        r->encCalls = encEnd > encStart ? calls / (encEnd - encStart) : 0.0;
+        r->decCalls = decEnd > decStart ? calls / (decEnd - decStart) : 0.0;
+        ThreadStats(encRate, threads, r->encThread);
+        ThreadStats(decRate, threads, r->decThread);
+    }
+
+    pthread_cond_destroy(&b.barrier.cond);
+    pthread_mutex_destroy(&b.barrier.mutex);
+    free(jobs);
+    return success;
+#else
+    (void) c;
+    (void) data;
+    (void) size;
+    (void) level;
+    (void) fast;
+    (void) warmupRuns;
+    (void) timedRuns;
+    (void) sizes;
+    (void) workload;
+    (void) threads;
+    (void) r;
+    (void) ThreadStats;
+    fprintf(stderr, "Threads are not supported on this system.\n");
+    return 0;
+#endif
+}
+
+/*-- (end of thread scaling benchmark) --------------------------------------*/
+
+
+/* Add the timing of a benchmark to a total (the runs are independent) */
+static void AddTimeStats(time_stats_t *total, const time_stats_t *s)
+{
+    total->count = s->count;
+    total->median += s->median;
+    total->min += s->min;
+    total->max += s->max;
+    total->mean += s->mean;
+    total->stddev = sqrt(total->stddev * total->stddev + s->stddev * s->stddev);
+    total->cycles += s->cycles;
+}
+
+/* Add a benchmark result to a total */
+static void AddResult(bench_result_t *total, const bench_result_t *r)
+{
+    total->decSize += r->decSize;
+    total->encSize += r->encSize;
+    AddTimeStats(&total->encode, &r->encode);
+    AddTimeStats(&total->decode, &r->decode);
+    if (r->encMem > total->encMem)
+        total->encMem = r->encMem;
+    if (r->decMem > total->decMem)
+        total->decMem = r->decMem;
+    AddPerfCounts(&total->encPerf, &r->encPerf);
+    AddPerfCounts(&total->decPerf, &r->decPerf);
+}
+
+
+/*-- Result output ----------------------------------------------------------*/
+
+static void PrintCSVString(FILE *f, const char *str)
+{
+    if (!strpbrk(str, ",\"\r\n"))
+    {
+        fputs(str, f);
+        return;
+    }
+    fputc('"', f);
+    for (; *str; ++str)
+    {
+        if (*str == '"')
+            fputc('"', f);
+        fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+static void PrintJSONString(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+            fprintf(f, "\\%c", *str);
+        else if ((unsigned char) *str < 32)
+            fprintf(f, "\\u%04x", (unsigned char) *str);
+        else
+            fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+static void PrintTimeStats(FILE *f, const char *name, const time_stats_t *s,
+                           double size)
+{
+    fprintf(f, "%s %8.0f us, %8.2f MB/s (best %8.2f MB/s, stddev %5.2f%%",
+            name, 1e6 * s->median, Throughput(size, s->median),
+            Throughput(size, s->min),
+            s->mean > 0.0 ? (100.0 * s->stddev) / s->mean : 0.0);
+    if (s->cycles > 0.0)
+        fprintf(f, ", %6.2f cycles/byte", s->cycles / size);
+    fprintf(f, ")\n");
+}
+
+void BeginOutput(output_t *o)
+{
+    if (o->format == FORMAT_CSV && o->mode == MODE_THREADS)
+        fprintf(o->f, "type,file,codec,level,runs,threads,workload,size,"
+                      "compressed_size,ratio,encode_mbps,encode_thread_min_mbps,"
+                      "encode_thread_mean_mbps,encode_thread_max_mbps,"
+                      "encode_calls_per_sec,encode_efficiency,decode_mbps,"
+                      "decode_thread_min_mbps,decode_thread_mean_mbps,"
+                      "decode_thread_max_mbps,decode_calls_per_sec,"
+                      "decode_efficiency,peak_kb\n");
+    else if (o->format == FORMAT_CSV && o->mode == MODE_MESSAGES)
+        fprintf(o->f, "type,file,codec,level,runs,messages,min_size,max_size,"
+                      "size,compressed_size,ratio,"
+                      "encode_calls_per_sec,encode_mbps,encode_p50_us,"
+                      "encode_p90_us,encode_p99_us,encode_p999_us,"
+                      "encode_max_us,decode_calls_per_sec,decode_mbps,"
+                      "decode_p50_us,decode_p90_us,decode_p99_us,"
+                      "decode_p999_us,decode_max_us\n");
+    else if (o->format == FORMAT_CSV)
+        fprintf(o->f, "type,file,codec,level,runs,size,compressed_size,ratio,"
+                      "encode_mbps,encode_best_mbps,encode_time,"
+                      "encode_time_mean,encode_time_stddev,"
+                      "encode_cycles_per_byte,decode_mbps,decode_best_mbps,"
+                      "decode_time,decode_time_mean,decode_time_stddev,"
+                      "decode_cycles_per_byte,encode_peak_kb,decode_peak_kb,"
+                      "encode_hw_cycles_per_byte,encode_instructions_per_byte,"
+                      "encode_ipc,encode_l1d_misses_per_byte,"
+                      "encode_llc_misses_per_byte,encode_branch_misses_per_byte,"
+                      "encode_dtlb_misses_per_byte,"
+                      "decode_hw_cycles_per_byte,decode_instructions_per_byte,"
+                      "decode_ipc,decode_l1d_misses_per_byte,"
+                      "decode_llc_misses_per_byte,decode_branch_misses_per_byte,"
+                      "decode_dtlb_misses_per_byte\n");
+    else if (o->format == FORMAT_JSON)
+        fprintf(o->f, "{");
+    o->records = -1;
+}
+
+void BeginSection(output_t *o, const char *name)
+{
+    if (o->format == FORMAT_JSON)
+        fprintf(o->f, "%s\n  \"%s\": [", o->records >= 0 ? "," : "", name);
+    o->records = 0;
+}
+
+void EndSection(output_t *o)
+{
+    if (o->format == FORMAT_JSON)
+        fprintf(o->f, "%s]", o->records > 0 ? "\n  " : "");
+}
+
+void EndOutput(output_t *o)
+{
+    if (o->format == FORMAT_JSON)
+        fprintf(o->f, "\n}\n");
+    fflush(o->f);
+}
+
+/* Print a non-negative value, or nothing / null if not available */
+static void PrintOptional(FILE *f, const char *fmt, double x, const char *na)
+{
+    if (x >= 0.0)
+        fprintf(f, fmt, x);
+    else
+        fputs(na, f);
+}
+
+/* Print a non-negative value as an item of a comma separated list */
+static void PrintListItem(FILE *f, const char *fmt, double x, const char **sep)
+{
+    if (x >= 0.0)
+    {
+        fputs(*sep, f);
+        fprintf(f, fmt, x);
+        *sep = ", ";
+    }
+}
+
+/* Print counter values (see BeginOutput for the CSV columns) */
+static void PrintPerfCounts(output_t *o, const char *name,
+                            const perf_counts_t *c, double bytes)
+{
+    FILE *f = o->f;
+    if (o->format == FORMAT_CSV)
+    {
+        PrintOptional(f, ",%.3f", PerfPerByte(c, PERF_CYCLES, bytes), ",");
+        PrintOptional(f, ",%.3f", PerfPerByte(c, PERF_INSTRUCTIONS, bytes), ",");
+        PrintOptional(f, ",%.3f", PerfIPC(c), ",");
+        PrintOptional(f, ",%.5f", PerfPerByte(c, PERF_L1D_MISSES, bytes), ",");
+        PrintOptional(f, ",%.5f", PerfPerByte(c, PERF_LLC_MISSES, bytes), ",");
+        PrintOptional(f, ",%.5f", PerfPerByte(c, PERF_BRANCH_MISSES, bytes), ",");
+        PrintOptional(f, ",%.5f", PerfPerByte(c, PERF_DTLB_MISSES, bytes), ",");
+    }
+    else if (o->format == FORMAT_JSON)
+    {
+        fprintf(f, ",\n      \"counters\": {\"cycles_per_byte\": ");
+        PrintOptional(f, "%.3f", PerfPerByte(c, PERF_CYCLES, bytes), "null");
+        fprintf(f, ", \"instructions_per_byte\": ");
+        PrintOptional(f, "%.3f", PerfPerByte(c, PERF_INSTRUCTIONS, bytes), "null");
+        fprintf(f, ", \"ipc\": ");
+        PrintOptional(f, "%.3f", PerfIPC(c), "null");
+        fprintf(f, ", \"l1d_misses_per_byte\": ");
+        PrintOptional(f, "%.5f", PerfPerByte(c, PERF_L1D_MISSES, bytes), "null");
+        fprintf(f, ", \"llc_misses_per_byte\": ");
+        PrintOptional(f, "%.5f", PerfPerByte(c, PERF_LLC_MISSES, bytes), "null");
+        fprintf(f, ", \"branch_misses_per_byte\": ");
+        PrintOptional(f, "%.5f", PerfPerByte(c, PERF_BRANCH_MISSES, bytes), "null");
+        fprintf(f, ", \"dtlb_misses_per_byte\": ");
+        PrintOptional(f, "%.5f", PerfPerByte(c, PERF_DTLB_MISSES, bytes), "null");
+        fprintf(f, "}");
+    }
+    else
+    {
+        const char *sep = " ";
+        fprintf(f, "%s", name);
+        PrintListItem(f, "%6.2f cycles/byte", PerfPerByte(c, PERF_CYCLES, bytes), &sep);
+        PrintListItem(f, "%6.2f instr/byte", PerfPerByte(c, PERF_INSTRUCTIONS, bytes), &sep);
+        PrintListItem(f, "IPC %4.2f", PerfIPC(c), &sep);
+        PrintListItem(f, "L1d miss %.4f/byte", PerfPerByte(c, PERF_L1D_MISSES, bytes), &sep);
+        PrintListItem(f, "LLC miss %.4f/byte", PerfPerByte(c, PERF_LLC_MISSES, bytes), &sep);
+        PrintListItem(f, "branch miss %.4f/byte", PerfPerByte(c, PERF_BRANCH_MISSES, bytes), &sep);
+        PrintListItem(f, "dTLB miss %.4f/byte", PerfPerByte(c, PERF_DTLB_MISSES, bytes), &sep);
+        fprintf(f, "\n");
+    }
+}
+
+/* Check if any counter is available */
+static int HasPerfCounts(const perf_counts_t *c)
+{
+    int i;
+    for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+        if (c->count[i] >= 0.0)
+            return 1;
+    }
+    return 0;
+}
+
+/* Print the result of a benchmark. For aggregate results (totals), name is
+   NULL and files is the number of files. */
+void PrintResult(output_t *o, const char *name, int files, const codec_t *c,
+                 int level, const bench_result_t *r)
+{
+    FILE *f = o->f;
+    double ratio = r->encSize > 0.0 ? r->decSize / r->encSize : 0.0;
+
+    if (o->format == FORMAT_CSV)
+    {
+        fprintf(f, "%s,", name ? "file" : "total");
+        if (name)
+            PrintCSVString(f, name);
+        else
+            fprintf(f, "%d files", files);
+        fprintf(f, ",%s,%d,%d,%.0f,%.0f,%.4f,", c->name, level,
+                r->encode.count, r->decSize, r->encSize, ratio);
+        fprintf(f, "%.3f,%.3f,%.9f,%.9f,%.9f,%.3f,",
+                Throughput(r->decSize, r->encode.median),
+                Throughput(r->decSize, r->encode.min), r->encode.median,
+                r->encode.mean, r->encode.stddev, r->encode.cycles / r->decSize);
+        fprintf(f, "%.3f,%.3f,%.9f,%.9f,%.9f,%.3f,",
+                Throughput(r->decSize, r->decode.median),
+                Throughput(r->decSize, r->decode.min), r->decode.median,
+                r->decode.mean, r->decode.stddev, r->decode.cycles / r->decSize);
+        fprintf(f, "%ld,%ld", r->encMem, r->decMem);
+        PrintPerfCounts(o, NULL, &r->encPerf, r->decSize);
+        PrintPerfCounts(o, NULL, &r->decPerf, r->decSize);
+        fprintf(f, "\n");
+    }
+    else if (o->format == FORMAT_JSON)
+    {
+        fprintf(f, "%s\n    {", o->records > 0 ? "," : "");
+        if (name)
+        {
+            fprintf(f, "\"file\": ");
+            PrintJSONString(f, name);
+        }
+        else
+            fprintf(f, "\"files\": %d", files);
+        fprintf(f, ", \"codec\": \"%s\", \"level\": %d, \"runs\": %d,"
+                   " \"size\": %.0f, \"compressed_size\": %.0f, \"ratio\": %.4f,",
+                c->name, level, r->encode.count, r->decSize, r->encSize, ratio);
+        fprintf(f, "\n     \"encode\": {\"mbps\": %.3f, \"best_mbps\": %.3f,"
+                   " \"time\": %.9f, \"time_mean\": %.9f, \"time_stddev\": %.9f,"
+                   " \"cycles_per_byte\": %.3f, \"peak_kb\": %ld",
+                Throughput(r->decSize, r->encode.median),
+                Throughput(r->decSize, r->encode.min), r->encode.median,
+                r->encode.mean, r->encode.stddev,
+                r->encode.cycles / r->decSize, r->encMem);
+        if (HasPerfCounts(&r->encPerf))
+            PrintPerfCounts(o, NULL, &r->encPerf, r->decSize);
+        fprintf(f, "},");
+        fprintf(f, "\n     \"decode\": {\"mbps\": %.3f, \"best_mbps\": %.3f,"
+                   " \"time\": %.9f, \"time_mean\": %.9f, \"time_stddev\": %.9f,"
+                   " \"cycles_per_byte\": %.3f, \"peak_kb\": %ld",
+                Throughput(r->decSize, r->decode.median),
+                Throughput(r->decSize, r->decode.min), r->decode.median,
+                r->decode.mean, r->decode.stddev,
+                r->decode.cycles / r->decSize, r->decMem);
+        if (HasPerfCounts(&r->decPerf))
+            PrintPerfCounts(o, NULL, &r->decPerf, r->decSize);
+        fprintf(f, "}}");
+    }
+    else
+    {
+        if (o->titles)
+        {
+            if (name)
+                fprintf(f, "\n%s (%s -%d):\n", name, c->name, level);
+            else
+                fprintf(f, "\nTotal, %d files (%s -%d):\n", files, c->name,
+                        level);
+        }
+        PrintTimeStats(f, "Compression:  ", &r->encode, r->decSize);
+        PrintTimeStats(f, "Decompression:", &r->decode, r->decSize);
+        fprintf(f, "Sizes: %.0f => %.0f bytes, %d%%\n", r->decSize, r->encSize,
+                (int) ((100.0 * r->encSize) / r->decSize));
+        if (r->encMem >= 0 && r->decMem >= 0)
+            fprintf(f, "Peak memory: %ld KB (compression), %ld KB "
+                       "(decompression)\n", r->encMem, r->decMem);
+        if (HasPerfCounts(&r->encPerf))
+            PrintPerfCounts(o, "Compression counters:  ", &r->encPerf, r->decSize);
+        if (HasPerfCounts(&r->decPerf))
+            PrintPerfCounts(o, "Decompression counters:", &r->decPerf, r->decSize);
+    }
+    ++o->records;
+}
+
+static void PrintLatencyStats(output_t *o, const char *name,
+                              const latency_stats_t *s)
+{
+    FILE *f = o->f;
+    if (o->format == FORMAT_CSV)
+        fprintf(f, ",%.1f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f", s->callsPerSec,
+                s->throughput, 1e6 * s->p50, 1e6 * s->p90, 1e6 * s->p99,
+                1e6 * s->p999, 1e6 * s->max);
+    else if (o->format == FORMAT_JSON)
+        fprintf(f, "\n     \"%s\": {\"calls_per_sec\": %.1f, \"mbps\": %.3f,"
+                   " \"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f,"
+                   " \"p999_us\": %.3f, \"max_us\": %.3f}", name,
+                s->callsPerSec, s->throughput, 1e6 * s->p50, 1e6 * s->p90,
+                1e6 * s->p99, 1e6 * s->p999, 1e6 * s->max);
+    else
+        fprintf(f, "%s p50 %8.2f us, p90 %8.2f us, p99 %8.2f us, p99.9 %8.2f us"
+                   " (%.0f calls/s, %.2f MB/s)\n", name, 1e6 * s->p50,
+                1e6 * s->p90, 1e6 * s->p99, 1e6 * s->p999, s->callsPerSec,
+                s->throughput);
+}
+
+/* Print the result of a small message benchmark */
+void PrintMessageResult(output_t *o, const char *name, const codec_t *c,
+                        int level, const msg_sizes_t *sizes,
+                        const msg_result_t *r)
+{
+    FILE *f = o->f;
+    double ratio = r->encSize > 0.0 ? r->decSize / r->encSize : 0.0;
+
+    if (o->format == FORMAT_CSV)
+    {
+        fprintf(f, "file,");
+        PrintCSVString(f, name);
+        fprintf(f, ",%s,%d,%d,%d,%u,%u,%.0f,%.0f,%.4f", c->name, level,
+                r->runs, r->messages, sizes->minSize, sizes->maxSize,
+                r->decSize, r->encSize, ratio);
+        PrintLatencyStats(o, NULL, &r->encode);
+        PrintLatencyStats(o, NULL, &r->decode);
+        fprintf(f, "\n");
+    }
+    else if (o->format == FORMAT_JSON)
+    {
+        fprintf(f, "%s\n    {\"file\": ", o->records > 0 ? "," : "");
+        PrintJSONString(f, name);
+        fprintf(f, ", \"codec\": \"%s\", \"level\": %d, \"runs\": %d,"
+                   " \"messages\": %d, \"min_size\": %u, \"max_size\": %u,"
+                   " \"size\": %.0f, \"compressed_size\": %.0f, \"ratio\": %.4f,",
+                c->name, level, r->runs, r->messages, sizes->minSize,
+                sizes->maxSize, r->decSize, r->encSize, ratio);
+        PrintLatencyStats(o, "encode", &r->encode);
+        fprintf(f, ",");
+        PrintLatencyStats(o, "decode", &r->decode);
+        fprintf(f, "}");
+    }
+    else
+    {
+        fprintf(f, "%s%s (%s -%d), %d messages of %u-%u bytes:\n",
+                o->records > 0 ? "\n" : "", name, c->name, level, r->messages,
+                sizes->minSize, sizes->maxSize);
+        PrintLatencyStats(o, "Compression:  ", &r->encode);
+        PrintLatencyStats(o, "Decompression:", &r->decode);
+        fprintf(f, "Sizes: %.0f => %.0f bytes, %d%%\n", r->decSize, r->encSize,
+                (int) ((100.0 * r->encSize) / r->decSize));
+    }
+    ++o->records;
+}
+
+
+/* Print the result of a thread scaling benchmark */
+void PrintThreadResult(output_t *o, const char *name, const codec_t *c,
+                       int level, int workload, const thread_result_t *r)
+{
+    static const char *WORKLOADS[] = { "full", "split" };
+    FILE *f = o->f;
+    double ratio = r->encSize > 0.0 ? r->decSize / r->encSize : 0.0;
+
+    if (o->format == FORMAT_CSV)
+    {
+        fprintf(f, "file,");
+        PrintCSVString(f, name);
+        fprintf(f, ",%s,%d,%d,%d,%s,%.0f,%.0f,%.4f", c->name, level,
+                r->runs, r->threads, WORKLOADS[workload], r->decSize, r->encSize,
+                ratio);
+        fprintf(f, ",%.3f,%.3f,%.3f,%.3f,%.1f,%.4f", r->encThroughput,
+                r->encThread[0], r->encThread[1], r->encThread[2],
+                r->encCalls, r->encEfficiency);
+        fprintf(f, ",%.3f,%.3f,%.3f,%.3f,%.1f,%.4f,%ld\n", r->decThroughput,
+                r->decThread[0], r->decThread[1], r->decThread[2],
+                r->decCalls, r->decEfficiency, r->peakMem);
+    }
+    else if (o->format == FORMAT_JSON)
+    {
+        fprintf(f, "%s\n    {\"file\": ", o->records > 0 ? "," : "");
+        PrintJSONString(f, name);
+        fprintf(f, ", \"codec\": \"%s\", \"level\": %d, \"runs\": %d,"
+                   " \"threads\": %d, \"workload\": \"%s\", \"size\": %.0f,"
+                   " \"compressed_size\": %.0f, \"ratio\": %.4f,"
+                   " \"peak_kb\": %ld,", c->name, level, r->runs, r->threads,
+                WORKLOADS[workload], r->decSize, r->encSize, ratio, r->peakMem);
+        fprintf(f, "\n     \"encode\": {\"mbps\": %.3f, \"thread_min_mbps\": %.3f,"
+                   " \"thread_mean_mbps\": %.3f, \"thread_max_mbps\": %.3f,"
+                   " \"calls_per_sec\": %.1f, \"efficiency\": %.4f},",
+                r->encThroughput, r->encThread[0], r->encThread[1],
+                r->encThread[2], r->encCalls, r->encEfficiency);
+        fprintf(f, "\n     \"decode\": {\"mbps\": %.3f, \"thread_min_mbps\": %.3f,"
+                   " \"thread_mean_mbps\": %.3f, \"thread_max_mbps\": %.3f,"
+                   " \"calls_per_sec\": %.1f, \"efficiency\": %.4f}}",
+                r->decThroughput, r->decThread[0], r->decThread[1],
+                r->decThread[2], r->decCalls, r->decEfficiency);
+    }
+    else
+    {
+        fprintf(f, "%s%s (%s -%d), %d thread%s (%s):\n",
+                o->records > 0 ? "\n" : "", name, c->name, level, r->threads,
+                r->threads == 1 ? "" : "s", WORKLOADS[workload]);
+        fprintf(f, "Compression:   %8.2f MB/s (per thread %.2f-%.2f MB/s, "
+                   "%.0f calls/s, efficiency %.0f%%)\n", r->encThroughput,
+                r->encThread[0], r->encThread[2], r->encCalls,
+                100.0 * r->encEfficiency);
+        fprintf(f, "Decompression: %8.2f MB/s (per thread %.2f-%.2f MB/s, "
+                   "%.0f calls/s, efficiency %.0f%%)\n", r->decThroughput,
+                r->decThread[0], r->decThread[2], r->decCalls,
+                100.0 * r->decEfficiency);
+        if (r->peakMem >= 0)
+            fprintf(f, "Peak memory: %ld KB\n", r->peakMem);
+    }
+    ++o->records;
+}
+
+/*-- (end of result output) -------------------------------------------------*/
+
+
+/*-- Baseline comparison ----------------------------------------------------*/
+
+/* A result from a baseline results file */
+typedef struct {
+    char          *file;        /* File name (NULL for totals) */
+    char           codec[16];
+    int            level;
+    bench_result_t result;
+} baseline_entry_t;
+
+/* Baseline results, and the comparison state */
+typedef struct {
+    baseline_entry_t *entries;
+    int               count;
+    double            threshold;    /* Regression threshold (percent) */
+    int               compared;     /* Number of compared results */
+    int               regressions;  /* Number of regressions */
+} baseline_t;
+
+/* Columns that are used from a results file (see BeginOutput) */
+static const char *BASELINE_COLUMNS[] = {
+    "type", "file", "codec", "level", "runs", "size", "compressed_size",
+    "encode_time", "encode_time_mean", "encode_time_stddev",
+    "decode_time", "decode_time_mean", "decode_time_stddev"
+};
+#define NUM_BASELINE_COLUMNS \
+    ((int) (sizeof(BASELINE_COLUMNS) / sizeof(BASELINE_COLUMNS[0])))
+#define MAX_CSV_FIELDS 64
+
+/* Optional columns (counters, that are compared if they are available) */
+static const char *BASELINE_DTLB_COLUMNS[2] = {
+    "encode_dtlb_misses_per_byte", "decode_dtlb_misses_per_byte"
+};
+
+/* Split a CSV line into fields (in place). Returns the number of fields. */
+static int SplitCSVLine(char *line, char **fields, int maxFields)
+{
+    char *src = line, *dst;
+    int count = 0;
+
+    while (count < maxFields)
+    {
+        fields[count++] = dst = src;
+        if (*src == '"')
+        {
+            // Quoted field ("" = ")
+            ++src;
+            while (*src && !(src[0] == '"' && src[1] != '"'))
+            {
+                if (*src == '"')
+                    ++src;
+                *dst++ = *src++;
+            }
+            if (*src == '"')
+                ++src;
+        }
+        while (*src && *src != ',' && *src != '\r' && *src != '\n')
+            *dst++ = *src++;
+        if (*src != ',')
+        {
+            *dst = 0;
+            break;
+        }
+        *dst = 0;
+        ++src;
+    }
+    return count;
+}
+
+void FreeBaseline(baseline_t *b)
+{
+    int i;
+    for (i = 0; i < b->count; ++i)
+        free(b->entries[i].file);
+    free(b->entries);
+    b->entries = NULL;
+    b->count = 0;
+}
+
+/* Find a column in a CSV header (-1 if not found) */
+static int FindCSVColumn(char **fields, int numFields, const char *name)
+{
+    int i;
+    for (i = 0; i < numFields; ++i)
+    {
+        if (strcmp(fields[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/* Load a results file (CSV) that was saved by a previous run. Returns non-zero
+   on success. */
+int LoadBaseline(const char *name, baseline_t *b)
+{
+    FILE *f;
+    char line[8192], *fields[MAX_CSV_FIELDS];
+    int col[NUM_BASELINE_COLUMNS], dtlbCol[2], numFields, capacity = 0, i;
+    baseline_entry_t *e;
+
+    b->entries = NULL;
+    b->count = 0;
+
+    f = fopen(name, "r");
+    if (!f)
+    {
+        fprintf(stderr, "Unable to open file \"%s\".\n", name);
+        return 0;
+    }
+
+    // Find the columns in the header
+    numFields = 0;
+    if (fgets(line, sizeof(line), f))
+        numFields = SplitCSVLine(line, fields, MAX_CSV_FIELDS);
+    for (i = 0; i < NUM_BASELINE_COLUMNS; ++i)
+    {
+        col[i] = FindCSVColumn(fields, numFields, BASELINE_COLUMNS[i]);
+        if (col[i] < 0)
+        {
+            fprintf(stderr, "\"%s\" is not a benchmark results file.\n", name);
+            fclose(f);
+            return 0;
+        }
+    }
+    for (i = 0; i < 2; ++i)
+        dtlbCol[i] = FindCSVColumn(fields, numFields, BASELINE_DTLB_COLUMNS[i]);
+
+    // Read the results
+    while (fgets(line, sizeof(line), f))
+    {
+        numFields = SplitCSVLine(line, fields, MAX_CSV_FIELDS);
+        if (numFields < NUM_BASELINE_COLUMNS)
+            continue;
+        if (b->count >= capacity)
+        {
+            capacity = capacity ? 2 * capacity : 64;
+            e = (baseline_entry_t*) realloc(b->entries,
+                                            capacity * sizeof(baseline_entry_t));
+            if (!e)
+            {
+                fprintf(stderr, "Out of memory!\n");
+                fclose(f);
+                FreeBaseline(b);
+                return 0;
+            }
+            b->entries = e;
+        }
+        e = &b->entries[b->count];
+        memset(e, 0, sizeof(baseline_entry_t));
+        if (strcmp(fields[col[0]], "file") == 0)
+        {
+            e->file = (char*) malloc(strlen(fields[col[1]]) + 1);
+            if (!e->file)
+                continue;
+            strcpy(e->file, fields[col[1]]);
+        }
+        strncpy(e->codec, fields[col[2]], sizeof(e->codec) - 1);
+        e->level = atoi(fields[col[3]]);
+        e->result.encode.count = e->result.decode.count = atoi(fields[col[4]]);
+        e->result.decSize = atof(fields[col[5]]);
+        e->result.encSize = atof(fields[col[6]]);
+        e->result.encode.median = atof(fields[col[7]]);
+        e->result.encode.mean = atof(fields[col[8]]);
+        e->result.encode.stddev = atof(fields[col[9]]);
+        e->result.decode.median = atof(fields[col[10]]);
+        e->result.decode.mean = atof(fields[col[11]]);
+        e->result.decode.stddev = atof(fields[col[12]]);
+        ClearPerfCounts(&e->result.encPerf);
+        ClearPerfCounts(&e->result.decPerf);
+        if ((dtlbCol[0] >= 0) && (dtlbCol[0] < numFields) &&
+            fields[dtlbCol[0]][0])
+            e->result.encPerf.count[PERF_DTLB_MISSES] =
+                atof(fields[dtlbCol[0]]) * e->result.decSize;
+        if ((dtlbCol[1] >= 0) && (dtlbCol[1] < numFields) &&
+            fields[dtlbCol[1]][0])
+            e->result.decPerf.count[PERF_DTLB_MISSES] =
+                atof(fields[dtlbCol[1]]) * e->result.decSize;
+        ++b->count;
+    }
+
+    fclose(f);
+    return 1;
+}
+
+static const bench_result_t *FindBaseline(const baseline_t *b, const char *name,
+                                          const codec_t *c, int level)
+{
+    int i;
+    for (i = 0; i < b->count; ++i)
+    {
+        const baseline_entry_t *e = &b->entries[i];
+        if ((e->level == level) && (strcmp(e->codec, c->name) == 0) &&
+            (name ? (e->file && strcmp(e->file, name) == 0) : !e->file))
+            return &e->result;
+    }
+    return NULL;
+}
+
+/* Two-sided 95% quantile of Student's t distribution */
+static double TQuantile95(double df)
+{
+    static const double t[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    int i = (int) df;
+    if (i < 1)
+        i = 1;
+    return i <= 30 ? t[i - 1] : 1.960;
+}
+
+/* Relative throughput change (percent) of s compared to base, with a 95%
+   confidence interval (Welch's t-test on the mean times) */
+static double ThroughputChange(const time_stats_t *base, const time_stats_t *s,
+                               double *lo, double *hi)
+{
+    double va, vb, se, df, d, t, slow, fast;
+
+    va = base->count > 0 ? base->stddev * base->stddev / base->count : 0.0;
+    vb = s->count > 0 ? s->stddev * s->stddev / s->count : 0.0;
+    se = sqrt(va + vb);
+    df = 1.0;
+    if ((base->count > 1) && (s->count > 1) && (se > 0.0))
+        df = (va + vb) * (va + vb) /
+             (va * va / (base->count - 1) + vb * vb / (s->count - 1));
+    t = TQuantile95(df);
+
+    // Interval of the mean time, expressed as a throughput change
+    d = s->mean - base->mean;
+    slow = base->mean + d + t * se;
+    fast = base->mean + d - t * se;
+    *lo = slow > 0.0 ? 100.0 * (base->mean / slow - 1.0) : -100.0;
+    *hi = fast > 0.0 ? 100.0 * (base->mean / fast - 1.0) : HUGE_VAL;
+
+    return s->median > 0.0 ? 100.0 * (base->median / s->median - 1.0) : 0.0;
+}
+
+/* Relative change (percent) of a counter (sets *valid to zero if the counter
+   is not available in both results) */
+static double CounterChange(const perf_counts_t *base, const perf_counts_t *c,
+                            int counter, int *valid)
+{
+    *valid = (base->count[counter] > 0.0) && (c->count[counter] >= 0.0);
+    return *valid ? 100.0 * (c->count[counter] / base->count[counter] - 1.0) :
+                    0.0;
+}
+
+/* Compare a result with the baseline, and print the differences */
+void CompareResult(FILE *f, baseline_t *b, const char *name, int files,
+                   const codec_t *c, int level, const bench_result_t *r)
+{
+    const bench_result_t *base;
+    double encChange, encLo, encHi, decChange, decLo, decHi, tlbChange;
+    int encRegression, decRegression, valid;
+
+    if (name)
+        fprintf(f, "%s (%s -%d): ", name, c->name, level);
+    else
+        fprintf(f, "Total, %d files (%s -%d): ", files, c->name, level);
+    base = FindBaseline(b, name, c, level);
+    if (!base || (base->decSize != r->decSize))
+    {
+        fprintf(f, "%s\n", base ? "different file size" : "not in baseline");
+        return;
+    }
+
+    encChange = ThroughputChange(&base->encode, &r->encode, &encLo, &encHi);
+    decChange = ThroughputChange(&base->decode, &r->decode, &decLo, &decHi);
+
+    // A regression must exceed the threshold, and be significant
+    encRegression = (encChange < -b->threshold) && (encHi < 0.0);
+    decRegression = (decChange < -b->threshold) && (decHi < 0.0);
+
+    fprintf(f, "size %+.2f%%, compression %+.1f%% [%+.1f%%, %+.1f%%], "
+               "decompression %+.1f%% [%+.1f%%, %+.1f%%]",
+            base->encSize > 0.0 ? 100.0 * (r->encSize / base->encSize - 1.0) : 0.0,
+            encChange, encLo, encHi, decChange, decLo, decHi);
+
+    // Change of the dTLB misses (if both runs used -perf)
+    tlbChange = CounterChange(&base->encPerf, &r->encPerf, PERF_DTLB_MISSES,
+                              &valid);
+    if (valid)
+        fprintf(f, ", compression dTLB misses %+.1f%%", tlbChange);
+    tlbChange = CounterChange(&base->decPerf, &r->decPerf, PERF_DTLB_MISSES,
+                              &valid);
+    if (valid)
+        fprintf(f, ", decompression dTLB misses %+.1f%%", tlbChange);
+    fprintf(f, "%s\n", (encRegression || decRegression) ? "  <-- REGRESSION" : "");
+
+    ++b->compared;
+    if (encRegression || decRegression)
+        ++b->regressions;
+}
+
+/*-- (end of baseline comparison) -------------------------------------------*/
+
+
+/* Add a codec at one or all of its levels to the benchmark configurations */
+static int AddConfigs(bench_config_t *configs, int count, const codec_t *c,
+                      int level, int allLevels)
+{
+    const int *l;
+    for (l = allLevels ? c->levels : &level; *l && count < MAX_CONFIGS; ++l)
+    {
+        memset(&configs[count], 0, sizeof(bench_config_t));
+        configs[count].codec = *c;
+        configs[count].level = *l;
+        configs[count].total.encMem = configs[count].total.decMem = -1;
+        ++count;
+        if (!allLevels)
+            break;
+    }
+    return count;
+}
+
+/* Get all available codecs */
+static int GetAllCodecs(codec_t *codecs)
+{
+    int count = 0;
+    InitCodecLZG(&codecs[count++]);
+#ifdef USE_ZLIB
+    InitCodecZLIB(&codecs[count++]);
+#endif
+#ifdef USE_BZ2
+    InitCodecBZ2(&codecs[count++]);
+#endif
+#ifdef USE_LZO
+    InitCodecLZO(&codecs[count++]);
+#endif
+    InitCodecMEMCPY(&codecs[count++]);
+    return count;
+}
+
+int main(int argc, char **argv)
+{
+    char *outName, *saveName, *baseName;
+    unsigned char *data;
+    unsigned int size = 0;
+    int arg, level, fast, verbose, warmupRuns, timedRuns, cpu, pin;
+    unsigned int seed;
+    int usePerf, msgMode;
+    msg_sizes_t msgSizes;
+    msg_result_t msgResult;
+    int threads, workload, mode;
+    thread_result_t threadResult, singleResult;
+    int allCodecs, allLevels, numCodecs, numConfigs, i, j, success;
+    size_t k;
+    LZGPROGRESSFUN progressfun = 0;
+    file_list_t files, synth;
+    codec_t codecs[8];
+    bench_config_t *configs = NULL;
+    bench_result_t *results = NULL, *r;
+    output_t out, save;
+    perf_counters_t perf;
+    baseline_t baseline;
+    FILE *report;
+
+    // Default arguments
+    outName = NULL;
+    saveName = NULL;
+    baseName = NULL;
+    level = 5;
+    verbose = 0;
+    fast = 1;
+    warmupRuns = DEFAULT_WARMUP_RUNS;
+    timedRuns = DEFAULT_TIMED_RUNS;
+    cpu = -1;
+    pin = 1;
+    allCodecs = 0;
+    allLevels = 0;
+    numCodecs = 0;
+    out.format = FORMAT_TEXT;
+    out.f = save.f = NULL;
+    save.format = FORMAT_CSV;
+    baseline.entries = NULL;
+    baseline.count = 0;
+    baseline.threshold = DEFAULT_THRESHOLD;
+    baseline.compared = baseline.regressions = 0;
+    success = 1;
+    seed = 1;
+    usePerf = 0;
+    msgMode = 0;
+    threads = 0;
+    workload = WORKLOAD_FULL;
+    InitFileList(&files);
+    InitFileList(&synth);
+
+    // Get arguments
+    for (arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp("-1", argv[arg]) == 0)
+            level = 1;
+        else if (strcmp("-2", argv[arg]) == 0)
+            level = 2;
+        else if (strcmp("-3", argv[arg]) == 0)
+            level = 3;
+        else if (strcmp("-4", argv[arg]) == 0)
+            level = 4;
+        else if (strcmp("-5", argv[arg]) == 0)
+            level = 5;
+        else if (strcmp("-6", argv[arg]) == 0)
+            level = 6;
+        else if (strcmp("-7", argv[arg]) == 0)
+            level = 7;
+        else if (strcmp("-8", argv[arg]) == 0)
+            level = 8;
+        else if (strcmp("-9", argv[arg]) == 0)
+            level = 9;
+        else if (strcmp("-v", argv[arg]) == 0)
+            verbose = 1;
+        else if (strcmp("-m", argv[arg]) == 0)
+            timedRuns = 10;
+        else if ((strcmp("-n", argv[arg]) == 0) && (arg + 1 < argc))
+            timedRuns = atoi(argv[++arg]);
+        else if ((strcmp("-w", argv[arg]) == 0) && (arg + 1 < argc))
+            warmupRuns = atoi(argv[++arg]);
+        else if ((strcmp("-cpu", argv[arg]) == 0) && (arg + 1 < argc))
+            cpu = atoi(argv[++arg]);
+        else if (strcmp("-nopin", argv[arg]) == 0)
+            pin = 0;
+        else if (strcmp("-perf", argv[arg]) == 0)
+            usePerf = 1;
+        else if ((strcmp("-threads", argv[arg]) == 0) && (arg + 1 < argc))
+            threads = atoi(argv[++arg]);
+        else if (strcmp("-split", argv[arg]) == 0)
+            workload = WORKLOAD_SPLIT;
+        else if ((strcmp("-msg", argv[arg]) == 0) && (arg + 1 < argc))
+        {
+            msgMode = 1;
+            if (!ParseMessageSizes(argv[++arg], &msgSizes))
+            {
+                fprintf(stderr, "Invalid message size \"%s\".\n", argv[arg]);
+                success = 0;
+            }
+        }
+        else if (strcmp("-s", argv[arg]) == 0)
+            fast = 0;
+        else if (strcmp("-hugepages", argv[arg]) == 0)
+            lzgHugePages = 1;
+        else if (strcmp("-trusted", argv[arg]) == 0)
+            lzgTrusted = 1;
+        else if (strcmp("-lzg", argv[arg]) == 0)
+            InitCodecLZG(&codecs[numCodecs++]);
+#ifdef USE_ZLIB
+        else if (strcmp("-zlib", argv[arg]) == 0)
+            InitCodecZLIB(&codecs[numCodecs++]);
+#endif
+#ifdef USE_BZ2
+        else if (strcmp("-bz2", argv[arg]) == 0)
+            InitCodecBZ2(&codecs[numCodecs++]);
+#endif
+#ifdef USE_LZO
+        else if (strcmp("-lzo", argv[arg]) == 0)
+            InitCodecLZO(&codecs[numCodecs++]);
+#endif
+        else if (strcmp("-memcpy", argv[arg]) == 0)
+            InitCodecMEMCPY(&codecs[numCodecs++]);
+        else if (strcmp("-levels", argv[arg]) == 0)
+            allLevels = 1;
+        else if (strcmp("-all", argv[arg]) == 0)
+            allCodecs = allLevels = 1;
+        else if (strcmp("-csv", argv[arg]) == 0)
+            out.format = FORMAT_CSV;
+        else if (strcmp("-json", argv[arg]) == 0)
+            out.format = FORMAT_JSON;
+        else if ((strcmp("-synth", argv[arg]) == 0) && (arg + 1 < argc))
+        {
+            if (!AddFile(&synth, argv[++arg]))
+                success = 0;
+        }
+        else if ((strcmp("-seed", argv[arg]) == 0) && (arg + 1 < argc))
+            seed = (unsigned int) strtoul(argv[++arg], NULL, 10);
+        else if ((strcmp("-o", argv[arg]) == 0) && (arg + 1 < argc))
+            outName = argv[++arg];
+        else if ((strcmp("-save", argv[arg]) == 0) && (arg + 1 < argc))
+            saveName = argv[++arg];
+        else if ((strcmp("-compare", argv[arg]) == 0) && (arg + 1 < argc))
+            baseName = argv[++arg];
+        else if ((strcmp("-threshold", argv[arg]) == 0) && (arg + 1 < argc))
+            baseline.threshold = atof(argv[++arg]);
+        else if (argv[arg][0] == '-')
+        {
+            ShowUsage(argv[0]);
+            FreeFileList(&files);
+            return 1;
+        }
+        else
+        {
+            // Input file, directory or file list
+            if (argv[arg][0] == '@')
+                success = AddFileList(&files, &argv[arg][1]);
+            else if (IsRegularFile(argv[arg]))
+                success = AddFile(&files, argv[arg]);
+            else
+                success = AddDirectory(&files, argv[arg], NULL);
+            if (!success)
+            {
+                FreeFileList(&files);
+                return 1;
+            }
+        }
+
+        // Too many codecs?
+        if (numCodecs >= (int) (sizeof(codecs) / sizeof(codecs[0])))
+            numCodecs = (int) (sizeof(codecs) / sizeof(codecs[0])) - 1;
+    }
+
+    // Synthetic inputs
+    for (k = 0; success && k < synth.count; ++k)
+        success = AddSynthetic(&files, synth.names[k], seed);
+    FreeFileList(&synth);
+    if (!success)
+    {
+        FreeFileList(&files);
+        return 1;
+    }
+
+    if ((files.count == 0) || (timedRuns < 1) || (warmupRuns < 0))
+    {
+        ShowUsage(argv[0]);
+        FreeFileList(&files);
+        return 1;
+    }
+
+    mode = threads > 0 ? MODE_THREADS : (msgMode ? MODE_MESSAGES : MODE_BULK);
+    if ((mode != MODE_BULK) && (baseName || usePerf))
+    {
+        fprintf(stderr, "-msg and -threads can not be combined with -compare or "
+                        "-perf.\n");
+        FreeFileList(&files);
+        return 1;
+    }
+    if (threads > MAX_THREADS)
+    {
+        fprintf(stderr, "Too many threads (max %d).\n", MAX_THREADS);
+        FreeFileList(&files);
+        return 1;
+    }
+    msgSizes.seed = seed;
+
+    // Load the baseline results
+    if (baseName && !LoadBaseline(baseName, &baseline))
+    {
+        FreeFileList(&files);
+        return 1;
+    }
+
+    // Set up the codec / level combinations to benchmark
+    if (allCodecs)
+        numCodecs = GetAllCodecs(codecs);
+    else if (numCodecs == 0)
+        InitCodecLZG(&codecs[numCodecs++]);
+    configs = (bench_config_t*) malloc(sizeof(bench_config_t) * MAX_CONFIGS);
+    results = (bench_result_t*) calloc(files.count * MAX_CONFIGS,
+                                       sizeof(bench_result_t));
+    if (!configs || !results)
+    {
+        fprintf(stderr, "Out of memory!\n");
+        success = 0;
+        goto done;
+    }
+    numConfigs = 0;
+    for (i = 0; i < numCodecs; ++i)
+        numConfigs = AddConfigs(configs, numConfigs, &codecs[i], level,
+                                allLevels);
+
+    // Open the output files
+    out.f = outName ? fopen(outName, "w") : stdout;
+    if (!out.f)
+    {
+        fprintf(stderr, "Unable to create file \"%s\".\n", outName);
+        success = 0;
+        goto done;
+    }
+    out.titles = (files.count > 1) || (numConfigs > 1);
+    out.mode = save.mode = mode;
+    if (saveName && !(save.f = fopen(saveName, "w")))
+    {
+        fprintf(stderr, "Unable to create file \"%s\".\n", saveName);
+        success = 0;
+        goto done;
+    }
+    save.titles = 0;
+
+    // Pin the benchmark to a single CPU (avoids migrations between cores).
+    // In thread scaling mode, the threads would inherit the affinity.
+    if (pin && (mode != MODE_THREADS))
+    {
+        cpu = PinToCPU(cpu);
+        if (verbose)
+        {
+            if (cpu >= 0)
+                fprintf(stderr, "Running on CPU %d\n", cpu);
+            else
+                fprintf(stderr, "Unable to pin the benchmark to a CPU\n");
+        }
+    }
+    if (verbose)
+        progressfun = ShowProgress;
+
+    // Open the hardware performance counters (after pinning the thread)
+    if (usePerf && !OpenPerfCounters(&perf))
+    {
+        fprintf(stderr, "Hardware performance counters are not available.\n");
+        ClosePerfCounters(&perf);
+        usePerf = 0;
+    }
+
+    // Run the benchmarks
+    BeginOutput(&out);
+    BeginSection(&out, "results");
+    if (save.f)
+    {
+        BeginOutput(&save);
+        BeginSection(&save, "results");
+    }
+    for (k = 0; k < files.count; ++k)
+    {
+        data = LoadInput(files.names[k], &size);
+        if (!data)
+        {
+            success = 0;
+            continue;
+        }
+        for (j = 0; j < numConfigs; ++j)
+        {
+            if (verbose)
+                fprintf(stderr, "%s (%s -%d)\n", files.names[k],
+                        configs[j].codec.name, configs[j].level);
+            r = &results[k * MAX_CONFIGS + j];
+            if (mode == MODE_THREADS)
+            {
+                // Single thread reference, and then all threads
+                if (RunThreadBenchmark(&configs[j].codec, data, size,
+                                       configs[j].level, fast, warmupRuns,
+                                       timedRuns, msgMode ? &msgSizes : NULL,
+                                       workload, 1, &singleResult) &&
+                    ((threads == 1) ||
+                     RunThreadBenchmark(&configs[j].codec, data, size,
+                                        configs[j].level, fast, warmupRuns,
+                                        timedRuns, msgMode ? &msgSizes : NULL,
+                                        workload, threads, &threadResult)))
+                {
+                    singleResult.encEfficiency = singleResult.decEfficiency = 1.0;
+                    PrintThreadResult(&out, files.names[k], &configs[j].codec,
+                                      configs[j].level, workload, &singleResult);
+                    if (save.f)
+                        PrintThreadResult(&save, files.names[k],
+                                          &configs[j].codec, configs[j].level,
+                                          workload, &singleResult);
+                    if (threads > 1)
+                    {
+                        threadResult.encEfficiency = threadResult.encThroughput /
+                            (threadResult.threads * singleResult.encThroughput);
+                        threadResult.decEfficiency = threadResult.decThroughput /
+                            (threadResult.threads * singleResult.decThroughput);
+                        PrintThreadResult(&out, files.names[k],
+                                          &configs[j].codec, configs[j].level,
+                                          workload, &threadResult);
+                        if (save.f)
+                            PrintThreadResult(&save, files.names[k],
+                                              &configs[j].codec,
+                                              configs[j].level, workload,
+                                              &threadResult);
+                    }
+                }
+                else
+                    success = 0;
+            }
+            else if (mode == MODE_MESSAGES)
+            {
+                if (RunMessageBenchmark(&configs[j].codec, data, size,
+                                        configs[j].level, fast, warmupRuns,
+                                        timedRuns, &msgSizes, &msgResult))
+                {
+                    PrintMessageResult(&out, files.names[k], &configs[j].codec,
+                                       configs[j].level, &msgSizes, &msgResult);
+                    if (save.f)
+                        PrintMessageResult(&save, files.names[k],
+                                           &configs[j].codec, configs[j].level,
+                                           &msgSizes, &msgResult);
+                }
+                else
+                    success = 0;
+            }
+            else if (RunBenchmark(&configs[j].codec, data, size, configs[j].level,
+                             fast, warmupRuns, timedRuns, progressfun,
+                             usePerf ? &perf : NULL, r))
+            {
+                PrintResult(&out, files.names[k], 1, &configs[j].codec,
+                            configs[j].level, r);
+                if (save.f)
+                    PrintResult(&save, files.names[k], 1, &configs[j].codec,
+                                configs[j].level, r);
+                AddResult(&configs[j].total, r);
+                ++configs[j].files;
+            }
+            else
+            {
+                r->encSize = 0.0;
+                success = 0;
+            }
+        }
+        free(data);
+    }
+    EndSection(&out);
+
+    // Aggregate results
+    if ((mode == MODE_BULK) &&
+        ((files.count > 1) || (out.format != FORMAT_TEXT)))
+    {
+        BeginSection(&out, "totals");
+        for (j = 0; j < numConfigs; ++j)
+        {
+            if (configs[j].files > 0)
+                PrintResult(&out, NULL, configs[j].files, &configs[j].codec,
+                            configs[j].level, &configs[j].total);
+        }
+        EndSection(&out);
+    }
+    EndOutput(&out);
+    if (save.f)
+    {
+        for (j = 0; j < numConfigs; ++j)
+        {
+            if (configs[j].files > 0)
+                PrintResult(&save, NULL, configs[j].files, &configs[j].codec,
+                            configs[j].level, &configs[j].total);
+        }
+        EndOutput(&save);
+    }
+
+    // Compare with the baseline
+    if (baseName)
+    {
+        // Keep machine readable output on stdout clean
+        report = (out.f == stdout && out.format != FORMAT_TEXT) ? stderr : stdout;
+        fprintf(report, "\nComparison with \"%s\" (throughput change, 95%% "
+                        "confidence interval):\n", baseName);
+        for (k = 0; k < files.count; ++k)
+        {
+            for (j = 0; j < numConfigs; ++j)
+            {
+                r = &results[k * MAX_CONFIGS + j];
+                if (r->encSize > 0.0)
+                    CompareResult(report, &baseline, files.names[k], 1,
+                                  &configs[j].codec, configs[j].level, r);
+            }
+        }
+        for (j = 0; j < numConfigs; ++j)
+        {
+            if ((files.count > 1) && (configs[j].files > 0))
+                CompareResult(report, &baseline, NULL, configs[j].files,
+                              &configs[j].codec, configs[j].level,
+                              &configs[j].total);
+        }
+        fprintf(report, "%d results compared, %d regressions (threshold "
+                        "%.1f%%)\n", baseline.compared, baseline.regressions,
+                        baseline.threshold);
+    }
+
+done:
+    // Clean up
+    if (out.f && out.f != stdout)
+        fclose(out.f);
+    if (save.f)
+        fclose(save.f);
+    if (usePerf)
+        ClosePerfCounters(&perf);
+    free(results);
+    free(configs);
+    FreeBaseline(&baseline);
+    FreeFileList(&files);
+
+    if (!success)
+        return 1;
+    return baseline.regressions > 0 ? 2 : 0;
+}
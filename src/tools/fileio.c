@@ -0,0 +1,550 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; -*- */
+
+/*
+* This file is part of liblzg.
+*
+* Copyright (c) 2010-2011 Marcus Geelnard
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would
+*    be appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fileio.h"
+
+#if !defined(_WIN32)
+# define USE_MMAP
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <dirent.h>
+#endif
+
+
+/*-- Input files ------------------------------------------------------------*/
+
+int IsRegularFile(const char *name)
+{
+#ifdef USE_MMAP
+    struct stat st;
+    if (stat(name, &st) != 0)
+        return 1; /* Let the caller report the error */
+    return S_ISREG(st.st_mode);
+#else
+    (void) name;
+    return 1;
+#endif
+}
+
+size_t GetFileSize(const char *name)
+{
+#ifdef USE_MMAP
+    struct stat st;
+    if (stat(name, &st) != 0)
+        return 0;
+    return (size_t) st.st_size;
+#else
+    FILE *f;
+    long size;
+    f = fopen(name, "rb");
+    if (!f)
+        return 0;
+    size = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    fclose(f);
+    return size > 0 ? (size_t) size : 0;
+#endif
+}
+
+static int ReadInputFile(const char *name, in_file_t *f)
+{
+    FILE *inFile;
+
+    inFile = fopen(name, "rb");
+    if (!inFile)
+    {
+        fprintf(stderr, "Unable to open file \"%s\".\n", name);
+        return 0;
+    }
+
+    fseek(inFile, 0, SEEK_END);
+    f->size = (size_t) ftell(inFile);
+    fseek(inFile, 0, SEEK_SET);
+    if (f->size > 0)
+    {
+        f->data = (unsigned char*) malloc(f->size);
+        if (f->data)
+        {
+            if (fread(f->data, 1, f->size, inFile) != f->size)
+            {
+                fprintf(stderr, "Error reading \"%s\".\n", name);
+                free(f->data);
+                f->data = (unsigned char*) 0;
+            }
+        }
+        else
+            fprintf(stderr, "Out of memory.\n");
+    }
+    else
+        fprintf(stderr, "Input file is empty.\n");
+
+    fclose(inFile);
+
+    return f->data != (unsigned char*) 0;
+}
+
+int OpenInputFile(const char *name, in_file_t *f)
+{
+#ifdef USE_MMAP
+    struct stat st;
+    void *p;
+    int fd;
+#endif
+
+    f->data = (unsigned char*) 0;
+    f->size = 0;
+    f->mapped = 0;
+    f->name = name;
+
+#ifdef USE_MMAP
+    fd = open(name, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Unable to open file \"%s\".\n", name);
+        return 0;
+    }
+    if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode))
+    {
+        if (st.st_size == 0)
+        {
+            fprintf(stderr, "Input file is empty.\n");
+            close(fd);
+            return 0;
+        }
+        p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            /* The coders read the data front to back */
+            madvise(p, (size_t) st.st_size, MADV_SEQUENTIAL);
+            f->data = (unsigned char*) p;
+            f->size = (size_t) st.st_size;
+            f->mapped = 1;
+        }
+    }
+    close(fd);
+    if (f->mapped)
+        return 1;
+#endif
+
+    /* Fall back to reading the file into a heap buffer */
+    return ReadInputFile(name, f);
+}
+
+void CloseInputFile(in_file_t *f)
+{
+#ifdef USE_MMAP
+    if (f->mapped)
+        munmap(f->data, f->size);
+    else
+#endif
+        free(f->data);
+    f->data = (unsigned char*) 0;
+    f->size = 0;
+}
+
+
+/*-- Output files -----------------------------------------------------------*/
+
+#ifdef USE_MMAP
+/* Check if two names refer to the same (existing) file */
+static int IsSameFile(const char *name1, const char *name2)
+{
+    struct stat st1, st2;
+    if ((stat(name1, &st1) != 0) || (stat(name2, &st2) != 0))
+        return 0;
+    return (st1.st_dev == st2.st_dev) && (st1.st_ino == st2.st_ino);
+}
+
+/* Allocate disk space for a file, so that writing to a memory mapping of it
+   can not fail (a sparse file gives SIGBUS when the disk is full). Returns
+   non-zero on success. */
+static int AllocateFile(int fd, size_t size)
+{
+# if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
+    return posix_fallocate(fd, 0, (off_t) size) == 0;
+# else
+    (void) fd;
+    (void) size;
+    return 0;
+# endif
+}
+#endif
+
+int CreateOutputFile(const char *name, size_t maxSize, const in_file_t *in,
+                     out_file_t *f)
+{
+#ifdef USE_MMAP
+    struct stat st;
+    void *p;
+#endif
+
+    f->data = (unsigned char*) 0;
+    f->size = maxSize;
+    f->mapped = 0;
+    f->fd = -1;
+    f->name = name;
+
+#ifdef USE_MMAP
+    if (name)
+    {
+        /* Truncating the input file would destroy the input data */
+        if (in && in->name && IsSameFile(in->name, name))
+        {
+            fprintf(stderr, "Input and output are the same file (\"%s\").\n",
+                    name);
+            return 0;
+        }
+
+        f->fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (f->fd < 0)
+        {
+            fprintf(stderr, "Unable to open file \"%s\".\n", name);
+            return 0;
+        }
+
+        /* Pre-allocate the file, and map it into memory (only possible for
+           regular files) */
+        if ((maxSize > 0) && (fstat(f->fd, &st) == 0) && S_ISREG(st.st_mode))
+        {
+            if (AllocateFile(f->fd, maxSize))
+            {
+                p = mmap(NULL, maxSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         f->fd, 0);
+                if (p != MAP_FAILED)
+                {
+                    f->data = (unsigned char*) p;
+                    f->mapped = 1;
+                    return 1;
+                }
+            }
+
+            /* The data is written when the file is closed instead (drop any
+               space that was allocated) */
+            if (ftruncate(f->fd, 0) != 0)
+            {
+                fprintf(stderr, "Unable to write to file \"%s\".\n", name);
+                AbortOutputFile(f);
+                return 0;
+            }
+        }
+    }
+#else
+    /* The output is only written when the file is closed */
+    (void) in;
+#endif
+
+    /* Fall back to a heap buffer */
+    f->data = (unsigned char*) malloc(maxSize > 0 ? maxSize : 1);
+    if (!f->data)
+    {
+        fprintf(stderr, "Out of memory!\n");
+        AbortOutputFile(f);
+        return 0;
+    }
+
+    return 1;
+}
+
+int CloseOutputFile(out_file_t *f, size_t size)
+{
+    FILE *outFile;
+    int success = 1;
+
+#ifdef USE_MMAP
+    if (f->mapped)
+    {
+        /* Unmap the data, and cut the file at the actual size */
+        munmap(f->data, f->size);
+        if (ftruncate(f->fd, (off_t) size) != 0)
+        {
+            fprintf(stderr, "Error writing to output file.\n");
+            success = 0;
+        }
+        close(f->fd);
+        f->data = (unsigned char*) 0;
+        f->fd = -1;
+        return success;
+    }
+
+    if (f->fd >= 0)
+    {
+        /* Not mappable (e.g. a device): plain write */
+        const unsigned char *ptr = f->data;
+        size_t left = size;
+        ssize_t count;
+        while (left > 0)
+        {
+            count = write(f->fd, ptr, left);
+            if (count <= 0)
+            {
+                fprintf(stderr, "Error writing to output file.\n");
+                success = 0;
+                break;
+            }
+            ptr += count;
+            left -= (size_t) count;
+        }
+        close(f->fd);
+        f->fd = -1;
+        free(f->data);
+        f->data = (unsigned char*) 0;
+        return success;
+    }
+#endif
+
+    if (f->name)
+    {
+        outFile = fopen(f->name, "wb");
+        if (!outFile)
+        {
+            fprintf(stderr, "Unable to open file \"%s\".\n", f->name);
+            success = 0;
+        }
+    }
+    else
+        outFile = stdout;
+
+    if (outFile)
+    {
+        if (fwrite(f->data, 1, size, outFile) != size)
+        {
+            fprintf(stderr, "Error writing to output file.\n");
+            success = 0;
+        }
+        if (f->name)
+            fclose(outFile);
+        else
+            fflush(outFile);
+    }
+
+    free(f->data);
+    f->data = (unsigned char*) 0;
+    return success;
+}
+
+void AbortOutputFile(out_file_t *f)
+{
+#ifdef USE_MMAP
+    if (f->mapped)
+        munmap(f->data, f->size);
+    else
+#endif
+        free(f->data);
+    f->data = (unsigned char*) 0;
+#ifdef USE_MMAP
+    if (f->fd >= 0)
+    {
+        close(f->fd);
+        f->fd = -1;
+        if (f->name)
+            unlink(f->name);
+    }
+#endif
+}
+
+
+/*-- Atomic file writes -----------------------------------------------------*/
+
+int WriteFileAtomic(const char *name, const unsigned char *data, size_t size)
+{
+    char *tmpName;
+    FILE *f;
+    int success = 1;
+#ifdef USE_MMAP
+    int fd;
+#endif
+
+    tmpName = (char*) malloc(strlen(name) + 32);
+    if (!tmpName)
+    {
+        fprintf(stderr, "Out of memory!\n");
+        return 0;
+    }
+
+    /* Create a temporary file next to the target file */
+#ifdef USE_MMAP
+    sprintf(tmpName, "%s.%ld.tmp", name, (long) getpid());
+    fd = open(tmpName, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    f = fd >= 0 ? fdopen(fd, "wb") : (FILE*) 0;
+    if ((fd >= 0) && !f)
+        close(fd);
+#else
+    sprintf(tmpName, "%s.tmp", name);
+    f = fopen(tmpName, "wb");
+#endif
+    if (!f)
+    {
+        fprintf(stderr, "Unable to open file \"%s\".\n", tmpName);
+        free(tmpName);
+        return 0;
+    }
+
+    /* Write data */
+    if (fwrite(data, 1, size, f) != size)
+        success = 0;
+    if (fclose(f) != 0)
+        success = 0;
+
+    /* Move it into place */
+    if (success)
+    {
+#ifndef USE_MMAP
+        remove(name);
+#endif
+        if (rename(tmpName, name) != 0)
+            success = 0;
+    }
+    if (!success)
+    {
+        fprintf(stderr, "Error writing to \"%s\".\n", name);
+        remove(tmpName);
+    }
+
+    free(tmpName);
+    return success;
+}
+
+
+/*-- File lists -------------------------------------------------------------*/
+
+void InitFileList(file_list_t *list)
+{
+    list->names = (char**) 0;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+void FreeFileList(file_list_t *list)
+{
+    size_t i;
+    for (i = 0; i < list->count; ++i)
+        free(list->names[i]);
+    free(list->names);
+    InitFileList(list);
+}
+
+int AddFile(file_list_t *list, const char *name)
+{
+    char **names;
+    size_t capacity;
+
+    if (list->count >= list->capacity)
+    {
+        capacity = list->capacity ? 2 * list->capacity : 64;
+        names = (char**) realloc(list->names, capacity * sizeof(char*));
+        if (!names)
+            return 0;
+        list->names = names;
+        list->capacity = capacity;
+    }
+    list->names[list->count] = (char*) malloc(strlen(name) + 1);
+    if (!list->names[list->count])
+        return 0;
+    strcpy(list->names[list->count], name);
+    ++list->count;
+    return 1;
+}
+
+#ifdef USE_MMAP
+static int CompareNames(const void *p1, const void *p2)
+{
+    return strcmp(*(char * const *)p1, *(char * const *)p2);
+}
+#endif
+
+int AddDirectory(file_list_t *list, const char *dir, const char *skipSuffix)
+{
+#ifdef USE_MMAP
+    DIR *d;
+    struct dirent *entry;
+    struct stat st;
+    char *path;
+    size_t dirLen, nameLen, suffixLen, first = list->count;
+    int success = 1;
+
+    d = opendir(dir);
+    if (!d)
+    {
+        fprintf(stderr, "Unable to open directory \"%s\".\n", dir);
+        return 0;
+    }
+
+    dirLen = strlen(dir);
+    while (dirLen > 1 && dir[dirLen - 1] == '/')
+        --dirLen;
+    suffixLen = skipSuffix ? strlen(skipSuffix) : 0;
+    while (success && (entry = readdir(d)))
+    {
+        if ((strcmp(entry->d_name, ".") == 0) ||
+            (strcmp(entry->d_name, "..") == 0))
+            continue;
+
+        /* Full path */
+        nameLen = strlen(entry->d_name);
+        path = (char*) malloc(dirLen + nameLen + 2);
+        if (!path)
+        {
+            success = 0;
+            break;
+        }
+        memcpy(path, dir, dirLen);
+        path[dirLen] = '/';
+        memcpy(path + dirLen + 1, entry->d_name, nameLen + 1);
+
+        /* Recurse into sub directories, and add regular files */
+        if (lstat(path, &st) == 0)
+        {
+            if (S_ISDIR(st.st_mode))
+                success = AddDirectory(list, path, skipSuffix);
+            else if (S_ISREG(st.st_mode) &&
+                     !((nameLen >= suffixLen) && (suffixLen > 0) &&
+                       (strcmp(entry->d_name + nameLen - suffixLen,
+                               skipSuffix) == 0)))
+                success = AddFile(list, path);
+        }
+        free(path);
+    }
+
+    closedir(d);
+
+    /* Sort the names (directory order is not well defined) */
+    qsort(&list->names[first], list->count - first, sizeof(char*),
+          CompareNames);
+
+    return success;
+#else
+    (void) list;
+    (void) skipSuffix;
+    fprintf(stderr, "Unable to open directory \"%s\" (not supported).\n", dir);
+    return 0;
+#endif
+}
@@ -0,0 +1,110 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; -*- */
+
+/*
+* This file is part of liblzg.
+*
+* Copyright (c) 2010-2011 Marcus Geelnard
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would
+*    be appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#ifndef _LZG_FILEIO_H_
+#define _LZG_FILEIO_H_
+
+#include <stddef.h>
+
+/*
+* File I/O helpers for the LZG tools.
+*
+* Where possible (POSIX systems), files are memory mapped, so that the data
+* does not have to be copied between the page cache and heap buffers. If memory
+* mapping is not possible (e.g. for stdout, pipes or unsupported systems), the
+* helpers fall back to regular heap buffers and stdio.
+*/
+
+/* Input file data */
+typedef struct {
+    unsigned char *data;     /* File data */
+    size_t         size;     /* File size (number of bytes) */
+    int            mapped;   /* Non-zero if data is memory mapped */
+    const char    *name;     /* File name */
+} in_file_t;
+
+/* Output file data */
+typedef struct {
+    unsigned char *data;     /* Output buffer */
+    size_t         size;     /* Output buffer size (number of bytes) */
+    int            mapped;   /* Non-zero if data is memory mapped */
+    int            fd;       /* File descriptor (if mapped) */
+    const char    *name;     /* File name (NULL for stdout) */
+} out_file_t;
+
+/* Check if a file is a regular (seekable) file. */
+int IsRegularFile(const char *name);
+
+/* Get the size of a file (zero if it can't be determined). */
+size_t GetFileSize(const char *name);
+
+/* Read an entire file. Returns non-zero on success. */
+int OpenInputFile(const char *name, in_file_t *f);
+
+/* Free the input file data. */
+void CloseInputFile(in_file_t *f);
+
+/* Create an output file (name = NULL for stdout), with a buffer that can hold
+   up to maxSize bytes. The output file may not be the same file as the input
+   file in (if given), since the input may be memory mapped. Returns non-zero
+   on success. */
+int CreateOutputFile(const char *name, size_t maxSize, const in_file_t *in,
+                     out_file_t *f);
+
+/* Write the first size bytes of the output buffer to the output file, and
+   close it. Returns non-zero on success. */
+int CloseOutputFile(out_file_t *f, size_t size);
+
+/* Discard the output file (e.g. after a failure). */
+void AbortOutputFile(out_file_t *f);
+
+/* Write data to a file atomically (via a temporary file that is renamed when
+   all the data has been written). Returns non-zero on success. */
+int WriteFileAtomic(const char *name, const unsigned char *data, size_t size);
+
+/* List of file names */
+typedef struct {
+    char   **names;
+    size_t   count;
+    size_t   capacity;
+} file_list_t;
+
+/* Initialize a file list. */
+void InitFileList(file_list_t *list);
+
+/* Free a file list. */
+void FreeFileList(file_list_t *list);
+
+/* Add a file name to a file list. Returns non-zero on success. */
+int AddFile(file_list_t *list, const char *name);
+
+/* Add all regular files in a directory (and its sub directories) to a file
+   list, except files with the given suffix (may be NULL). The names are added
+   in sorted order. Returns non-zero on success. */
+int AddDirectory(file_list_t *list, const char *dir, const char *skipSuffix);
+
+#endif // _LZG_FILEIO_H_
@@ -29,6 +29,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include <lzg.h>
+#include "fileio.h"
+#include "stream.h"
+
+#ifndef _WIN32
+# define USE_THREADS
+# include <pthread.h>
+# include <unistd.h>
+#endif
+
+/* Block size for stream compression (stdin, pipes etc) */
+#define STREAM_BLOCK_SIZE (4 * 1024 * 1024)
+
+typedef struct {
+    lzg_encoder_config_t *config;
+    double decTotal, encTotal;
+} stream_state_t;
+
+/* Maximum number of worker threads for batch compression */
+#define MAX_THREADS 256
+
+typedef struct {
+    file_list_t files;
+    lzg_encoder_config_t *config;
+    int verbose;
+    size_t next, maxSize;
+    int failures;
+    double decTotal, encTotal;
+#ifdef USE_THREADS
+    pthread_mutex_t mutex;
+#endif
+} batch_t;
 
 
 void ShowProgress(int progress, void *data)
@@ -38,29 +69,581 @@ void ShowProgress(int progress, void *data)
     fflush(f);
 }
 
+/* Print encoder statistics (a summary of the LZG_Encode() counters) */
+void PrintEncoderStats(FILE *f, const lzg_encoder_stats_t *s)
+{
+    static const char *copyNames[4] = {
+        "M1 (distant)", "M2 (medium)", "M3 (short)", "M4 (near)"
+    };
+    lzg_uint32_t i, copies = 0;
+
+    fprintf(f, "Literals:         %u\n", s->literals);
+    fprintf(f, "Escaped literals: %u\n", s->escapedLiterals);
+    for (i = 0; i < 4; ++i)
+    {
+        fprintf(f, "%-13s     %u\n", copyNames[i], s->copies[i]);
+        copies += s->copies[i];
+    }
+    fprintf(f, "Chain steps:      %.0f", s->chainSteps);
+    if (copies + s->literals + s->escapedLiterals > 0)
+        fprintf(f, " (%.1f per search)", s->chainSteps /
+                (double) (copies + s->literals + s->escapedLiterals));
+    fprintf(f, "\nGood length stops: %u\n", s->goodLengthStops);
+    fprintf(f, "Time:             markers %.3f s, search %.3f s, emit %.3f s\n",
+            s->markerTime, s->searchTime, s->emitTime);
+    fprintf(f, "Copy lengths:");
+    for (i = 0; i < LZG_STATS_LENGTH_BINS; ++i)
+        if (s->lengths[i])
+            fprintf(f, " %u:%u", i, s->lengths[i]);
+    fprintf(f, "\nCopy offsets:");
+    for (i = 0; i < LZG_STATS_OFFSET_BINS; ++i)
+        if (s->offsets[i])
+            fprintf(f, " %u-%u:%u", 1 << i, (2 << i) - 1, s->offsets[i]);
+    fprintf(f, "\n");
+}
+
+/* Accumulated results of the analysis mode */
+typedef struct {
+    lzg_decoder_stats_t stats;
+    double encSize, decSize, storedSize;
+    unsigned int files, blocks, storedBlocks, failures;
+} analysis_t;
+
+static void InitAnalysis(analysis_t *a)
+{
+    memset(a, 0, sizeof(analysis_t));
+}
+
+static void AddAnalysis(analysis_t *a, const lzg_decoder_stats_t *s)
+{
+    int i;
+    a->stats.literals += s->literals;
+    a->stats.escapedLiterals += s->escapedLiterals;
+    for (i = 0; i < 4; ++i)
+    {
+        a->stats.copies[i] += s->copies[i];
+        a->stats.copyBytes[i] += s->copyBytes[i];
+    }
+    for (i = 0; i < LZG_STATS_LENGTH_BINS; ++i)
+        a->stats.lengths[i] += s->lengths[i];
+    for (i = 0; i < LZG_STATS_OFFSET_BINS; ++i)
+        a->stats.offsets[i] += s->offsets[i];
+    a->stats.quantizedCopies += s->quantizedCopies;
+    a->stats.quantizedBytes += s->quantizedBytes;
+    a->stats.parseGainBytes += s->parseGainBytes;
+    if (s->maxOffset > a->stats.maxOffset)
+        a->stats.maxOffset = s->maxOffset;
+}
+
+static void PrintAnalysisRow(const char *name, double count, double coded,
+                             double decoded, const analysis_t *a)
+{
+    printf("  %-18s %12.0f %12.0f %5.1f%% %12.0f %5.1f%%\n", name, count,
+           coded, a->encSize > 0.0 ? (100.0 * coded) / a->encSize : 0.0,
+           decoded, a->decSize > 0.0 ? (100.0 * decoded) / a->decSize : 0.0);
+}
+
+/* Print the token level breakdown of the analysis mode */
+static void PrintAnalysis(const char *name, const analysis_t *a)
+{
+    static const char *copyNames[4] = {
+        "M1 (distant)", "M2 (medium)", "M3 (short)", "M4 (near)"
+    };
+    static const int copySizes[4] = {4, 3, 2, 2};
+    const lzg_decoder_stats_t *s = &a->stats;
+    double coded, tokenBytes, copies = 0.0;
+    int i;
+
+    printf("%s: %u block(s), %.0f => %.0f bytes", name, a->blocks,
+           a->decSize, a->encSize);
+    if (a->decSize > 0.0)
+        printf(" (%.1f%% of the original)", (100.0 * a->encSize) / a->decSize);
+    printf("\n  %-18s %12s %12s %6s %12s %6s\n", "Token", "Count", "Coded",
+           "", "Decoded", "");
+
+    PrintAnalysisRow("Literals", s->literals, s->literals, s->literals, a);
+    PrintAnalysisRow("Escaped literals", s->escapedLiterals,
+                     2.0 * s->escapedLiterals, s->escapedLiterals, a);
+    tokenBytes = s->literals + 2.0 * s->escapedLiterals;
+    for (i = 0; i < 4; ++i)
+    {
+        coded = (double) copySizes[i] * s->copies[i];
+        PrintAnalysisRow(copyNames[i], s->copies[i], coded, s->copyBytes[i],
+                         a);
+        tokenBytes += coded;
+        copies += s->copies[i];
+    }
+    if (a->storedSize > 0.0)
+        PrintAnalysisRow("Stored", a->storedBlocks, a->storedSize,
+                         a->storedSize, a);
+    PrintAnalysisRow("Headers, markers", a->blocks,
+                     a->encSize - tokenBytes - a->storedSize, 0.0, a);
+
+    printf("  Copy lengths:");
+    for (i = 0; i < LZG_STATS_LENGTH_BINS; ++i)
+        if (s->lengths[i])
+            printf(" %d:%u", i, s->lengths[i]);
+    printf("\n  Copy offsets:");
+    for (i = 0; i < LZG_STATS_OFFSET_BINS; ++i)
+        if (s->offsets[i])
+            printf(" %d-%d:%u", 1 << i, (2 << i) - 1, s->offsets[i]);
+
+    // The literal ratio of the blocks is recalculated for the whole file
+    printf("\n  Max offset: %u, literal ratio: %.1f%% of the decoded bytes\n",
+           s->maxOffset, a->decSize > 0.0 ?
+           (100.0 * (s->literals + s->escapedLiterals)) / a->decSize : 0.0);
+    printf("  Length quantization: %u copies (%.2f%%) lost %u matching "
+           "bytes\n", s->quantizedCopies,
+           copies > 0.0 ? (100.0 * s->quantizedCopies) / copies : 0.0,
+           s->quantizedBytes);
+    printf("  Better parsing could save about %u bytes (%.2f%% of the coded "
+           "size)\n", s->parseGainBytes,
+           a->encSize > 0.0 ? (100.0 * s->parseGainBytes) / a->encSize : 0.0);
+}
+
+/* Analyze all the LZG buffers in a file (buf is a reusable output buffer) */
+static int AnalyzeFile(const char *name, analysis_t *a, unsigned char **buf,
+                       lzg_uint32_t *bufSize)
+{
+    in_file_t inFile;
+    lzg_decoder_stats_t stats;
+    lzg_uint32_t encSize, decSize;
+    size_t pos;
+    int success = 1;
+
+    if (!OpenInputFile(name, &inFile))
+        return 0;
+
+    // Walk through the concatenated LZG buffers (stream mode files)
+    for (pos = 0; success && (pos < inFile.size); pos += encSize)
+    {
+        encSize = LZG_EncodedSize(&inFile.data[pos], (lzg_uint32_t)
+                      (inFile.size - pos > 0xffffffff ? 0xffffffff :
+                       inFile.size - pos));
+        decSize = LZG_DecodedSize(&inFile.data[pos], encSize);
+        if (!encSize || (encSize > inFile.size - pos))
+        {
+            fprintf(stderr, "%s: Bad input data.\n", name);
+            success = 0;
+            break;
+        }
+
+        // Make sure that the output buffer is large enough
+        if (decSize > *bufSize)
+        {
+            free(*buf);
+            *bufSize = 0;
+            *buf = (unsigned char*) malloc(decSize);
+            if (!*buf)
+            {
+                fprintf(stderr, "Out of memory!\n");
+                success = 0;
+                break;
+            }
+            *bufSize = decSize;
+        }
+
+        // Decode and analyze
+        if ((LZG_Analyze(&inFile.data[pos], encSize, *buf, *bufSize, &stats)
+             != decSize) && decSize)
+        {
+            fprintf(stderr, "%s: Bad input data.\n", name);
+            success = 0;
+            break;
+        }
+        AddAnalysis(a, &stats);
+        a->blocks++;
+        a->encSize += encSize;
+        a->decSize += decSize;
+        if (decSize && !stats.literals && !stats.escapedLiterals &&
+            !stats.copies[0] && !stats.copies[1] && !stats.copies[2] &&
+            !stats.copies[3])
+        {
+            a->storedBlocks++;
+            a->storedSize += decSize;
+        }
+    }
+
+    CloseInputFile(&inFile);
+    return success;
+}
+
+/* Analyze a list of files. Returns the number of files that failed. */
+static unsigned int AnalyzeFiles(const file_list_t *files)
+{
+    analysis_t total, a;
+    unsigned char *buf = (unsigned char*) 0;
+    lzg_uint32_t bufSize = 0;
+    size_t i;
+
+    InitAnalysis(&total);
+    for (i = 0; i < files->count; ++i)
+    {
+        InitAnalysis(&a);
+        if (AnalyzeFile(files->names[i], &a, &buf, &bufSize))
+        {
+            PrintAnalysis(files->names[i], &a);
+            AddAnalysis(&total, &a.stats);
+            total.blocks += a.blocks;
+            total.encSize += a.encSize;
+            total.decSize += a.decSize;
+            total.storedSize += a.storedSize;
+            total.storedBlocks += a.storedBlocks;
+            total.files++;
+        }
+        else
+            total.failures++;
+    }
+    if (total.files > 1)
+        PrintAnalysis("Total", &total);
+    if (total.failures)
+        fprintf(stderr, "%u files failed.\n", total.failures);
+
+    free(buf);
+    return total.failures;
+}
+
 void ShowUsage(char *prgName)
 {
     fprintf(stderr, "Usage: %s [options] infile [outfile]\n", prgName);
+    fprintf(stderr, "       %s [options] -b file1 file2 ...\n", prgName);
+    fprintf(stderr, "       %s [options] -r dir1 dir2 ...\n", prgName);
+    fprintf(stderr, "       %s --analyze file1.lzg file2.lzg ...\n", prgName);
     fprintf(stderr, "\nOptions:\n");
     fprintf(stderr, " -1  Use fastest compression\n");
     fprintf(stderr, " -9  Use best compression\n");
     fprintf(stderr, " -s  Do not use the fast method (saves memory)\n");
+    fprintf(stderr, " -c  Add a checksum of the uncompressed data\n");
+    fprintf(stderr, " -b  Batch mode: compress each file to file.lzg\n");
+    fprintf(stderr, " -r  Batch mode, recursively compress all files in the given directories\n");
+    fprintf(stderr, " -j  Number of threads to use in batch mode (e.g. -j 4)\n");
     fprintf(stderr, " -v  Be verbose\n");
+    fprintf(stderr, " -S  Print encoder statistics (single file mode)\n");
     fprintf(stderr, " -V  Show LZG library version and exit\n");
     fprintf(stderr, "\nIf no output file is given, stdout is used for output.\n");
+    fprintf(stderr, "If infile is -, stdin is used for input. Data from stdin or pipes is\n");
+    fprintf(stderr, "compressed in blocks of %d KB.\n", STREAM_BLOCK_SIZE / 1024);
+    fprintf(stderr, "Batch mode is used if more than two files are given.\n");
+    fprintf(stderr, "\nThe --analyze mode decodes the given LZG files (without writing any output)\n");
+    fprintf(stderr, "and prints a token level breakdown of the coded data: the bytes spent on\n");
+    fprintf(stderr, "literals and each copy type, copy length and offset distributions, the\n");
+    fprintf(stderr, "match bytes lost by the length quantization, and an estimate of what better\n");
+    fprintf(stderr, "parsing could gain. The exit code is 1 if any file could not be\n");
+    fprintf(stderr, "analyzed.\n");
+}
+
+static int ReadRawBlock(FILE *f, stream_block_t *blk, void *userdata)
+{
+    (void) userdata;
+    if (!ReserveBlock(blk, STREAM_BLOCK_SIZE))
+    {
+        fprintf(stderr, "Out of memory!\n");
+        return -1;
+    }
+    blk->size = fread(blk->data, 1, STREAM_BLOCK_SIZE, f);
+    if (ferror(f))
+    {
+        fprintf(stderr, "Error reading input data.\n");
+        return -1;
+    }
+    return blk->size > 0;
+}
+
+static int CompressBlock(const stream_block_t *in, stream_block_t *out,
+                         void *userdata)
+{
+    stream_state_t *state = (stream_state_t *) userdata;
+    lzg_uint32_t maxEncSize;
+
+    // Allocate memory for the compressed data
+    maxEncSize = LZG_MaxEncodedSize((lzg_uint32_t) in->size);
+    if (!ReserveBlock(out, maxEncSize))
+    {
+        fprintf(stderr, "Out of memory!\n");
+        return 0;
+    }
+
+    // Compress
+    out->size = LZG_Encode(in->data, (lzg_uint32_t) in->size, out->data,
+                           maxEncSize, state->config);
+    if (!out->size)
+    {
+        fprintf(stderr, "Compression failed!\n");
+        return 0;
+    }
+
+    state->decTotal += (double) in->size;
+    state->encTotal += (double) out->size;
+    return 1;
+}
+
+static int CompressStream(char *inName, char *outName,
+                          lzg_encoder_config_t *config, int verbose)
+{
+    FILE *inFile, *outFile;
+    stream_state_t state;
+    lzg_encoder_config_t blockConfig;
+    int success;
+
+    // Open input and output streams
+    if (strcmp(inName, "-") == 0)
+    {
+        inFile = stdin;
+        SetBinaryMode(stdin);
+    }
+    else if (!(inFile = fopen(inName, "rb")))
+    {
+        fprintf(stderr, "Unable to open file \"%s\".\n", inName);
+        return 0;
+    }
+    if (!outName)
+    {
+        outFile = stdout;
+        SetBinaryMode(stdout);
+    }
+    else if (!(outFile = fopen(outName, "wb")))
+    {
+        fprintf(stderr, "Unable to open file \"%s\".\n", outName);
+        if (inFile != stdin)
+            fclose(inFile);
+        return 0;
+    }
+
+    // All blocks are compressed by the same thread, so they can share one
+    // encoder workspace instead of allocating new search tables per block
+    blockConfig = *config;
+    blockConfig.workspaceSize = LZG_EncoderWorkspaceSize(config->level,
+        config->fast, STREAM_BLOCK_SIZE);
+    blockConfig.workspace = calloc(blockConfig.workspaceSize, 1);
+    if (!blockConfig.workspace)
+        blockConfig.workspaceSize = 0;
+
+    // Compress block by block
+    state.config = &blockConfig;
+    state.decTotal = 0.0;
+    state.encTotal = 0.0;
+    success = ProcessStream(inFile, outFile, ReadRawBlock, CompressBlock,
+                            &state);
+    if (success && verbose && (state.decTotal > 0.0))
+    {
+        fprintf(stderr, "Result: %.0f bytes (%d%% of the original)\n",
+                        state.encTotal,
+                        (int) ((100.0 * state.encTotal) / state.decTotal));
+    }
+    free(blockConfig.workspace);
+
+    // Close files
+    if (inFile != stdin)
+        fclose(inFile);
+    if (outFile != stdout)
+        fclose(outFile);
+
+    return success;
+}
+
+/* Compress one file in batch mode (buf is a reusable output buffer, and
+   config holds the encoder workspace of the calling worker) */
+static int CompressFile(batch_t *b, const char *name,
+                        lzg_encoder_config_t *config, unsigned char **buf,
+                        lzg_uint32_t *bufSize)
+{
+    in_file_t inFile;
+    lzg_uint32_t maxEncSize, encSize;
+    lzg_encoder_config_t fileConfig;
+    char *outName;
+    int success = 0;
+
+    // Read input file
+    if (!OpenInputFile(name, &inFile))
+        return 0;
+    if (inFile.size > 0xffffffff - LZG_MaxEncodedSize(0))
+    {
+        fprintf(stderr, "Input file \"%s\" is too large.\n", name);
+        CloseInputFile(&inFile);
+        return 0;
+    }
+
+    // Make sure that the output buffer is large enough
+    maxEncSize = LZG_MaxEncodedSize((lzg_uint32_t) inFile.size);
+    if (maxEncSize > *bufSize)
+    {
+        free(*buf);
+        *bufSize = 0;
+        *buf = (unsigned char*) malloc(maxEncSize);
+        if (*buf)
+            *bufSize = maxEncSize;
+    }
+
+    // Use the workspace of the worker, unless the file has grown since the
+    // workspace was sized (then LZG_Encode() allocates memory by itself)
+    fileConfig = *config;
+    if (LZG_EncoderWorkspaceSize(config->level, config->fast,
+            (lzg_uint32_t) inFile.size) > config->workspaceSize)
+    {
+        fileConfig.workspace = NULL;
+        fileConfig.workspaceSize = 0;
+    }
+
+    outName = (char*) malloc(strlen(name) + 5);
+    if (*buf && outName)
+    {
+        // Compress
+        encSize = LZG_Encode(inFile.data, (lzg_uint32_t) inFile.size, *buf,
+                             maxEncSize, &fileConfig);
+        if (encSize)
+        {
+            // Write the output file
+            strcpy(outName, name);
+            strcat(outName, ".lzg");
+            success = WriteFileAtomic(outName, *buf, encSize);
+        }
+        else
+            fprintf(stderr, "Compression of \"%s\" failed!\n", name);
+    }
+    else
+        fprintf(stderr, "Out of memory!\n");
+
+    // Update statistics
+#ifdef USE_THREADS
+    pthread_mutex_lock(&b->mutex);
+#endif
+    if (success)
+    {
+        b->decTotal += (double) inFile.size;
+        b->encTotal += (double) encSize;
+        if (b->verbose)
+            fprintf(stderr, "%s: %d bytes (%d%% of the original)\n", name,
+                    encSize, (int) ((100.0 * encSize) / inFile.size));
+    }
+#ifdef USE_THREADS
+    pthread_mutex_unlock(&b->mutex);
+#endif
+
+    free(outName);
+    CloseInputFile(&inFile);
+    return success;
+}
+
+/* Batch worker: compress files until there are no more files */
+static void *BatchWorker(void *arg)
+{
+    batch_t *b = (batch_t *) arg;
+    unsigned char *buf = (unsigned char*) 0;
+    lzg_uint32_t bufSize = 0;
+    lzg_encoder_config_t config;
+    size_t idx;
+
+    // Each worker has its own encoder workspace, which is reused for all the
+    // files that it compresses, and is sized for the largest file (if
+    // allocation fails, LZG_Encode() allocates memory by itself instead)
+    config = *b->config;
+    config.workspaceSize = LZG_EncoderWorkspaceSize(config.level, config.fast,
+        b->maxSize > 0xffffffff ? 0xffffffff : (lzg_uint32_t) b->maxSize);
+    config.workspace = calloc(config.workspaceSize, 1);
+    if (!config.workspace)
+        config.workspaceSize = 0;
+
+    for (;;)
+    {
+        // Get the next file
+#ifdef USE_THREADS
+        pthread_mutex_lock(&b->mutex);
+#endif
+        idx = b->next++;
+#ifdef USE_THREADS
+        pthread_mutex_unlock(&b->mutex);
+#endif
+        if (idx >= b->files.count)
+            break;
+
+        // Compress it
+        if (!CompressFile(b, b->files.names[idx], &config, &buf, &bufSize))
+        {
+#ifdef USE_THREADS
+            pthread_mutex_lock(&b->mutex);
+#endif
+            ++b->failures;
+#ifdef USE_THREADS
+            pthread_mutex_unlock(&b->mutex);
+#endif
+        }
+    }
+
+    free(buf);
+    free(config.workspace);
+    return NULL;
+}
+
+static void CompressBatch(batch_t *b, int numThreads)
+{
+#ifdef USE_THREADS
+    pthread_t threads[MAX_THREADS];
+    int i;
+#endif
+    size_t size, j;
+
+    // Find the largest file (the encoder workspaces are sized for it)
+    b->maxSize = 0;
+    for (j = 0; j < b->files.count; ++j)
+    {
+        size = GetFileSize(b->files.names[j]);
+        if (size > b->maxSize)
+            b->maxSize = size;
+    }
+
+#ifdef USE_THREADS
+    // Determine the number of threads
+    if (numThreads <= 0)
+        numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (numThreads <= 0)
+        numThreads = 1;
+    if (numThreads > MAX_THREADS)
+        numThreads = MAX_THREADS;
+    if ((size_t) numThreads > b->files.count)
+        numThreads = (int) b->files.count;
+
+    // Run the workers
+    pthread_mutex_init(&b->mutex, NULL);
+    for (i = 1; i < numThreads; ++i)
+    {
+        if (pthread_create(&threads[i], NULL, BatchWorker, b) != 0)
+            break;
+    }
+    numThreads = i;
+    BatchWorker(b);
+    for (i = 1; i < numThreads; ++i)
+        pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&b->mutex);
+#else
+    (void) numThreads;
+    BatchWorker(b);
+#endif
+
+    if (b->verbose)
+    {
+        fprintf(stderr, "Result: %d files, %.0f => %.0f bytes", (int)
+                b->files.count - b->failures, b->decTotal, b->encTotal);
+        if (b->decTotal > 0.0)
+            fprintf(stderr, " (%d%% of the original)",
+                    (int) ((100.0 * b->encTotal) / b->decTotal));
+        fprintf(stderr, "\n");
+    }
+    if (b->failures)
+        fprintf(stderr, "%d files failed.\n", b->failures);
 }
 
 int main(int argc, char **argv)
 {
     char *inName, *outName;
-    FILE *inFile, *outFile;
-    size_t fileSize;
-    unsigned char *decBuf;
-    lzg_uint32_t decSize = 0;
-    unsigned char *encBuf;
+    in_file_t inFile;
+    out_file_t outFile;
+    lzg_uint32_t decSize;
     lzg_uint32_t maxEncSize, encSize;
-    int arg, verbose;
+    int arg, verbose, batch, recursive, numThreads, i, success, showStats;
+    int analyze;
     lzg_encoder_config_t config;
+    lzg_encoder_stats_t stats;
+    batch_t b;
 
     // Default arguments
     inName = NULL;
@@ -68,6 +651,12 @@ int main(int argc, char **argv)
     LZG_InitEncoderConfig(&config);
     config.fast = LZG_TRUE;
     verbose = 0;
+    batch = 0;
+    recursive = 0;
+    numThreads = 0;
+    showStats = 0;
+    analyze = 0;
+    InitFileList(&b.files);
 
     // Get arguments
     for (arg = 1; arg < argc; ++arg)
@@ -92,70 +681,123 @@ int main(int argc, char **argv)
             config.level = LZG_LEVEL_9;
         else if (strcmp("-s", argv[arg]) == 0)
             config.fast = LZG_FALSE;
+        else if (strcmp("-c", argv[arg]) == 0)
+            config.contentChecksum = LZG_TRUE;
+        else if (strcmp("-b", argv[arg]) == 0)
+            batch = 1;
+        else if (strcmp("-r", argv[arg]) == 0)
+            batch = recursive = 1;
+        else if (strcmp("-j", argv[arg]) == 0)
+        {
+            if (arg + 1 >= argc)
+            {
+                fprintf(stderr, "Missing number of threads for -j.\n");
+                FreeFileList(&b.files);
+                return 1;
+            }
+            numThreads = atoi(argv[++arg]);
+        }
         else if (strcmp("-v", argv[arg]) == 0)
             verbose = 1;
+        else if (strcmp("-S", argv[arg]) == 0)
+            showStats = 1;
+        else if (strcmp("--analyze", argv[arg]) == 0)
+            analyze = 1;
         else if (strcmp("-V", argv[arg]) == 0)
         {
             printf("LZG library version %s\n", LZG_VersionString());
             return 0;
         }
-        else if (!inName)
-            inName = argv[arg];
-        else if (!outName)
-            outName = argv[arg];
-        else
+        else if (!AddFile(&b.files, argv[arg]))
         {
-            ShowUsage(argv[0]);
+            fprintf(stderr, "Out of memory!\n");
             return 0;
         }
     }
-    if (!inName)
+    if (b.files.count == 0)
     {
         ShowUsage(argv[0]);
+        FreeFileList(&b.files);
         return 0;
     }
 
-    // Read input file
-    decBuf = (unsigned char*) 0;
-    inFile = fopen(inName, "rb");
-    if (inFile)
-    {
-        fseek(inFile, 0, SEEK_END);
-        fileSize = (size_t) ftell(inFile);
-        fseek(inFile, 0, SEEK_SET);
-        if (fileSize > 0)
+    // Analysis mode?
+    if (analyze)
+    {
+        success = AnalyzeFiles(&b.files) == 0;
+        FreeFileList(&b.files);
+        return success ? 0 : 1;
+    }
+
+    // Batch mode?
+    if (batch || (b.files.count > 2))
+    {
+        // Find all files in the given directories
+        if (recursive)
         {
-            decSize = (lzg_uint32_t) fileSize;
-            decBuf = (unsigned char*) malloc(decSize);
-            if (decBuf)
+            file_list_t dirs = b.files;
+            InitFileList(&b.files);
+            success = 1;
+            for (i = 0; success && ((size_t) i < dirs.count); ++i)
+            {
+                if (IsRegularFile(dirs.names[i]))
+                    success = AddFile(&b.files, dirs.names[i]);
+                else
+                    success = AddDirectory(&b.files, dirs.names[i], ".lzg");
+            }
+            FreeFileList(&dirs);
+            if (!success)
             {
-                if (fread(decBuf, 1, decSize, inFile) != decSize)
-                {
-                    fprintf(stderr, "Error reading \"%s\".\n", inName);
-                    free(decBuf);
-                    decBuf = (unsigned char*) 0;
-                }
+                FreeFileList(&b.files);
+                return 0;
             }
-            else
-                fprintf(stderr, "Out of memory.\n");
         }
-        else
-            fprintf(stderr, "Input file is empty.\n");
 
-        fclose(inFile);
+        // Compress all files
+        b.config = &config;
+        b.verbose = verbose;
+        b.next = 0;
+        b.failures = 0;
+        b.decTotal = 0.0;
+        b.encTotal = 0.0;
+        CompressBatch(&b, numThreads);
+        FreeFileList(&b.files);
+        return b.failures ? 1 : 0;
     }
-    else
-        fprintf(stderr, "Unable to open file \"%s\".\n", inName);
+    inName = b.files.names[0];
+    outName = b.files.count > 1 ? b.files.names[1] : NULL;
+    if (outName && (strcmp(outName, "-") == 0))
+        outName = NULL;
 
-    if (!decBuf)
-        return 0;
+    // Input from stdin or a pipe? (can't be loaded in one piece)
+    if ((strcmp(inName, "-") == 0) || !IsRegularFile(inName))
+    {
+        success = CompressStream(inName, outName, &config, verbose);
+        FreeFileList(&b.files);
+        return success ? 0 : 1;
+    }
+
+    // Read input file
+    if (!OpenInputFile(inName, &inFile))
+    {
+        FreeFileList(&b.files);
+        return 1;
+    }
+    if (inFile.size > 0xffffffff - LZG_MaxEncodedSize(0))
+    {
+        fprintf(stderr, "Input file is too large.\n");
+        CloseInputFile(&inFile);
+        FreeFileList(&b.files);
+        return 1;
+    }
+    decSize = (lzg_uint32_t) inFile.size;
 
     // Determine maximum size of compressed data
     maxEncSize = LZG_MaxEncodedSize(decSize);
 
-    // Allocate memory for the compressed data
-    encBuf = (unsigned char*) malloc(maxEncSize);
-    if (encBuf)
+    // Create the output file (the compressed data is written directly to it)
+    success = 0;
+    if (CreateOutputFile(outName, maxEncSize, &inFile, &outFile))
     {
         // Compress
         if (verbose)
@@ -163,7 +805,10 @@ int main(int argc, char **argv)
             config.progressfun = ShowProgress;
             config.userdata = stderr;
         }
-        encSize = LZG_Encode(decBuf, decSize, encBuf, maxEncSize, &config);
+        if (showStats)
+            config.stats = &stats;
+        encSize = LZG_Encode(inFile.data, decSize, outFile.data, maxEncSize,
+                             &config);
         if (encSize)
         {
             if (verbose)
@@ -171,40 +816,23 @@ int main(int argc, char **argv)
                 fprintf(stderr, "Result: %d bytes (%d%% of the original)\n",
                                 encSize, (100 * encSize) / decSize);
             }
+            if (showStats)
+                PrintEncoderStats(stderr, &stats);
 
-            // Compressed data is now in encBuf, write it...
-            if (outName)
-            {
-                outFile = fopen(outName, "wb");
-                if (!outFile)
-                    fprintf(stderr, "Unable to open file \"%s\".\n", outName);
-            }
-            else
-                outFile = stdout;
-
-            if (outFile)
-            {
-                // Write data
-                if (fwrite(encBuf, 1, encSize, outFile) != encSize)
-                    fprintf(stderr, "Error writing to output file.\n");
-
-                // Close file
-                if (outName)
-                    fclose(outFile);
-            }
+            // Compressed data is now in the output buffer, write it...
+            success = CloseOutputFile(&outFile, encSize);
         }
         else
+        {
             fprintf(stderr, "Compression failed!\n");
-
-        // Free memory when we're done with the compressed data
-        free(encBuf);
+            AbortOutputFile(&outFile);
+        }
     }
-    else
-        fprintf(stderr, "Out of memory!\n");
 
     // Free memory
-    free(decBuf);
+    CloseInputFile(&inFile);
+    FreeFileList(&b.files);
 
-    return 0;
+    return success ? 0 : 1;
 }
 
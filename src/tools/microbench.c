@@ -0,0 +1,855 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; -*- */
+
+/*
+* This file is part of liblzg.
+*
+* Copyright (c) 2010-2011 Marcus Geelnard
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would
+*    be appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE /* For CPU affinity */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "synth.h"
+
+/*
+* The internal kernels of the library are static functions, so the library
+* sources are compiled into this program (instead of linking with liblzg).
+* This way the kernels are benchmarked exactly as they are compiled in the
+* library, including inlining of the constant arguments.
+*/
+#include "../lib/checksum.c"
+#include "../lib/encode.c"
+#include "../lib/decode.c"
+
+
+/*-- High resolution timer implementation -----------------------------------*/
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <time.h>
+#endif
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+# include <x86intrin.h>
+# define HAVE_TSC
+#endif
+
+/* Get the current time (seconds, monotonic) */
+double GetTime(void)
+{
+#ifdef _WIN32
+    static __int64 timeFreq = 0;
+    __int64 t;
+    if (!timeFreq)
+        QueryPerformanceFrequency((LARGE_INTEGER *)&timeFreq);
+    QueryPerformanceCounter((LARGE_INTEGER *)&t);
+    return (double) t / (double) timeFreq;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+#endif
+}
+
+/* Get the current CPU time stamp counter (zero if not available) */
+unsigned long long GetCycles(void)
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*-- (end of high resolution timer implementation) --------------------------*/
+
+
+/*-- CPU affinity -----------------------------------------------------------*/
+
+#if defined(__linux__)
+# include <sched.h>
+#endif
+
+/* Pin the current thread to the current CPU. Returns the CPU number, or -1 if
+   not supported. */
+int PinToCurrentCPU(void)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    int cpu = sched_getcpu();
+    if (cpu < 0)
+        return -1;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        return -1;
+    return cpu;
+#elif defined(_WIN32)
+    int cpu = (int) GetCurrentProcessorNumber();
+    if (!SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR) 1) << cpu))
+        return -1;
+    return cpu;
+#else
+    return -1;
+#endif
+}
+
+/*-- (end of CPU affinity) --------------------------------------------------*/
+
+
+/*-- Kernel timing ----------------------------------------------------------*/
+
+#define DEFAULT_TIMED_RUNS 15
+#define DEFAULT_WARMUP_RUNS 2
+#define DEFAULT_SIZE (1024 * 1024)
+
+/* State for a kernel (the fields that are used depend on the kernel) */
+typedef struct {
+    const unsigned char *data;  /* Input data */
+    lzg_uint32_t size;          /* Size of the input data */
+    search_accel_t *sa;         /* Search accelerator (encoder kernels) */
+    lzg_bool_t checksum;        /* Histogram: calculate the checksum too */
+    unsigned char *out;         /* Output buffer (decoder kernels) */
+    lzg_uint32_t outSize;       /* Size of the output buffer */
+    lzg_uint32_t decodedSize;   /* Expected decoded size */
+} kernel_ctx_t;
+
+/* A kernel to be timed: setup is called before every run (not timed) */
+typedef struct {
+    void (*setup)(kernel_ctx_t *ctx);
+    int (*run)(kernel_ctx_t *ctx);
+} kernel_t;
+
+/* Timing result for a kernel */
+typedef struct {
+    const char *kernel;     /* Kernel name */
+    char params[64];        /* Kernel parameters */
+    double bytes;           /* Number of bytes processed per run */
+    double items;           /* Number of items (calls, tokens...) per run */
+    int runs;               /* Number of timed runs */
+    double median;          /* Median time (seconds) */
+    double min;             /* Minimum time (seconds) */
+    double cycles;          /* Median number of cycles (zero if N/A) */
+} kernel_result_t;
+
+/* Results of the kernels are accumulated here, so that the compiler can not
+   optimize them away */
+static volatile lzg_uint32_t g_sink;
+
+static int CompareDouble(const void *p1, const void *p2)
+{
+    double d1 = *(const double *)p1, d2 = *(const double *)p2;
+    return d1 < d2 ? -1 : (d1 > d2 ? 1 : 0);
+}
+
+static double Median(double *x, int n)
+{
+    qsort((void *)x, n, sizeof(double), CompareDouble);
+    if (n & 1)
+        return x[n / 2];
+    return 0.5 * (x[n / 2 - 1] + x[n / 2]);
+}
+
+/* Time a kernel. Returns zero if the kernel failed. */
+int TimeKernel(const kernel_t *k, kernel_ctx_t *ctx, int warmupRuns,
+               int timedRuns, kernel_result_t *r)
+{
+    double *times, *cycles, t0;
+    unsigned long long c0;
+    int i, success = 1;
+
+    times = (double *) malloc(sizeof(double) * timedRuns);
+    cycles = (double *) malloc(sizeof(double) * timedRuns);
+    if (!times || !cycles)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        free(times);
+        free(cycles);
+        return 0;
+    }
+
+    for (i = -warmupRuns; i < timedRuns && success; ++i)
+    {
+        if (k->setup)
+            k->setup(ctx);
+        t0 = GetTime();
+        c0 = GetCycles();
+        success = k->run(ctx);
+        if (i >= 0)
+        {
+            cycles[i] = (double) (GetCycles() - c0);
+            times[i] = GetTime() - t0;
+        }
+    }
+
+    if (success)
+    {
+        r->runs = timedRuns;
+        r->cycles = Median(cycles, timedRuns);
+        r->median = Median(times, timedRuns);
+        r->min = times[0];
+    }
+    else
+        fprintf(stderr, "Kernel %s (%s) failed.\n", r->kernel, r->params);
+
+    free(times);
+    free(cycles);
+    return success;
+}
+
+/*-- (end of kernel timing) -------------------------------------------------*/
+
+
+/*-- Kernels ----------------------------------------------------------------*/
+
+/* Checksum of the input data */
+static int RunChecksum(kernel_ctx_t *ctx)
+{
+    g_sink += _LZG_CalcChecksum(ctx->data, ctx->size);
+    return 1;
+}
+
+/* Histogram and marker symbol selection (including the qsort) */
+static int RunHistogram(kernel_ctx_t *ctx)
+{
+    unsigned char m1, m2, m3, m4;
+    lzg_uint32_t checksum = 0;
+    lzg_iovec_t seg;
+    seg.base = (void *) ctx->data;
+    seg.size = ctx->size;
+    _LZG_DetermineMarkers(&seg, 1, &m1, &m2, &m3, &m4,
+                          ctx->checksum ? &checksum : NULL);
+    g_sink += m1 + m2 + m3 + m4 + checksum;
+    return 1;
+}
+
+/* Clear the search accelerator (only the entries that are used) */
+static void ResetSearchAccel(kernel_ctx_t *ctx)
+{
+    lzg_iovec_t seg;
+    seg.base = (void *) ctx->data;
+    seg.size = ctx->size;
+    _LZG_SearchAccel_Clear(ctx->sa, &seg, 1);
+}
+
+/* Search accelerator update, for every position of the input data */
+static int RunUpdateLastPos(kernel_ctx_t *ctx)
+{
+    unsigned char *pos, *end;
+    end = (unsigned char *) ctx->data + ctx->size;
+    for (pos = (unsigned char *) ctx->data; pos < end; ++pos)
+        _LZG_UpdateLastPos(ctx->sa, ctx->data, 0, end, pos, ctx->sa->fast,
+                           ctx->sa->params.window, ctx->sa->useCheck);
+    g_sink += ctx->sa->tab[0];
+    return 1;
+}
+
+/* Match search (and update), for every position of the input data */
+static int RunFindMatch(kernel_ctx_t *ctx)
+{
+    unsigned char *pos, *end;
+    lzg_uint32_t length, offset, sum = 0;
+    end = (unsigned char *) ctx->data + ctx->size;
+    for (pos = (unsigned char *) ctx->data; pos < end; ++pos)
+    {
+        _LZG_UpdateLastPos(ctx->sa, ctx->data, 0, end, pos, ctx->sa->fast,
+                           ctx->sa->params.window, ctx->sa->useCheck);
+        length = _LZG_FindMatch(ctx->sa, ctx->data, 0, end, pos, 1, &offset,
+                                NULL, ctx->sa->fast, ctx->sa->params.window,
+                                ctx->sa->params.maxMatches,
+                                ctx->sa->params.goodLength, ctx->sa->useCheck);
+        sum += length + offset;
+    }
+    g_sink += sum;
+    return 1;
+}
+
+/* Count the chain steps of the match search (the items of the findmatch
+   kernel), with the statistics version of the search (not timed) */
+static double CountChainSteps(kernel_ctx_t *ctx)
+{
+    unsigned char *pos, *end;
+    lzg_uint32_t offset;
+    lzg_encoder_stats_t stats;
+
+    memset(&stats, 0, sizeof(stats));
+    ResetSearchAccel(ctx);
+    end = (unsigned char *) ctx->data + ctx->size;
+    for (pos = (unsigned char *) ctx->data; pos < end; ++pos)
+    {
+        _LZG_UpdateLastPos(ctx->sa, ctx->data, 0, end, pos, ctx->sa->fast,
+                           ctx->sa->params.window, ctx->sa->useCheck);
+        _LZG_FindMatch(ctx->sa, ctx->data, 0, end, pos, 1, &offset, &stats,
+                       ctx->sa->fast, ctx->sa->params.window,
+                       ctx->sa->params.maxMatches, ctx->sa->params.goodLength,
+                       ctx->sa->useCheck);
+    }
+    return stats.chainSteps;
+}
+
+/* Decode an LZG1 token stream (no header or checksum) */
+static int RunDecode(kernel_ctx_t *ctx)
+{
+    unsigned char *dst;
+    dst = _LZG_DecodeLZG1(ctx->data, ctx->data + ctx->size, ctx->out,
+                          ctx->out + ctx->outSize, FALSE, TRUE, FALSE);
+    if (!dst || ((lzg_uint32_t) (dst - ctx->out) != ctx->decodedSize))
+        return 0;
+    g_sink += dst[-1];
+    return 1;
+}
+
+/*-- (end of kernels) -------------------------------------------------------*/
+
+
+/*-- Decoder token streams --------------------------------------------------*/
+
+/* Token types of the decoder kernel */
+enum {
+    TOKEN_LITERAL = 0,  /* Plain literals */
+    TOKEN_ESCAPED,      /* Escaped marker symbols */
+    TOKEN_M1,           /* Distant copy (4 bytes) */
+    TOKEN_M2,           /* Medium copy (3 bytes) */
+    TOKEN_M3,           /* Short copy (2 bytes) */
+    TOKEN_M4,           /* Near copy (2 bytes) */
+    TOKEN_RLE,          /* Near copy with offset 1 (run length) */
+    NUM_TOKEN_TYPES
+};
+
+static const char *TOKEN_NAMES[NUM_TOKEN_TYPES] = {
+    "literal", "escaped", "m1", "m2", "m3", "m4", "rle"
+};
+
+/* Copy offset for each token type */
+static const lzg_uint32_t TOKEN_OFFSETS[NUM_TOKEN_TYPES] = {
+    0, 0, 4096, 1024, 32, 8, 1
+};
+
+/* Copy lengths that are tested by default */
+static const lzg_uint32_t COPY_LENGTHS[] = {
+    3, 4, 5, 6, 8, 12, 16, 24, 29, 35, 48, 72, 128
+};
+
+/* The marker symbols of the token streams */
+#define MARKER1 0xfc
+#define MARKER2 0xfd
+#define MARKER3 0xfe
+#define MARKER4 0xff
+
+/* Get the 5-bit length code for a copy length (-1 if not encodable) */
+static int LengthCode(lzg_uint32_t length)
+{
+    int i;
+    for (i = 1; i < 32; ++i)
+        if (_LZG_LENGTH_DECODE_LUT[i] == length)
+            return i;
+    return -1;
+}
+
+/* Check if a token type can encode the given copy length */
+static int CanEncode(int type, lzg_uint32_t length)
+{
+    if (type == TOKEN_LITERAL || type == TOKEN_ESCAPED)
+        return length == 1;
+    if (type == TOKEN_M3)
+        return length >= 3 && length <= 6;
+    return LengthCode(length) >= 0;
+}
+
+/* Create an LZG1 token stream that decodes to (at least) size bytes. The
+   stream starts with literals for the history of the first copy, followed by
+   identical tokens. Returns the stream size (zero if out of memory). */
+static lzg_uint32_t MakeTokenStream(int type, lzg_uint32_t length,
+    lzg_uint32_t size, const unsigned char *data, unsigned char **stream,
+    lzg_uint32_t *decodedSize, lzg_uint32_t *tokens)
+{
+    unsigned char *dst, b;
+    lzg_uint32_t i, offset, count, history;
+
+    offset = TOKEN_OFFSETS[type];
+    history = offset;
+    count = (size - history + length - 1) / length;
+    *stream = (unsigned char *) malloc(4 + 2 * history + 4 * count);
+    if (!*stream)
+        return 0;
+
+    dst = *stream;
+    *dst++ = MARKER1;
+    *dst++ = MARKER2;
+    *dst++ = MARKER3;
+    *dst++ = MARKER4;
+
+    // History (literals, without the marker symbols)
+    for (i = 0; i < history; ++i)
+        *dst++ = data[i] < MARKER1 ? data[i] : (data[i] & 0x7f);
+
+    // Tokens
+    for (i = 0; i < count; ++i)
+    {
+        switch (type)
+        {
+            case TOKEN_LITERAL:
+                b = data[(history + i) % size];
+                *dst++ = b < MARKER1 ? b : (b & 0x7f);
+                break;
+            case TOKEN_ESCAPED:
+                *dst++ = MARKER1 + (i & 3);
+                *dst++ = 0;
+                break;
+            case TOKEN_M1:
+                *dst++ = MARKER1;
+                *dst++ = (((offset - 2056) >> 11) & 0xe0) | LengthCode(length);
+                *dst++ = (offset - 2056) >> 8;
+                *dst++ = offset - 2056;
+                break;
+            case TOKEN_M2:
+                *dst++ = MARKER2;
+                *dst++ = (((offset - 8) >> 3) & 0xe0) | LengthCode(length);
+                *dst++ = offset - 8;
+                break;
+            case TOKEN_M3:
+                *dst++ = MARKER3;
+                *dst++ = ((length - 3) << 6) | (offset - 8);
+                break;
+            default:
+                *dst++ = MARKER4;
+                *dst++ = ((offset - 1) << 5) | LengthCode(length);
+                break;
+        }
+    }
+
+    *decodedSize = history + count * length;
+    *tokens = count;
+    return (lzg_uint32_t) (dst - *stream);
+}
+
+/*-- (end of decoder token streams) -----------------------------------------*/
+
+
+/*-- Output -----------------------------------------------------------------*/
+
+typedef struct {
+    int json;       /* Print the results in JSON format */
+    int records;    /* Number of printed records */
+} output_t;
+
+void BeginOutput(output_t *o, const char *data, lzg_uint32_t size,
+                 unsigned int seed, int level, int fast)
+{
+    if (o->json)
+    {
+        printf("{\n  \"data\": \"%s\",\n  \"size\": %u,\n  \"seed\": %u,\n"
+               "  \"level\": %d,\n  \"fast\": %s,\n  \"kernels\": [",
+               data, size, seed, level, fast ? "true" : "false");
+    }
+    else
+    {
+        printf("Data: %s, %u bytes (seed %u), level %d%s\n\n", data, size,
+               seed, level, fast ? "" : " (slow)");
+        printf("%-10s %-28s %11s %12s %10s %10s\n", "kernel", "params",
+               "items", "ns/item", "MB/s", "cycles/B");
+    }
+    o->records = 0;
+}
+
+void PrintResult(output_t *o, const kernel_result_t *r)
+{
+    double nsPerItem, mbps, cyclesPerByte;
+
+    nsPerItem = 1e9 * r->median / r->items;
+    mbps = r->median > 0.0 ? r->bytes / (1e6 * r->median) : 0.0;
+    cyclesPerByte = r->cycles / r->bytes;
+
+    if (o->json)
+    {
+        printf("%s\n    {\"kernel\": \"%s\", \"params\": \"%s\", "
+               "\"bytes\": %.0f, \"items\": %.0f, \"runs\": %d, "
+               "\"time\": %.9f, \"time_min\": %.9f, \"ns_per_item\": %.3f, "
+               "\"mbps\": %.2f, \"best_mbps\": %.2f, ",
+               o->records > 0 ? "," : "", r->kernel, r->params, r->bytes,
+               r->items, r->runs, r->median, r->min, nsPerItem, mbps,
+               r->min > 0.0 ? r->bytes / (1e6 * r->min) : 0.0);
+        if (r->cycles > 0.0)
+            printf("\"cycles_per_byte\": %.3f}", cyclesPerByte);
+        else
+            printf("\"cycles_per_byte\": null}");
+    }
+    else
+    {
+        printf("%-10s %-28s %11.0f %12.3f %10.2f ", r->kernel, r->params,
+               r->items, nsPerItem, mbps);
+        if (r->cycles > 0.0)
+            printf("%10.3f\n", cyclesPerByte);
+        else
+            printf("%10s\n", "-");
+    }
+    ++o->records;
+    fflush(stdout);
+}
+
+void EndOutput(output_t *o)
+{
+    if (o->json)
+        printf("%s]\n}\n", o->records > 0 ? "\n  " : "");
+}
+
+/*-- (end of output) --------------------------------------------------------*/
+
+
+/* Names of the kernels (in the order they are run) */
+static const char *KERNEL_NAMES[] = {
+    "checksum", "histogram", "update", "findmatch", "decode", NULL
+};
+
+/* Chain lengths that are tested by default (findmatch kernel) */
+static const lzg_uint32_t CHAIN_LENGTHS[] = {
+    1, 4, 16, 64, 256, 1024
+};
+
+#define NUM_ELEMENTS(x) (sizeof(x) / sizeof((x)[0]))
+
+void ShowUsage(char *prgName)
+{
+    int i;
+    fprintf(stderr, "Usage: %s [options] [kernel(s)]\n", prgName);
+    fprintf(stderr, "\nOptions:\n");
+    fprintf(stderr, " -1 ... -9      Compression level of the encoder kernels (default: 5)\n");
+    fprintf(stderr, " -s             Do not use the fast method (encoder kernels)\n");
+    fprintf(stderr, " -n N           Number of timed runs (default: %d)\n", DEFAULT_TIMED_RUNS);
+    fprintf(stderr, " -w N           Number of warm-up runs (default: %d)\n", DEFAULT_WARMUP_RUNS);
+    fprintf(stderr, " -size N        Size of the input data (default: 1M)\n");
+    fprintf(stderr, " -data T        Synthetic input data type (default: text)\n");
+    fprintf(stderr, " -seed N        Seed for the synthetic input data (default: 1)\n");
+    fprintf(stderr, " -chain N       Only test the chain length N (findmatch)\n");
+    fprintf(stderr, " -len N         Only test the copy length N (decode)\n");
+    fprintf(stderr, " -token T       Only test the token type T (decode)\n");
+    fprintf(stderr, " -nopin         Do not pin the benchmark to a CPU\n");
+    fprintf(stderr, " -json          Print the results in JSON format\n");
+    fprintf(stderr, "\nKernels (default: all):\n");
+    fprintf(stderr, " checksum       Checksum calculation\n");
+    fprintf(stderr, " histogram      Histogram and marker symbol selection (with and without\n");
+    fprintf(stderr, "                the content checksum)\n");
+    fprintf(stderr, " update         Search accelerator update (per input position)\n");
+    fprintf(stderr, " findmatch      Match search including the update (per chain step), for\n");
+    fprintf(stderr, "                different maximum chain lengths\n");
+    fprintf(stderr, " decode         Decoding of a stream of identical tokens (per token), for\n");
+    fprintf(stderr, "                each token type and copy length\n");
+    fprintf(stderr, "\nToken types: ");
+    for (i = 0; i < NUM_TOKEN_TYPES; ++i)
+        fprintf(stderr, "%s%s", i > 0 ? ", " : "", TOKEN_NAMES[i]);
+    fprintf(stderr, "\nData types: ");
+    for (i = 0; SyntheticTypeName(i); ++i)
+        fprintf(stderr, "%s%s", i > 0 ? ", " : "", SyntheticTypeName(i));
+    fprintf(stderr, "\n\nDescription:\n");
+    fprintf(stderr, "This program times the internal kernels of the library one by one, on\n");
+    fprintf(stderr, "synthetic input data (the same data on every machine for a given seed).\n");
+    fprintf(stderr, "The median time per item and throughput are printed to stdout.\n");
+}
+
+/* Parse a size, with an optional K/M suffix (0 if invalid) */
+static lzg_uint32_t ParseSize(const char *str)
+{
+    char *end;
+    unsigned long size = strtoul(str, &end, 10);
+    if (*end == 'K' || *end == 'k')
+        size *= 1024, ++end;
+    else if (*end == 'M' || *end == 'm')
+        size *= 1024 * 1024, ++end;
+    if (*end || size > 0x40000000)
+        return 0;
+    return (lzg_uint32_t) size;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned char *data = NULL, *stream;
+    const char *dataType;
+    unsigned int seed;
+    lzg_uint32_t size, chain, length, tokens, decodedSize;
+    int arg, i, j, level, fast, pin, warmupRuns, timedRuns, token, success;
+    int selected[NUM_ELEMENTS(KERNEL_NAMES)], anySelected;
+    tune_params_t params;
+    search_accel_t sa;
+    void *tables = NULL;
+    kernel_ctx_t ctx;
+    kernel_t k;
+    kernel_result_t r;
+    output_t out;
+
+    // Default arguments
+    level = 5;
+    fast = 1;
+    pin = 1;
+    warmupRuns = DEFAULT_WARMUP_RUNS;
+    timedRuns = DEFAULT_TIMED_RUNS;
+    size = DEFAULT_SIZE;
+    dataType = "text";
+    seed = 1;
+    chain = 0;
+    length = 0;
+    token = -1;
+    out.json = 0;
+    anySelected = 0;
+    for (i = 0; KERNEL_NAMES[i]; ++i)
+        selected[i] = 0;
+
+    // Get arguments
+    for (arg = 1; arg < argc; ++arg)
+    {
+        if (argv[arg][0] == '-' && argv[arg][1] >= '1' &&
+            argv[arg][1] <= '9' && !argv[arg][2])
+            level = argv[arg][1] - '0';
+        else if (strcmp("-s", argv[arg]) == 0)
+            fast = 0;
+        else if ((strcmp("-n", argv[arg]) == 0) && (arg + 1 < argc))
+            timedRuns = atoi(argv[++arg]);
+        else if ((strcmp("-w", argv[arg]) == 0) && (arg + 1 < argc))
+            warmupRuns = atoi(argv[++arg]);
+        else if ((strcmp("-size", argv[arg]) == 0) && (arg + 1 < argc))
+            size = ParseSize(argv[++arg]);
+        else if ((strcmp("-data", argv[arg]) == 0) && (arg + 1 < argc))
+            dataType = argv[++arg];
+        else if ((strcmp("-seed", argv[arg]) == 0) && (arg + 1 < argc))
+            seed = (unsigned int) strtoul(argv[++arg], NULL, 10);
+        else if ((strcmp("-chain", argv[arg]) == 0) && (arg + 1 < argc))
+            chain = (lzg_uint32_t) strtoul(argv[++arg], NULL, 10);
+        else if ((strcmp("-len", argv[arg]) == 0) && (arg + 1 < argc))
+            length = (lzg_uint32_t) strtoul(argv[++arg], NULL, 10);
+        else if ((strcmp("-token", argv[arg]) == 0) && (arg + 1 < argc))
+        {
+            ++arg;
+            for (token = NUM_TOKEN_TYPES - 1; token >= 0; --token)
+                if (strcmp(TOKEN_NAMES[token], argv[arg]) == 0)
+                    break;
+            if (token < 0)
+            {
+                fprintf(stderr, "Unknown token type \"%s\".\n", argv[arg]);
+                return 1;
+            }
+        }
+        else if (strcmp("-nopin", argv[arg]) == 0)
+            pin = 0;
+        else if (strcmp("-json", argv[arg]) == 0)
+            out.json = 1;
+        else if (argv[arg][0] == '-')
+        {
+            ShowUsage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            for (i = 0; KERNEL_NAMES[i]; ++i)
+                if (strcmp(KERNEL_NAMES[i], argv[arg]) == 0)
+                    break;
+            if (!KERNEL_NAMES[i])
+            {
+                fprintf(stderr, "Unknown kernel \"%s\".\n", argv[arg]);
+                return 1;
+            }
+            selected[i] = anySelected = 1;
+        }
+    }
+    if ((size < 4096) || (timedRuns < 1) || (warmupRuns < 0))
+    {
+        ShowUsage(argv[0]);
+        return 1;
+    }
+    if (!anySelected)
+        for (i = 0; KERNEL_NAMES[i]; ++i)
+            selected[i] = 1;
+
+    // Generate the input data
+    data = (unsigned char *) malloc(size);
+    if (!data)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    if (!GenerateSynthetic(dataType, data, size, seed))
+    {
+        fprintf(stderr, "Unknown data type \"%s\".\n", dataType);
+        free(data);
+        return 1;
+    }
+
+    // Pin the benchmark to the current CPU (stable caches and clocks)
+    if (pin && PinToCurrentCPU() < 0)
+        fprintf(stderr, "Warning: Unable to pin the benchmark to a CPU.\n");
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.data = data;
+    ctx.size = size;
+    params = _LZG_TUNING_PARAMETERS[level - 1];
+    success = 1;
+
+    BeginOutput(&out, dataType, size, seed, level, fast);
+
+    // Checksum
+    if (selected[0])
+    {
+        k.setup = NULL;
+        k.run = RunChecksum;
+        r.kernel = KERNEL_NAMES[0];
+        r.params[0] = 0;
+        r.bytes = r.items = size;
+        if (TimeKernel(&k, &ctx, warmupRuns, timedRuns, &r))
+            PrintResult(&out, &r);
+        else
+            success = 0;
+    }
+
+    // Histogram (with and without the content checksum)
+    for (i = 0; selected[1] && i < 2; ++i)
+    {
+        k.setup = NULL;
+        k.run = RunHistogram;
+        ctx.checksum = (lzg_bool_t) i;
+        r.kernel = KERNEL_NAMES[1];
+        sprintf(r.params, "checksum=%d", i);
+        r.bytes = r.items = size;
+        if (TimeKernel(&k, &ctx, warmupRuns, timedRuns, &r))
+            PrintResult(&out, &r);
+        else
+            success = 0;
+    }
+
+    // Search accelerator update and match search
+    if (selected[2] || selected[3])
+    {
+        tables = calloc(_LZG_SearchAccel_TableSize(&params, size, fast), 1);
+        if (tables)
+        {
+            _LZG_SearchAccel_Init(&sa, &params, size, fast, tables);
+            ctx.sa = &sa;
+        }
+        else
+        {
+            fprintf(stderr, "Out of memory.\n");
+            success = 0;
+        }
+    }
+    if (ctx.sa && selected[2])
+    {
+        k.setup = ResetSearchAccel;
+        k.run = RunUpdateLastPos;
+        r.kernel = KERNEL_NAMES[2];
+        sprintf(r.params, "level=%d fast=%d", level, fast);
+        r.bytes = r.items = size;
+        if (TimeKernel(&k, &ctx, warmupRuns, timedRuns, &r))
+            PrintResult(&out, &r);
+        else
+            success = 0;
+    }
+    for (j = 0; ctx.sa && selected[3] && j < (int) NUM_ELEMENTS(CHAIN_LENGTHS);
+         ++j)
+    {
+        if (chain && (j > 0))
+            break;
+
+        // Fixed maximum chain length (never stop early on a good match)
+        ctx.sa->params.maxMatches = chain ? chain : CHAIN_LENGTHS[j];
+        ctx.sa->params.goodLength = _LZG_MAX_RUN_LENGTH + 1;
+
+        k.setup = ResetSearchAccel;
+        k.run = RunFindMatch;
+        r.kernel = KERNEL_NAMES[3];
+        sprintf(r.params, "chain=%u level=%d fast=%d",
+                ctx.sa->params.maxMatches, level, fast);
+        r.bytes = size;
+        r.items = CountChainSteps(&ctx);
+        if (r.items < 1.0)
+            r.items = 1.0;
+        if (TimeKernel(&k, &ctx, warmupRuns, timedRuns, &r))
+            PrintResult(&out, &r);
+        else
+            success = 0;
+    }
+    free(tables);
+    ctx.sa = NULL;
+
+    // Decoder, per token type and copy length
+    for (i = 0; selected[4] && i < NUM_TOKEN_TYPES; ++i)
+    {
+        if ((token >= 0) && (i != token))
+            continue;
+        for (j = 0; j < (int) NUM_ELEMENTS(COPY_LENGTHS) + 1; ++j)
+        {
+            // Literal tokens have length 1 (the first item only)
+            lzg_uint32_t len = j == 0 ? 1 : COPY_LENGTHS[j - 1];
+            if (length)
+            {
+                if (j > 0)
+                    break;
+                len = (i == TOKEN_LITERAL || i == TOKEN_ESCAPED) ? 1 : length;
+            }
+            if (!CanEncode(i, len))
+                continue;
+
+            ctx.size = MakeTokenStream(i, len, size, data, &stream,
+                                       &decodedSize, &tokens);
+            if (!ctx.size)
+            {
+                fprintf(stderr, "Out of memory.\n");
+                success = 0;
+                break;
+            }
+            ctx.data = stream;
+            ctx.decodedSize = ctx.outSize = decodedSize;
+            ctx.out = (unsigned char *) malloc(decodedSize);
+            if (ctx.out)
+            {
+                k.setup = NULL;
+                k.run = RunDecode;
+                r.kernel = KERNEL_NAMES[4];
+                if (i == TOKEN_LITERAL || i == TOKEN_ESCAPED)
+                    sprintf(r.params, "token=%s", TOKEN_NAMES[i]);
+                else
+                    sprintf(r.params, "token=%s length=%u offset=%u",
+                            TOKEN_NAMES[i], len, TOKEN_OFFSETS[i]);
+                r.bytes = decodedSize;
+                r.items = tokens;
+                if (TimeKernel(&k, &ctx, warmupRuns, timedRuns, &r))
+                    PrintResult(&out, &r);
+                else
+                    success = 0;
+                free(ctx.out);
+            }
+            else
+            {
+                fprintf(stderr, "Out of memory.\n");
+                success = 0;
+            }
+            free(stream);
+            ctx.data = data;
+            ctx.size = size;
+        }
+    }
+
+    EndOutput(&out);
+
+    free(data);
+    return success ? 0 : 1;
+}
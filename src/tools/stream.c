@@ -0,0 +1,346 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; -*- */
+
+/*
+* This file is part of liblzg.
+*
+* Copyright (c) 2010-2011 Marcus Geelnard
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would
+*    be appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include <stdlib.h>
+#include "stream.h"
+
+#ifdef _WIN32
+# include <io.h>
+# include <fcntl.h>
+#else
+# define USE_THREADS
+# include <pthread.h>
+#endif
+
+/* Number of buffers per direction (double buffering) */
+#define NUM_BUFFERS 2
+
+/* Block status */
+#define BLOCK_DATA  0
+#define BLOCK_END   1
+#define BLOCK_ERROR 2
+
+
+/*-- Block queue ------------------------------------------------------------*/
+
+/* A queue that never holds more than NUM_BUFFERS blocks (the number of blocks
+   that are in circulation), so putting a block never blocks */
+typedef struct {
+    stream_block_t *items[NUM_BUFFERS];
+    int             head, count;
+#ifdef USE_THREADS
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+#endif
+} block_queue_t;
+
+static void InitQueue(block_queue_t *q)
+{
+    q->head = 0;
+    q->count = 0;
+#ifdef USE_THREADS
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+#endif
+}
+
+static void DestroyQueue(block_queue_t *q)
+{
+#ifdef USE_THREADS
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->mutex);
+#else
+    (void) q;
+#endif
+}
+
+static void QueuePut(block_queue_t *q, stream_block_t *blk)
+{
+#ifdef USE_THREADS
+    pthread_mutex_lock(&q->mutex);
+#endif
+    q->items[(q->head + q->count) % NUM_BUFFERS] = blk;
+    ++q->count;
+#ifdef USE_THREADS
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+#endif
+}
+
+static stream_block_t *QueueGet(block_queue_t *q)
+{
+    stream_block_t *blk;
+#ifdef USE_THREADS
+    pthread_mutex_lock(&q->mutex);
+    while (q->count == 0)
+        pthread_cond_wait(&q->cond, &q->mutex);
+#endif
+    blk = q->items[q->head];
+    q->head = (q->head + 1) % NUM_BUFFERS;
+    --q->count;
+#ifdef USE_THREADS
+    pthread_mutex_unlock(&q->mutex);
+#endif
+    return blk;
+}
+
+
+/*-- Stream processing ------------------------------------------------------*/
+
+typedef struct {
+    FILE           *inFile, *outFile;
+    READBLOCKFUN    readfun;
+    void           *userdata;
+    block_queue_t   freeIn, fullIn, freeOut, fullOut;
+    int             abort;
+    int             writeError;
+#ifdef USE_THREADS
+    pthread_mutex_t mutex;
+#endif
+} stream_t;
+
+/* The abort flag is shared by all the threads */
+static int IsAborted(stream_t *s)
+{
+    int abort;
+#ifdef USE_THREADS
+    pthread_mutex_lock(&s->mutex);
+#endif
+    abort = s->abort;
+#ifdef USE_THREADS
+    pthread_mutex_unlock(&s->mutex);
+#endif
+    return abort;
+}
+
+static void Abort(stream_t *s)
+{
+#ifdef USE_THREADS
+    pthread_mutex_lock(&s->mutex);
+#endif
+    s->abort = 1;
+#ifdef USE_THREADS
+    pthread_mutex_unlock(&s->mutex);
+#endif
+}
+
+int ReserveBlock(stream_block_t *blk, size_t size)
+{
+    unsigned char *data;
+    if (size <= blk->capacity)
+        return 1;
+    data = (unsigned char*) realloc(blk->data, size);
+    if (!data)
+        return 0;
+    blk->data = data;
+    blk->capacity = size;
+    return 1;
+}
+
+/* Read one block (reader side) */
+static int ReadNextBlock(stream_t *s)
+{
+    stream_block_t *blk;
+    int result;
+
+    blk = QueueGet(&s->freeIn);
+    if (IsAborted(s))
+        result = 0;
+    else
+        result = s->readfun(s->inFile, blk, s->userdata);
+    blk->status = result > 0 ? BLOCK_DATA :
+                  (result == 0 ? BLOCK_END : BLOCK_ERROR);
+    QueuePut(&s->fullIn, blk);
+    return result > 0;
+}
+
+/* Write one block (writer side) */
+static int WriteNextBlock(stream_t *s)
+{
+    stream_block_t *blk;
+    int status;
+
+    blk = QueueGet(&s->fullOut);
+    status = blk->status;
+    if ((status == BLOCK_DATA) && !s->writeError)
+    {
+        if (fwrite(blk->data, 1, blk->size, s->outFile) != blk->size)
+        {
+            fprintf(stderr, "Error writing to output file.\n");
+            s->writeError = 1;
+            Abort(s);
+        }
+    }
+    QueuePut(&s->freeOut, blk);
+    return status == BLOCK_DATA;
+}
+
+#ifdef USE_THREADS
+static void *ReaderThread(void *arg)
+{
+    stream_t *s = (stream_t *) arg;
+    while (ReadNextBlock(s));
+    return NULL;
+}
+
+static void *WriterThread(void *arg)
+{
+    stream_t *s = (stream_t *) arg;
+    while (WriteNextBlock(s));
+    return NULL;
+}
+#endif
+
+int ProcessStream(FILE *inFile, FILE *outFile, READBLOCKFUN readfun,
+                  PROCESSBLOCKFUN processfun, void *userdata)
+{
+    stream_t s;
+    stream_block_t blocks[2 * NUM_BUFFERS], *in, *out;
+    int i, success = 1, readerDone = 0, haveReader = 0, haveWriter = 0;
+#ifdef USE_THREADS
+    pthread_t reader, writer;
+#endif
+
+    s.inFile = inFile;
+    s.outFile = outFile;
+    s.readfun = readfun;
+    s.userdata = userdata;
+    s.abort = 0;
+    s.writeError = 0;
+#ifdef USE_THREADS
+    pthread_mutex_init(&s.mutex, NULL);
+#endif
+
+    /* Set up the buffer pools */
+    InitQueue(&s.freeIn);
+    InitQueue(&s.fullIn);
+    InitQueue(&s.freeOut);
+    InitQueue(&s.fullOut);
+    for (i = 0; i < 2 * NUM_BUFFERS; ++i)
+    {
+        blocks[i].data = (unsigned char*) 0;
+        blocks[i].size = 0;
+        blocks[i].capacity = 0;
+        blocks[i].status = BLOCK_DATA;
+        QueuePut(i < NUM_BUFFERS ? &s.freeIn : &s.freeOut, &blocks[i]);
+    }
+
+    /* Start the reader and writer threads (if a thread can't be created, its
+       work is done by this thread instead) */
+#ifdef USE_THREADS
+    haveReader = pthread_create(&reader, NULL, ReaderThread, &s) == 0;
+    haveWriter = pthread_create(&writer, NULL, WriterThread, &s) == 0;
+#endif
+
+    for (;;)
+    {
+        /* Get the next input block */
+        if (!haveReader)
+            ReadNextBlock(&s);
+        in = QueueGet(&s.fullIn);
+        if (in->status != BLOCK_DATA)
+        {
+            if (in->status == BLOCK_ERROR)
+                success = 0;
+            QueuePut(&s.freeIn, in);
+            readerDone = 1;
+            break;
+        }
+
+        /* Process it */
+        out = QueueGet(&s.freeOut);
+        out->size = 0;
+        out->status = BLOCK_DATA;
+        if (IsAborted(&s) || !processfun(in, out, userdata))
+        {
+            Abort(&s);
+            success = 0;
+        }
+        QueuePut(&s.freeIn, in);
+
+        /* Write it */
+        if (!success)
+        {
+            QueuePut(&s.freeOut, out);
+            break;
+        }
+        QueuePut(&s.fullOut, out);
+        if (!haveWriter)
+            WriteNextBlock(&s);
+    }
+
+    /* Tell the writer that we're done */
+    out = QueueGet(&s.freeOut);
+    out->status = BLOCK_END;
+    QueuePut(&s.fullOut, out);
+
+#ifdef USE_THREADS
+    /* If we stopped early, let the reader run until it notices the abort
+       flag */
+    if (haveReader)
+    {
+        while (!readerDone)
+        {
+            in = QueueGet(&s.fullIn);
+            readerDone = in->status != BLOCK_DATA;
+            QueuePut(&s.freeIn, in);
+        }
+        pthread_join(reader, NULL);
+    }
+    if (haveWriter)
+        pthread_join(writer, NULL);
+#endif
+    if (!haveWriter)
+        WriteNextBlock(&s);
+
+    if (s.writeError)
+        success = 0;
+    if (fflush(outFile) != 0)
+        success = 0;
+
+    /* Free resources */
+    for (i = 0; i < 2 * NUM_BUFFERS; ++i)
+        free(blocks[i].data);
+    DestroyQueue(&s.freeIn);
+    DestroyQueue(&s.fullIn);
+    DestroyQueue(&s.freeOut);
+    DestroyQueue(&s.fullOut);
+#ifdef USE_THREADS
+    pthread_mutex_destroy(&s.mutex);
+#endif
+
+    return success;
+}
+
+void SetBinaryMode(FILE *f)
+{
+#ifdef _WIN32
+    _setmode(_fileno(f), _O_BINARY);
+#else
+    (void) f;
+#endif
+}
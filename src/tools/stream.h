@@ -0,0 +1,71 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; -*- */
+
+/*
+* This file is part of liblzg.
+*
+* Copyright (c) 2010-2011 Marcus Geelnard
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would
+*    be appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#ifndef _LZG_STREAM_H_
+#define _LZG_STREAM_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+* Block stream processing for the LZG tools.
+*
+* Data that can not be loaded in one piece (e.g. data from a pipe) is processed
+* block by block. Reading, processing and writing overlap: a reader thread and
+* a writer thread run concurrently with the processing (calling) thread, using
+* double buffering (i.e. memory usage is bounded by a few blocks).
+*/
+
+/* Stream data block */
+typedef struct {
+    unsigned char *data;     /* Block data */
+    size_t         size;     /* Data size (number of bytes) */
+    size_t         capacity; /* Buffer size (number of bytes) */
+    int            status;   /* Internal block status */
+} stream_block_t;
+
+/* Read the next block from the input stream into blk.
+   Returns 1 on success, 0 at end of stream, or -1 on failure. */
+typedef int (*READBLOCKFUN)(FILE *f, stream_block_t *blk, void *userdata);
+
+/* Process one input block into an output block.
+   Returns non-zero on success. */
+typedef int (*PROCESSBLOCKFUN)(const stream_block_t *in, stream_block_t *out,
+                               void *userdata);
+
+/* Make sure that a block can hold at least size bytes.
+   Returns non-zero on success. */
+int ReserveBlock(stream_block_t *blk, size_t size);
+
+/* Process an entire stream. Returns non-zero on success. */
+int ProcessStream(FILE *inFile, FILE *outFile, READBLOCKFUN readfun,
+                  PROCESSBLOCKFUN processfun, void *userdata);
+
+/* Put a standard stream in binary mode (no-op on most systems). */
+void SetBinaryMode(FILE *f);
+
+#endif // _LZG_STREAM_H_
@@ -0,0 +1,443 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; -*- */
+
+/*
+* This file is part of liblzg.
+*
+* Copyright (c) 2010-2011 Marcus Geelnard
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would
+*    be appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <lzg.h>
+#include "synth.h"
+
+
+/*-- Random numbers ---------------------------------------------------------*/
+
+/* Xorshift generator (the same sequence on all platforms) */
+typedef struct {
+    lzg_uint32_t state;
+} rng_t;
+
+static lzg_uint32_t NextRandom(rng_t *r)
+{
+    lzg_uint32_t x = r->state;
+    x ^= (x << 13) & 0xffffffff;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xffffffff;
+    r->state = x;
+    return x;
+}
+
+static void SeedRandom(rng_t *r, unsigned int seed)
+{
+    int i;
+    r->state = (((lzg_uint32_t) seed * 0x9e3779b9) ^ 0x6a09e667) & 0xffffffff;
+    if (!r->state)
+        r->state = 1;
+    for (i = 0; i < 8; ++i)
+        NextRandom(r);
+}
+
+/* Random integer in the range [0, n) */
+static unsigned int RandomRange(rng_t *r, unsigned int n)
+{
+    return (unsigned int) ((NextRandom(r) >> 1) % n);
+}
+
+/* Random number in the range [0, 1) */
+static double RandomUnit(rng_t *r)
+{
+    return (double) NextRandom(r) * (1.0 / 4294967296.0);
+}
+
+/*-- (end of random numbers) ------------------------------------------------*/
+
+
+/*-- Output buffer ----------------------------------------------------------*/
+
+typedef struct {
+    unsigned char *buf;
+    size_t         size;
+    size_t         pos;
+} writer_t;
+
+static void PutByte(writer_t *w, unsigned char x)
+{
+    if (w->pos < w->size)
+        w->buf[w->pos++] = x;
+}
+
+static void PutString(writer_t *w, const char *str)
+{
+    while (*str && w->pos < w->size)
+        w->buf[w->pos++] = (unsigned char) *str++;
+}
+
+/* Little endian 32-bit integer */
+static void PutInt32(writer_t *w, lzg_uint32_t x)
+{
+    PutByte(w, (unsigned char) x);
+    PutByte(w, (unsigned char) (x >> 8));
+    PutByte(w, (unsigned char) (x >> 16));
+    PutByte(w, (unsigned char) (x >> 24));
+}
+
+/* Copy length bytes from offset bytes back (may overlap, like an LZ copy) */
+static void PutCopy(writer_t *w, size_t offset, size_t length)
+{
+    if (offset > w->pos)
+        return;
+    while (length-- && w->pos < w->size)
+    {
+        w->buf[w->pos] = w->buf[w->pos - offset];
+        ++w->pos;
+    }
+}
+
+/*-- (end of output buffer) -------------------------------------------------*/
+
+
+/*-- Words ------------------------------------------------------------------*/
+
+/* Common English words, in (roughly) decreasing order of frequency */
+static const char *WORDS[] = {
+    "the", "of", "and", "to", "a", "in", "is", "it", "you", "that", "he",
+    "was", "for", "on", "are", "with", "as", "his", "they", "be", "at", "one",
+    "have", "this", "from", "or", "had", "by", "hot", "word", "but", "what",
+    "some", "we", "can", "out", "other", "were", "all", "there", "when", "up",
+    "use", "your", "how", "said", "an", "each", "she", "which", "do", "their",
+    "time", "if", "will", "way", "about", "many", "then", "them", "write",
+    "would", "like", "so", "these", "her", "long", "make", "thing", "see",
+    "him", "two", "has", "look", "more", "day", "could", "go", "come", "did",
+    "number", "sound", "no", "most", "people", "my", "over", "know", "water",
+    "than", "call", "first", "who", "may", "down", "side", "been", "now",
+    "find", "any", "new", "work", "part", "take", "get", "place", "made",
+    "live", "where", "after", "back", "little", "only", "round", "man",
+    "year", "came", "show", "every", "good", "me", "give", "our", "under",
+    "name", "very", "through", "just", "form", "sentence", "great", "think",
+    "say", "help", "low", "line", "differ", "turn", "cause", "much", "mean",
+    "before", "move", "right", "boy", "old", "too", "same", "tell", "does",
+    "set", "three", "want", "air", "well", "also", "play", "small", "end",
+    "put", "home", "read", "hand", "port", "large", "spell", "add", "even",
+    "land", "here", "must", "big", "high", "such", "follow", "act", "why",
+    "ask", "men", "change", "went", "light", "kind", "off", "need", "house",
+    "picture", "try", "us", "again", "animal", "point", "mother", "world",
+    "near", "build", "self", "earth", "father", "head", "stand", "own",
+    "page", "should", "country", "found", "answer", "school", "grow", "study",
+    "still", "learn", "plant", "cover", "food", "sun", "four", "between",
+    "state", "keep", "eye", "never", "last", "let", "thought", "city", "tree",
+    "cross", "farm", "hard", "start", "might", "story", "saw", "far", "sea",
+    "draw", "left", "late", "run", "while", "press", "close", "night", "real",
+    "life", "few", "north"
+};
+#define NUM_WORDS ((int) (sizeof(WORDS) / sizeof(WORDS[0])))
+
+/* Number of likely successors of each word (Markov chain) */
+#define NUM_SUCCESSORS 6
+
+typedef struct {
+    rng_t  rng;
+    double cdf[NUM_WORDS];   /* Zipf distribution of the words */
+} words_t;
+
+static void InitWords(words_t *w, unsigned int seed)
+{
+    double sum = 0.0;
+    int i;
+    SeedRandom(&w->rng, seed);
+    for (i = 0; i < NUM_WORDS; ++i)
+    {
+        sum += 1.0 / (i + 1);
+        w->cdf[i] = sum;
+    }
+    for (i = 0; i < NUM_WORDS; ++i)
+        w->cdf[i] /= sum;
+}
+
+/* Pick a random word (Zipf distribution) */
+static int RandomWord(words_t *w)
+{
+    double x = RandomUnit(&w->rng);
+    int lo = 0, hi = NUM_WORDS - 1, mid;
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if (w->cdf[mid] < x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Pick the next word, given the previous word (first order Markov chain) */
+static int NextWord(words_t *w, int prev)
+{
+    if (RandomRange(&w->rng, 10) < 7)
+    {
+        // One of the likely successors of the previous word
+        return (prev * 37 + 11 + 53 * (int) RandomRange(&w->rng, NUM_SUCCESSORS))
+               % NUM_WORDS;
+    }
+    return RandomWord(w);
+}
+
+/* Write a word, optionally capitalized */
+static void PutWord(writer_t *out, int word, int capitalize)
+{
+    const char *str = WORDS[word];
+    if (capitalize && *str >= 'a' && *str <= 'z')
+    {
+        PutByte(out, (unsigned char) (*str - 'a' + 'A'));
+        ++str;
+    }
+    PutString(out, str);
+}
+
+/*-- (end of words) ---------------------------------------------------------*/
+
+
+/*-- Generators -------------------------------------------------------------*/
+
+static void GenerateRandom(writer_t *out, unsigned int seed)
+{
+    rng_t rng;
+    SeedRandom(&rng, seed);
+    while (out->pos < out->size)
+        PutInt32(out, NextRandom(&rng));
+}
+
+static void GenerateText(writer_t *out, unsigned int seed)
+{
+    words_t w;
+    int word, i, sentences = 0, length;
+
+    InitWords(&w, seed);
+    word = RandomWord(&w);
+    while (out->pos < out->size)
+    {
+        // Sentence
+        length = 4 + (int) RandomRange(&w.rng, 16);
+        for (i = 0; i < length; ++i)
+        {
+            word = NextWord(&w, word);
+            PutWord(out, word, i == 0);
+            if (i < length - 1)
+                PutString(out, RandomRange(&w.rng, 12) ? " " : ", ");
+        }
+        PutString(out, RandomRange(&w.rng, 10) ? "." : "?");
+
+        // Paragraph
+        if (++sentences >= 3 + (int) RandomRange(&w.rng, 5))
+        {
+            PutString(out, "\n\n");
+            sentences = 0;
+        }
+        else
+            PutByte(out, ' ');
+    }
+}
+
+static void GenerateJSON(writer_t *out, unsigned int seed)
+{
+    words_t w;
+    char tmp[128];
+    int first, last, i, tags;
+    unsigned int id = 100000;
+
+    InitWords(&w, seed);
+    PutString(out, "[\n");
+    while (out->pos < out->size)
+    {
+        first = RandomWord(&w);
+        last = RandomWord(&w);
+        id += 1 + RandomRange(&w.rng, 3);
+        sprintf(tmp, "  {\"id\": %u, \"name\": \"", id);
+        PutString(out, tmp);
+        PutWord(out, first, 1);
+        PutByte(out, ' ');
+        PutWord(out, last, 1);
+        PutString(out, "\", \"email\": \"");
+        PutWord(out, first, 0);
+        PutByte(out, '.');
+        PutWord(out, last, 0);
+        sprintf(tmp, "@example.com\", \"age\": %u, \"active\": %s, "
+                     "\"score\": %u.%02u, \"tags\": [",
+                18 + RandomRange(&w.rng, 60),
+                RandomRange(&w.rng, 4) ? "true" : "false",
+                RandomRange(&w.rng, 100), RandomRange(&w.rng, 100));
+        PutString(out, tmp);
+        tags = (int) RandomRange(&w.rng, 4);
+        for (i = 0; i < tags; ++i)
+        {
+            PutString(out, i ? ", \"" : "\"");
+            PutWord(out, RandomWord(&w), 0);
+            PutByte(out, '"');
+        }
+        PutString(out, "]},\n");
+    }
+}
+
+static void GenerateRuns(writer_t *out, unsigned int seed)
+{
+    rng_t rng;
+    unsigned int mode, i, length, period;
+    unsigned char x;
+
+    SeedRandom(&rng, seed);
+    while (out->pos < out->size)
+    {
+        mode = RandomRange(&rng, 10);
+        if (mode < 6)
+        {
+            // Run of a single byte (16 - 4096 bytes)
+            x = (unsigned char) NextRandom(&rng);
+            length = (16u << RandomRange(&rng, 8)) + RandomRange(&rng, 16);
+            for (i = 0; i < length; ++i)
+                PutByte(out, x);
+        }
+        else if (mode < 9)
+        {
+            // Short periodic pattern (period 2 - 8)
+            period = 2 + RandomRange(&rng, 7);
+            for (i = 0; i < period; ++i)
+                PutByte(out, (unsigned char) NextRandom(&rng));
+            PutCopy(out, period, 16 + RandomRange(&rng, 1024));
+        }
+        else
+        {
+            // Random bytes
+            length = 1 + RandomRange(&rng, 64);
+            for (i = 0; i < length; ++i)
+                PutByte(out, (unsigned char) NextRandom(&rng));
+        }
+    }
+}
+
+static void GenerateTable(writer_t *out, unsigned int seed)
+{
+    rng_t rng;
+    lzg_uint32_t id = 1, timestamp = 1300000000;
+
+    SeedRandom(&rng, seed);
+    while (out->pos < out->size)
+    {
+        // 32 byte record: mostly zeros, small values and counters
+        PutInt32(out, id++);
+        PutByte(out, (unsigned char) RandomRange(&rng, 4));
+        PutByte(out, (unsigned char) (RandomRange(&rng, 8) ? 0 : 1 << RandomRange(&rng, 8)));
+        PutByte(out, 0);
+        PutByte(out, 0);
+        PutInt32(out, RandomRange(&rng, 16) ? RandomRange(&rng, 1000) : NextRandom(&rng));
+        PutInt32(out, 0);
+        PutInt32(out, RandomRange(&rng, 4) ? 0 : RandomRange(&rng, 65536));
+        timestamp += RandomRange(&rng, 60);
+        PutInt32(out, timestamp);
+        PutInt32(out, 0);
+        PutInt32(out, 0);
+    }
+}
+
+static void GenerateMarkers(writer_t *out, unsigned int seed)
+{
+    rng_t rng;
+    unsigned char perm[256], x;
+    unsigned int i, j, n, length, next = 256;
+
+    SeedRandom(&rng, seed);
+    for (i = 0; i < 256; ++i)
+        perm[i] = (unsigned char) i;
+    while (out->pos < out->size)
+    {
+        if ((out->pos < 64) || RandomRange(&rng, 2))
+        {
+            // Literals, taking all 256 byte values in turn (random order)
+            length = 1 + RandomRange(&rng, 16);
+            for (n = 0; n < length; ++n)
+            {
+                if (next >= 256)
+                {
+                    for (i = 255; i > 0; --i)
+                    {
+                        j = RandomRange(&rng, i + 1);
+                        x = perm[i];
+                        perm[i] = perm[j];
+                        perm[j] = x;
+                    }
+                    next = 0;
+                }
+                PutByte(out, perm[next++]);
+            }
+        }
+        else
+        {
+            // Short copy from near by
+            PutCopy(out, 1 + RandomRange(&rng, 64), 3 + RandomRange(&rng, 6));
+        }
+    }
+}
+
+/*-- (end of generators) ----------------------------------------------------*/
+
+
+typedef void (*GENERATEFUN)(writer_t *out, unsigned int seed);
+
+static const struct {
+    const char *name;
+    GENERATEFUN fun;
+} GENERATORS[] = {
+    { "random",  GenerateRandom },
+    { "text",    GenerateText },
+    { "json",    GenerateJSON },
+    { "runs",    GenerateRuns },
+    { "table",   GenerateTable },
+    { "markers", GenerateMarkers }
+};
+#define NUM_GENERATORS ((int) (sizeof(GENERATORS) / sizeof(GENERATORS[0])))
+
+const char *SyntheticTypeName(int i)
+{
+    if (i < 0 || i >= NUM_GENERATORS)
+        return NULL;
+    return GENERATORS[i].name;
+}
+
+int GenerateSynthetic(const char *type, unsigned char *buf, size_t size,
+                      unsigned int seed)
+{
+    writer_t out;
+    int i;
+
+    for (i = 0; i < NUM_GENERATORS; ++i)
+    {
+        if (strcmp(type, GENERATORS[i].name) == 0)
+        {
+            out.buf = buf;
+            out.size = size;
+            out.pos = 0;
+            GENERATORS[i].fun(&out, seed);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+/* -*- mode: c; tab-width: 4; indent-tabs-mode: nil; -*- */
+
+/*
+* This file is part of liblzg.
+*
+* Copyright (c) 2010-2011 Marcus Geelnard
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would
+*    be appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#ifndef _LZG_SYNTH_H_
+#define _LZG_SYNTH_H_
+
+#include <stddef.h>
+
+/*
+* Synthetic benchmark data.
+*
+* The generators produce deterministic data for a given seed (the same bytes on
+* every machine), so that benchmarks can be repeated without access to any
+* external test corpus. Each data type targets specific parts of the LZG
+* encoder and decoder:
+*
+*  random   Uniformly distributed bytes (literals only, incompressible).
+*  text     English-like text from a word level Markov chain (mixed copies).
+*  json     JSON-like records with repeating keys (medium and distant copies).
+*  runs     Long runs and short periodic patterns (near copies, RLE).
+*  table    Sparse fixed size binary records (short and medium copies).
+*  markers  All byte values equally frequent, with near copies (escaped
+*           marker symbols among the literals).
+*/
+
+/* Get the name of synthetic data type number i (NULL if i is out of range). */
+const char *SyntheticTypeName(int i);
+
+/* Fill a buffer with synthetic data of the given type. Returns non-zero on
+   success, or zero if the type is unknown. */
+int GenerateSynthetic(const char *type, unsigned char *buf, size_t size,
+                      unsigned int seed);
+
+#endif // _LZG_SYNTH_H_
@@ -27,113 +27,384 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <lzg.h>
+#include "fileio.h"
+#include "stream.h"
 
-int main(int argc, char **argv)
+/* Header size (enough for LZG_EncodedSize) */
+#define HEADER_SIZE 16
+
+/* Largest decoded block that is accepted in stream mode (the lzg tool writes
+   4 MB blocks). This bounds the memory usage for untrusted input. */
+#define MAX_STREAM_BLOCK_SIZE (64 * 1024 * 1024)
+
+static int ReadLZGBlock(FILE *f, stream_block_t *blk, void *userdata)
+{
+    lzg_uint32_t encSize;
+    size_t count;
+
+    (void) userdata;
+    if (!ReserveBlock(blk, HEADER_SIZE))
+        return -1;
+
+    // Read the header
+    count = fread(blk->data, 1, HEADER_SIZE, f);
+    if (count == 0)
+    {
+        if (!ferror(f))
+            return 0;
+        fprintf(stderr, "Error reading input data.\n");
+        return -1;
+    }
+    encSize = LZG_EncodedSize(blk->data, (lzg_uint32_t) count);
+    if (!encSize)
+    {
+        fprintf(stderr, "Bad input data!\n");
+        return -1;
+    }
+    if (encSize > LZG_MaxEncodedSize(MAX_STREAM_BLOCK_SIZE))
+    {
+        fprintf(stderr, "Block too large for stream mode (max %d MB).\n",
+                MAX_STREAM_BLOCK_SIZE / (1024 * 1024));
+        return -1;
+    }
+
+    // Read the rest of the coded buffer
+    if (!ReserveBlock(blk, encSize))
+    {
+        fprintf(stderr, "Out of memory!\n");
+        return -1;
+    }
+    if (fread(blk->data + HEADER_SIZE, 1, encSize - HEADER_SIZE, f) !=
+        encSize - HEADER_SIZE)
+    {
+        fprintf(stderr, "Bad input data!\n");
+        return -1;
+    }
+    blk->size = encSize;
+
+    return 1;
+}
+
+static int DecompressBlock(const stream_block_t *in, stream_block_t *out,
+                           void *userdata)
 {
-    FILE *inFile, *outFile;
-    size_t fileSize;
-    unsigned char *encBuf;
-    lzg_uint32_t encSize = 0;
-    unsigned char *decBuf;
     lzg_uint32_t decSize;
-    int useStdout = 0;
 
-    // Check arguments
-    if ((argc < 2) || (argc > 3))
+    (void) userdata;
+
+    // Determine size of decompressed data (an empty block has no data to
+    // decode, so it is only checked)
+    decSize = LZG_DecodedSize(in->data, (lzg_uint32_t) in->size);
+    if (!decSize)
     {
-        fprintf(stderr, "Usage: %s infile [outfile]\n", argv[0]);
-        fprintf(stderr, "If no output file is given, stdout is used for output.\n");
+        out->size = 0;
+        if (LZG_Validate(in->data, (lzg_uint32_t) in->size, NULL))
+            return 1;
+        fprintf(stderr, "Bad input data!\n");
+        return 0;
+    }
+    if (decSize > MAX_STREAM_BLOCK_SIZE)
+    {
+        fprintf(stderr, "Block too large for stream mode (max %d MB).\n",
+                MAX_STREAM_BLOCK_SIZE / (1024 * 1024));
         return 0;
     }
 
-    // Use stdout?
-    if (argc < 3)
-        useStdout = 1;
+    // Allocate memory for the decompressed data
+    if (!ReserveBlock(out, decSize))
+    {
+        fprintf(stderr, "Out of memory!\n");
+        return 0;
+    }
 
-    // Read input file
-    encBuf = (unsigned char*) 0;
-    inFile = fopen(argv[1], "rb");
-    if (inFile)
-    {
-        fseek(inFile, 0, SEEK_END);
-        fileSize = ftell(inFile);
-        fseek(inFile, 0, SEEK_SET);
-        if (fileSize > 0)
+    // Decompress
+    out->size = LZG_Decode(in->data, (lzg_uint32_t) in->size, out->data,
+                           decSize);
+    if (!out->size)
+    {
+        fprintf(stderr, "Decompression failed (bad data)!\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+static int DecompressStream(char *inName, char *outName)
+{
+    FILE *inFile, *outFile;
+    int success;
+
+    // Open input and output streams
+    if (strcmp(inName, "-") == 0)
+    {
+        inFile = stdin;
+        SetBinaryMode(stdin);
+    }
+    else if (!(inFile = fopen(inName, "rb")))
+    {
+        fprintf(stderr, "Unable to open file \"%s\".\n", inName);
+        return 0;
+    }
+    if (!outName)
+    {
+        outFile = stdout;
+        SetBinaryMode(stdout);
+    }
+    else if (!(outFile = fopen(outName, "wb")))
+    {
+        fprintf(stderr, "Unable to open file \"%s\".\n", outName);
+        if (inFile != stdin)
+            fclose(inFile);
+        return 0;
+    }
+
+    // Decompress block by block
+    success = ProcessStream(inFile, outFile, ReadLZGBlock, DecompressBlock,
+                            NULL);
+
+    // Close files
+    if (inFile != stdin)
+        fclose(inFile);
+    if (outFile != stdout)
+        fclose(outFile);
+
+    return success;
+}
+
+/* Determine the total decompressed size of a sequence of LZG coded buffers.
+   Returns zero if the data is invalid (empty buffers are valid, and they are
+   checked here since decoding them gives no result to check). */
+static int TotalDecodedSize(const unsigned char *in, size_t insize,
+                            size_t *total)
+{
+    size_t pos = 0, avail;
+    lzg_uint32_t encSize, decSize;
+    *total = 0;
+    while (pos < insize)
+    {
+        avail = insize - pos;
+        if (avail > 0xffffffff)
+            avail = 0xffffffff;
+        encSize = LZG_EncodedSize(in + pos, (lzg_uint32_t) avail);
+        decSize = LZG_DecodedSize(in + pos, (lzg_uint32_t) avail);
+        if (!encSize || (encSize > avail))
+            return 0;
+        if (!decSize && !LZG_Validate(in + pos, encSize, NULL))
+            return 0;
+        *total += decSize;
+        pos += encSize;
+    }
+    return insize > 0;
+}
+
+/* Check that all the LZG coded buffers in a file are valid (without
+   decoding them). Returns non-zero if the file is valid. */
+static int TestFile(const char *name, int verbose)
+{
+    in_file_t inFile;
+    lzg_decoder_stats_t stats;
+    size_t pos, avail, blocks = 0;
+    lzg_uint32_t encSize, maxOffset = 0;
+    double decTotal = 0.0, literals = 0.0;
+    int success = 1;
+
+    if (!OpenInputFile(name, &inFile))
+        return 0;
+
+    for (pos = 0; pos < inFile.size; pos += encSize)
+    {
+        avail = inFile.size - pos;
+        if (avail > 0xffffffff)
+            avail = 0xffffffff;
+        encSize = LZG_EncodedSize(inFile.data + pos, (lzg_uint32_t) avail);
+        if (!encSize || (encSize > avail) ||
+            !LZG_Validate(inFile.data + pos, encSize, verbose ? &stats : NULL))
         {
-            encSize = (lzg_uint32_t) fileSize;
-            encBuf = (unsigned char*) malloc(encSize);
-            if (encBuf)
-            {
-                if (fread(encBuf, 1, encSize, inFile) != encSize)
-                {
-                    fprintf(stderr, "Error reading \"%s\".\n", argv[1]);
-                    free(encBuf);
-                    encBuf = (unsigned char*) 0;
-                }
-            }
-            else
-                fprintf(stderr, "Out of memory.\n");
+            success = 0;
+            break;
+        }
+        ++blocks;
+        if (verbose)
+        {
+            decTotal += LZG_DecodedSize(inFile.data + pos, encSize);
+            literals += stats.literals + stats.escapedLiterals;
+            if (stats.maxOffset > maxOffset)
+                maxOffset = stats.maxOffset;
+        }
+    }
+    if (inFile.size == 0)
+        success = 0;
+
+    if (!success)
+        fprintf(stderr, "%s: Bad data (block %d, offset %lu)\n", name,
+                (int) blocks, (unsigned long) pos);
+    else if (verbose)
+        printf("%s: OK (%d blocks, %.0f bytes, max offset %u, %.1f%% "
+               "literals)\n", name, (int) blocks, decTotal, maxOffset,
+               decTotal > 0.0 ? (100.0 * literals) / decTotal : 0.0);
+
+    CloseInputFile(&inFile);
+    return success;
+}
+
+/* Decompress only the first count bytes of a file (the decoding stops early,
+   and the checksums are not verified). Returns non-zero on success. */
+static int HeadFile(const char *inName, const char *outName, size_t count)
+{
+    in_file_t inFile;
+    out_file_t outFile;
+    size_t pos, decPos, avail, total;
+    lzg_uint32_t encSize, decSize, size;
+    int success = 0;
+
+    if (!OpenInputFile(inName, &inFile))
+        return 0;
+
+    // Clamp the count to the decompressed size
+    if (!TotalDecodedSize(inFile.data, inFile.size, &total))
+    {
+        fprintf(stderr, "Bad input data!\n");
+        CloseInputFile(&inFile);
+        return 0;
+    }
+    if (count > total)
+        count = total;
+
+    if (CreateOutputFile(outName, count, &inFile, &outFile))
+    {
+        // Decompress block by block, until we have enough data
+        pos = 0;
+        decPos = 0;
+        while (decPos < count)
+        {
+            avail = count - decPos;
+            size = avail > 0xffffffff ? 0xffffffff : (lzg_uint32_t) avail;
+            encSize = LZG_EncodedSize(inFile.data + pos, HEADER_SIZE);
+            decSize = LZG_DecodePrefix(inFile.data + pos, encSize,
+                                       outFile.data + decPos, size, LZG_FALSE);
+            if (!decSize && LZG_DecodedSize(inFile.data + pos, encSize))
+                break;
+            pos += encSize;
+            decPos += decSize;
         }
+        if (decPos == count)
+            success = CloseOutputFile(&outFile, count);
         else
-            fprintf(stderr, "Input file is empty.\n");
+        {
+            fprintf(stderr, "Decompression failed (bad data)!\n");
+            AbortOutputFile(&outFile);
+        }
+    }
 
-        fclose(inFile);
+    CloseInputFile(&inFile);
+    return success;
+}
+
+int main(int argc, char **argv)
+{
+    char *inName, *outName;
+    in_file_t inFile;
+    out_file_t outFile;
+    size_t pos, decPos, decTotal, avail;
+    lzg_uint32_t encSize, decSize;
+    int arg, verbose, failures, success = 0;
+
+    // Test mode?
+    if ((argc >= 3) && (strcmp(argv[1], "-t") == 0))
+    {
+        verbose = (argc >= 4) && (strcmp(argv[2], "-v") == 0);
+        failures = 0;
+        for (arg = verbose ? 3 : 2; arg < argc; ++arg)
+        {
+            if (!TestFile(argv[arg], verbose))
+                ++failures;
+        }
+        return failures ? 1 : 0;
+    }
+
+    // Head mode?
+    if ((argc >= 4) && (argc <= 5) && (strcmp(argv[1], "-n") == 0))
+    {
+        outName = argc < 5 ? NULL : argv[4];
+        if (outName && (strcmp(outName, "-") == 0))
+            outName = NULL;
+        return HeadFile(argv[3], outName, (size_t) atol(argv[2])) ? 0 : 1;
     }
-    else
-        fprintf(stderr, "Unable to open file \"%s\".\n", argv[1]);
 
-    if (!encBuf)
+    // Check arguments
+    if ((argc < 2) || (argc > 3))
+    {
+        fprintf(stderr, "Usage: %s infile [outfile]\n", argv[0]);
+        fprintf(stderr, "       %s -t [-v] file1 file2 ...\n", argv[0]);
+        fprintf(stderr, "       %s -n N infile [outfile]\n", argv[0]);
+        fprintf(stderr, "If no output file is given, stdout is used for output.\n");
+        fprintf(stderr, "If infile is -, stdin is used for input (blocks of up to %d MB).\n",
+                MAX_STREAM_BLOCK_SIZE / (1024 * 1024));
+        fprintf(stderr, "With -t, the files are checked without decoding them (-v: print\n");
+        fprintf(stderr, "statistics), and the exit code is 1 if any file is invalid. The\n");
+        fprintf(stderr, "checksum of the decompressed data (lzg -c) is not checked.\n");
+        fprintf(stderr, "With -n, only the first N bytes are decompressed (without checking the\n");
+        fprintf(stderr, "whole file).\n");
         return 0;
+    }
+    inName = argv[1];
+    outName = argc < 3 ? NULL : argv[2];
+    if (outName && (strcmp(outName, "-") == 0))
+        outName = NULL;
+
+    // Input from stdin or a pipe? (can't be loaded in one piece)
+    if ((strcmp(inName, "-") == 0) || !IsRegularFile(inName))
+    {
+        return DecompressStream(inName, outName) ? 0 : 1;
+    }
+
+    // Read input file
+    if (!OpenInputFile(inName, &inFile))
+        return 1;
 
-    // Determine size of decompressed data
-    decSize = LZG_DecodedSize(encBuf, encSize);
-    if (decSize)
+    // Determine size of decompressed data (the file may hold several coded
+    // buffers, e.g. if it was compressed from a stream)
+    if (TotalDecodedSize(inFile.data, inFile.size, &decTotal))
     {
-        // Allocate memory for the decompressed data
-        decBuf = (unsigned char*) malloc(decSize);
-        if (decBuf)
+        // Create the output file (the data is decompressed directly to it)
+        if (CreateOutputFile(outName, decTotal, &inFile, &outFile))
         {
             // Decompress
-            decSize = LZG_Decode(encBuf, encSize, decBuf, decSize);
-            if (decSize)
+            pos = 0;
+            decPos = 0;
+            while (pos < inFile.size)
             {
-                // Uncompressed data is now in decBuf, write it...
-                if (!useStdout)
-                {
-                    outFile = fopen(argv[2], "wb");
-                    if (!outFile)
-                        fprintf(stderr, "Unable to open file \"%s\".\n", argv[2]);
-                }
-                else
-                    outFile = stdout;
-
-                if (outFile)
-                {
-                    // Write data
-                    if (fwrite(decBuf, 1, decSize, outFile) != decSize)
-                        fprintf(stderr, "Error writing to output file.\n");
-
-                    // Close file
-                    if (!useStdout)
-                        fclose(outFile);
-                }
+                avail = decTotal - decPos;
+                if (avail > 0xffffffff)
+                    avail = 0xffffffff;
+                encSize = LZG_EncodedSize(inFile.data + pos, HEADER_SIZE);
+                decSize = LZG_Decode(inFile.data + pos, encSize,
+                                     outFile.data + decPos,
+                                     (lzg_uint32_t) avail);
+                if (!decSize && LZG_DecodedSize(inFile.data + pos, encSize))
+                    break;
+                pos += encSize;
+                decPos += decSize;
+            }
+            if (pos == inFile.size)
+            {
+                // Uncompressed data is now in the output buffer, write it...
+                success = CloseOutputFile(&outFile, decTotal);
             }
             else
+            {
                 fprintf(stderr, "Decompression failed (bad data)!\n");
-
-            // Free memory when we're done with the decompressed data
-            free(decBuf);
+                AbortOutputFile(&outFile);
+            }
         }
-        else
-            fprintf(stderr, "Out of memory!\n");
     }
     else
         fprintf(stderr, "Bad input data!\n");
 
     // Free memory
-    free(encBuf);
+    CloseInputFile(&inFile);
 
-    return 0;
+    return success ? 0 : 1;
 }
-